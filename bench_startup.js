@@ -0,0 +1,173 @@
+// time to first frame of the web build, measured headless on node: every run
+// is a fresh process that loads jnb.js the way the page does, compiles the
+// module while it streams in from disk, starts a game from the embedded levels
+// and makes the calls draw_game makes for the first frame
+//
+// usage: node bench_startup.js [--runs N] [--buffered] [--dir DIR]
+// after ./build_wasm.sh release; --buffered reads the whole module before
+// compiling it, like a server that doesn't send application/wasm
+
+"use strict";
+
+const { execFileSync } = require("child_process");
+const fs = require("fs");
+const path = require("path");
+const { Readable } = require("stream");
+
+const BOARD_WIDTH = 14;
+const BOARD_HEIGHT = 10;
+
+const METRICS = [
+  ["load", "loading jnb.js"],
+  ["ready", "compiling and instantiating jnb.wasm"],
+  ["new", "starting a game"],
+  ["frame", "reading the board for the first frame"],
+  ["total", "time to first frame"],
+];
+
+// one run in this process, printed as JSON for the parent
+async function measure(dir, buffered) {
+  const wasm_path = path.join(dir, "jnb.wasm");
+  // node loads its fetch and web streams on first use, which browsers don't
+  await new Response(Readable.toWeb(Readable.from([]))).arrayBuffer();
+  const start = performance.now();
+  const createJnb = require(path.resolve(dir, "jnb.js"));
+  const loaded = performance.now();
+
+  const instance = await createJnb({
+    instantiateWasm(imports, receive) {
+      const source = buffered
+        ? WebAssembly.instantiate(fs.readFileSync(wasm_path), imports)
+        : WebAssembly.instantiateStreaming(
+            new Response(Readable.toWeb(fs.createReadStream(wasm_path)), {
+              headers: { "Content-Type": "application/wasm" },
+            }),
+            imports
+          );
+      source.then((result) => receive(result.instance, result.module));
+      return {};
+    },
+  });
+  const ready = performance.now();
+
+  const call = (name, ret, args) => instance.cwrap(name, ret, args);
+  const game = call("GAME_new", "number", [])();
+  const created = performance.now();
+
+  const get_cell = call("GAME_get_cell", "number", [
+    "number",
+    "number",
+    "number",
+  ]);
+  const get_cell_type = call("GAME_get_cell_type", "number", [
+    "number",
+    "number",
+  ]);
+  const get_color = call("GAME_get_color", "number", ["number", "number"]);
+  const where_connected = call("GAME_cell_where_connected", "number", [
+    "number",
+    "number",
+  ]);
+  call("GAME_is_solved", "boolean", ["number"])(game);
+  call("GAME_colors_remaining", "number", ["number"])(game);
+  for (let y = 0; y < BOARD_HEIGHT; y++) {
+    for (let x = 0; x < BOARD_WIDTH; x++) {
+      const cell = get_cell(game, x, y);
+      if (get_cell_type(game, cell) != 0) {
+        get_color(game, cell);
+        where_connected(game, cell);
+      }
+    }
+  }
+  const frame = performance.now();
+  call("GAME_free", null, ["number"])(game);
+
+  console.log(
+    JSON.stringify({
+      load: loaded - start,
+      ready: ready - loaded,
+      new: created - ready,
+      frame: frame - created,
+      total: frame - start,
+    })
+  );
+}
+
+function median(values) {
+  const sorted = [...values].sort((a, b) => a - b);
+  const mid = sorted.length >> 1;
+  return sorted.length % 2 ? sorted[mid] : (sorted[mid - 1] + sorted[mid]) / 2;
+}
+
+function main() {
+  const args = process.argv.slice(2);
+  let runs = 20;
+  let buffered = false;
+  let dir = path.join(__dirname, "web");
+  let child = false;
+  for (let i = 0; i < args.length; i++) {
+    if (args[i] == "--runs" && i + 1 < args.length) {
+      runs = parseInt(args[++i]);
+    } else if (args[i] == "--buffered") {
+      buffered = true;
+    } else if (args[i] == "--dir" && i + 1 < args.length) {
+      dir = args[++i];
+    } else if (args[i] == "--child") {
+      child = true;
+    } else {
+      console.error(
+        "usage: node bench_startup.js [--runs N] [--buffered] [--dir DIR]"
+      );
+      process.exit(1);
+    }
+  }
+
+  if (child) {
+    measure(dir, buffered).catch((err) => {
+      console.error(err);
+      process.exit(1);
+    });
+    return;
+  }
+
+  const wasm_path = path.join(dir, "jnb.wasm");
+  if (!fs.existsSync(wasm_path)) {
+    console.error(wasm_path + " is missing, run ./build_wasm.sh release");
+    process.exit(1);
+  }
+  // fresh processes, so that no run reuses what an earlier one compiled
+  const results = [];
+  for (let i = 0; i < runs; i++) {
+    const child_args = [__filename, "--child", "--dir", dir];
+    if (buffered) {
+      child_args.push("--buffered");
+    }
+    const output = execFileSync(process.execPath, child_args, {
+      encoding: "utf8",
+    });
+    results.push(JSON.parse(output.trim().split("\n").pop()));
+  }
+
+  console.log(
+    "jnb.wasm " +
+      (fs.statSync(wasm_path).size / 1024).toFixed(1) +
+      " KiB, " +
+      (buffered ? "buffered" : "streaming") +
+      " compilation, " +
+      runs +
+      " runs"
+  );
+  for (const [key, description] of METRICS) {
+    const values = results.map((result) => result[key]);
+    console.log(
+      key.padEnd(6) +
+        median(values).toFixed(2).padStart(9) +
+        " ms median, " +
+        Math.min(...values).toFixed(2).padStart(8) +
+        " ms min  " +
+        description
+    );
+  }
+}
+
+main();
@@ -12,12 +12,25 @@ fi
 
 python3 gen_funclist.py
 
-FILES="src/game.c src/web.c src/util.c src/b64.c"
+ENGINE="src/game.c src/pack.c src/util.c"
+FILES="$ENGINE src/bigmem.c src/solver.c src/solver_ext.c src/web.c src/b64.c build/web_levels.c"
 
-mkdir -p web
-eval emcc -o web/jnb.html $FILES \
+# the levels are preprocessed by the engine built for the same target, so that
+# the bytes embedded in the module have its layout; LEVELS can name other packs
+LEVELS="${LEVELS:-levels/web.txt}"
+mkdir -p build web
+emcc -o build/embed_levels.js src/embed_levels.c $ENGINE -O2 -sNODERAWFS=1
+"${EMSDK_NODE:-node}" build/embed_levels.js build/web_levels.c $LEVELS
+
+# a factory instead of a global Module, which game.js calls once the page is
+# parsed; the module is compiled while it streams in, see index.html
+eval emcc -o web/jnb.js $FILES \
+    -Isrc \
     $EXTRA_FLAGS \
     -sWASM=1 \
     -Wall \
+    -sALLOW_MEMORY_GROWTH=1 \
+    -sMODULARIZE=1 \
+    -sEXPORT_NAME=createJnb \
     -sEXPORTED_RUNTIME_METHODS=ccall,cwrap \
     $(cat emcc_funclist.txt)
@@ -0,0 +1,206 @@
+#if defined(__linux__) && !defined(__EMSCRIPTEN__)
+    // for MAP_HUGETLB and syscall
+    #define _GNU_SOURCE
+#endif
+
+#include "bigmem.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__) && !defined(__EMSCRIPTEN__)
+    #define BIGMEM_USE_MMAP
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+// mappings are rounded up to this, and aligned to it so that transparent huge
+// pages can back all of them
+#define BIGMEM_HUGE_PAGE ((size_t)2 << 20)
+
+// MPOL_PREFERRED of <numaif.h>; the system call is made directly, so libnuma
+// isn't needed
+#define BIGMEM_MPOL_PREFERRED 1
+
+// NUMA nodes the binding handles
+#define BIGMEM_MAX_NODES 1024
+
+// in front of every allocation, padded so that the memory after it is as
+// aligned as malloc's
+#define BIGMEM_HEADER_SIZE 64
+
+struct BigMemHeader {
+    // bytes asked for
+    size_t size;
+    // bytes mapped, the header included; 0 for the heap
+    size_t map_size;
+    BigMemMode mode;
+};
+
+static_assert(
+    sizeof(struct BigMemHeader) <= BIGMEM_HEADER_SIZE,
+    "the header fits in front of the memory");
+
+static inline struct BigMemHeader *header_of(void *ptr) {
+    return (struct BigMemHeader *)((unsigned char *)ptr - BIGMEM_HEADER_SIZE);
+}
+
+static inline void *memory_of(struct BigMemHeader *header) {
+    return (unsigned char *)header + BIGMEM_HEADER_SIZE;
+}
+
+static bool wants_mapping(size_t size, const struct BigMemOptions *options) {
+#ifdef BIGMEM_USE_MMAP
+    return (options->huge_pages || options->numa_local) &&
+           size >= BIGMEM_MIN_MAPPED;
+#else
+    (void)size;
+    (void)options;
+    return false;
+#endif
+}
+
+#ifdef BIGMEM_USE_MMAP
+// prefers the node of the CPU the thread runs on for the pages of the mapping
+// that haven't been touched yet
+static bool bind_local(void *base, size_t size) {
+    unsigned cpu;
+    unsigned node;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0 ||
+        node >= BIGMEM_MAX_NODES)
+        return false;
+    unsigned long mask[BIGMEM_MAX_NODES / (8 * sizeof(unsigned long))] = {0};
+    mask[node / (8 * sizeof(unsigned long))] |=
+        1ul << (node % (8 * sizeof(unsigned long)));
+    return syscall(
+               SYS_mbind, base, size, BIGMEM_MPOL_PREFERRED, mask,
+               (unsigned long)BIGMEM_MAX_NODES, 0) == 0;
+}
+
+static struct BigMemHeader *
+    map_memory(size_t size, const struct BigMemOptions *options) {
+    size_t map_size = (size + BIGMEM_HEADER_SIZE + BIGMEM_HUGE_PAGE - 1) /
+                      BIGMEM_HUGE_PAGE * BIGMEM_HUGE_PAGE;
+    BigMemMode mode = 0;
+    unsigned char *base = MAP_FAILED;
+    if (options->huge_pages) {
+        base = mmap(
+            NULL, map_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        mode = BIGMEM_HUGETLB;
+    }
+    if (base == MAP_FAILED) {
+        // a huge page more than needed, and the ends trimmed so that what is
+        // left starts at a huge page boundary
+        size_t padded = map_size + BIGMEM_HUGE_PAGE;
+        unsigned char *raw = mmap(
+            NULL, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+            -1, 0);
+        if (raw == MAP_FAILED)
+            return NULL;
+        base = (unsigned char *)(((uintptr_t)raw + BIGMEM_HUGE_PAGE - 1) /
+                                 BIGMEM_HUGE_PAGE * BIGMEM_HUGE_PAGE);
+        if (base > raw)
+            munmap(raw, base - raw);
+        if (raw + padded > base + map_size)
+            munmap(base + map_size, raw + padded - (base + map_size));
+        bool advised = options->huge_pages &&
+                       madvise(base, map_size, MADV_HUGEPAGE) == 0;
+        mode = advised ? BIGMEM_THP : BIGMEM_PAGES;
+    }
+    if (options->numa_local && bind_local(base, map_size))
+        mode |= BIGMEM_NUMA;
+
+    struct BigMemHeader *header = (struct BigMemHeader *)base;
+    *header = (struct BigMemHeader){
+        .size = size,
+        .map_size = map_size,
+        .mode = mode,
+    };
+    return header;
+}
+#endif
+
+void *bigmem_alloc(
+    size_t size, const struct BigMemOptions *options, BigMemMode *modes) {
+    struct BigMemHeader *header = NULL;
+#ifdef BIGMEM_USE_MMAP
+    if (wants_mapping(size, options))
+        header = map_memory(size, options);
+#endif
+    // the heap is the fallback as well
+    if (header == NULL) {
+        header = malloc(BIGMEM_HEADER_SIZE + size);
+        if (header == NULL)
+            return NULL;
+        *header = (struct BigMemHeader){.size = size, .mode = BIGMEM_HEAP};
+    }
+    *modes |= header->mode;
+    return memory_of(header);
+}
+
+void *bigmem_realloc(
+    void *ptr,
+    size_t size,
+    const struct BigMemOptions *options,
+    BigMemMode *modes) {
+    if (ptr == NULL)
+        return bigmem_alloc(size, options, modes);
+    struct BigMemHeader *header = header_of(ptr);
+
+    if (header->map_size == 0 && !wants_mapping(size, options)) {
+        header = realloc(header, BIGMEM_HEADER_SIZE + size);
+        if (header == NULL)
+            return NULL;
+        header->size = size;
+        *modes |= header->mode;
+        return memory_of(header);
+    }
+    // mappings don't shrink
+    if (header->map_size >= BIGMEM_HEADER_SIZE + size) {
+        header->size = size;
+        *modes |= header->mode;
+        return ptr;
+    }
+
+    void *grown = bigmem_alloc(size, options, modes);
+    if (grown == NULL)
+        return NULL;
+    memcpy(grown, ptr, header->size < size ? header->size : size);
+    bigmem_free(ptr);
+    return grown;
+}
+
+void bigmem_free(void *ptr) {
+    if (ptr == NULL)
+        return;
+    struct BigMemHeader *header = header_of(ptr);
+#ifdef BIGMEM_USE_MMAP
+    if (header->map_size != 0) {
+        munmap(header, header->map_size);
+        return;
+    }
+#endif
+    free(header);
+}
+
+void bigmem_modes_string(BigMemMode modes, char *dest, size_t size) {
+    static const char *names[] = {"heap", "hugetlb", "thp", "pages", "numa"};
+    size_t length = 0;
+    if (size > 0)
+        dest[0] = '\0';
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); ++i) {
+        if (!((modes >> i) & 1))
+            continue;
+        int written = snprintf(
+            dest + length, length < size ? size - length : 0, "%s%s",
+            length > 0 ? "+" : "", names[i]);
+        if (written > 0)
+            length += written;
+    }
+    if (length == 0)
+        snprintf(dest, size, "none");
+}
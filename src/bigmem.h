@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// allocations from this size on are mapped on their own when huge pages or
+// NUMA binding are asked for; smaller ones come from the heap
+#define BIGMEM_MIN_MAPPED ((size_t)2 << 20)
+
+enum _BigMemMode {
+    BIGMEM_HEAP = 1 << 0,
+    /// @brief Mapped, from the huge pages the system reserved (`MAP_HUGETLB`).
+    BIGMEM_HUGETLB = 1 << 1,
+    /// @brief Mapped, with transparent huge pages asked for
+    /// (`MADV_HUGEPAGE`).
+    BIGMEM_THP = 1 << 2,
+    /// @brief Mapped, with regular pages, if the system has no huge pages.
+    BIGMEM_PAGES = 1 << 3,
+    /// @brief Mapped and bound to the NUMA node of the allocating thread.
+    BIGMEM_NUMA = 1 << 4
+};
+typedef uint8_t BigMemMode;
+
+/// @brief How large, randomly accessed structures like the node tables of a
+/// search are allocated. Zero-initialized, it is the plain heap. Huge pages
+/// and NUMA binding are only available on Linux, and fall back to regular
+/// pages and no binding.
+struct BigMemOptions {
+    /// @brief Use huge pages, reserved ones if the system has them and
+    /// transparent ones otherwise, to save TLB misses.
+    bool huge_pages;
+    /// @brief Prefer the NUMA node of the thread that allocates, which is
+    /// the one that uses the memory for the searches of a worker thread.
+    bool numa_local;
+};
+
+/// @brief Allocate memory that can only be resized with `bigmem_realloc` and
+/// freed with `bigmem_free`.
+/// @param size
+/// @param options
+/// @param modes The mode used is added to it
+/// @return `NULL` if memory allocation failed
+void *bigmem_alloc(
+    size_t size, const struct BigMemOptions *options, BigMemMode *modes);
+
+/// @brief Resize memory from `bigmem_alloc`, like `realloc`. Memory that grows
+/// past `BIGMEM_MIN_MAPPED` moves from the heap to a mapping.
+/// @param ptr May be `NULL`
+/// @param size
+/// @param options
+/// @param modes The mode used is added to it
+/// @return `NULL` if memory allocation failed, which leaves `ptr` as it was
+void *bigmem_realloc(
+    void *ptr,
+    size_t size,
+    const struct BigMemOptions *options,
+    BigMemMode *modes);
+
+/// @brief Free memory from `bigmem_alloc`.
+/// @param ptr May be `NULL`
+void bigmem_free(void *ptr);
+
+/// @brief Name the modes, like `hugetlb+numa`, for reports.
+/// @param modes
+/// @param dest
+/// @param size
+void bigmem_modes_string(BigMemMode modes, char *dest, size_t size);
@@ -0,0 +1,395 @@
+#include "cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define CACHE_USE_MMAP
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#define CACHE_MAGIC "jnbcache"
+// bumped whenever the rules or the record layout change, which makes old
+// results meaningless
+#define CACHE_VERSION 2
+
+// the options a search ran with that change its result or its stats; a result
+// is only served to the same search
+#define CACHE_OPTION_NO_PRUNING 1
+#define CACHE_OPTION_SYMMETRY 2
+#define CACHE_OPTION_MACRO_MOVES 4
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint8_t board_width;
+    uint8_t board_height;
+    uint16_t reserved;
+};
+
+// followed by the solution string, zero terminated and padded to 8 bytes, and
+// a checksum of everything before it
+struct CacheRecord {
+    uint64_t level_hash;
+    // of the whole record
+    uint32_t size;
+    int8_t status;
+    int8_t mode;
+    uint16_t solution_length;
+    uint64_t expanded;
+    uint64_t generated;
+    uint64_t duplicates;
+    uint64_t pruned;
+    int32_t depth;
+    int32_t h_root;
+    // CACHE_OPTION_*
+    uint32_t options;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(struct CacheHeader) % 8 == 0, "keeps records aligned");
+static_assert(sizeof(struct CacheRecord) % 8 == 0, "records are 8 aligned");
+
+struct SolutionCache {
+    FILE *append;
+
+    // contents of the file when it was opened
+    const uint8_t *data;
+    size_t data_size;
+    bool mapped;
+
+    // records added since then, and the ones that had to be copied to be
+    // aligned
+    uint8_t **owned;
+    int owned_count;
+    int owned_cap;
+
+    // open addressing map from level hash, mode and options to the latest
+    // record; slots hold NULL when empty
+    const struct CacheRecord **index;
+    size_t index_mask;
+    size_t index_count;
+};
+
+static uint64_t hash_data(const void *data, size_t size, uint64_t h) {
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; ++i)
+        h = (h ^ bytes[i]) * 0x100000001b3ull;
+    return h;
+}
+
+static uint32_t search_options(const struct SolverOptions *options) {
+    return (options->no_pruning ? CACHE_OPTION_NO_PRUNING : 0) |
+           (options->symmetry ? CACHE_OPTION_SYMMETRY : 0) |
+           (options->macro_moves ? CACHE_OPTION_MACRO_MOVES : 0);
+}
+
+// whether two records hold results of the same search of the same level
+static bool same_search(
+    const struct CacheRecord *a, const struct CacheRecord *b) {
+    return a->level_hash == b->level_hash && a->mode == b->mode &&
+           a->options == b->options;
+}
+
+// the checksum is the last 8 bytes of the record
+static uint64_t record_checksum(const uint8_t *record, uint32_t size) {
+    return hash_data(record, size - sizeof(uint64_t), 0xcbf29ce484222325ull);
+}
+
+// records can be anywhere in the file, see index_contents
+static bool record_valid(const uint8_t *record, size_t available) {
+    uint32_t size;
+    memcpy(&size, record + offsetof(struct CacheRecord, size), sizeof(size));
+    if (size % 8 != 0 ||
+        size < sizeof(struct CacheRecord) + 2 * sizeof(uint64_t) ||
+        size > available)
+        return false;
+    uint64_t checksum;
+    memcpy(&checksum, record + size - sizeof(uint64_t), sizeof(uint64_t));
+    return checksum == record_checksum(record, size);
+}
+
+static uint8_t *own_record(struct SolutionCache *cache, size_t size) {
+    if (cache->owned_count == cache->owned_cap) {
+        int cap = cache->owned_cap ? cache->owned_cap * 2 : 16;
+        uint8_t **owned = realloc(cache->owned, cap * sizeof(uint8_t *));
+        if (owned == NULL)
+            return NULL;
+        cache->owned = owned;
+        cache->owned_cap = cap;
+    }
+    uint8_t *record = calloc(1, size);
+    if (record != NULL)
+        cache->owned[cache->owned_count++] = record;
+    return record;
+}
+
+// keeps the load factor under 1/2
+static bool index_put(
+    struct SolutionCache *cache, const struct CacheRecord *record) {
+    if ((cache->index_count + 1) * 2 > cache->index_mask + 1) {
+        size_t size = cache->index ? (cache->index_mask + 1) * 2 : 64;
+        const struct CacheRecord **index =
+            calloc(size, sizeof(struct CacheRecord *));
+        if (index == NULL)
+            return false;
+        for (size_t i = 0; cache->index && i <= cache->index_mask; ++i) {
+            const struct CacheRecord *old = cache->index[i];
+            if (old == NULL)
+                continue;
+            size_t slot = old->level_hash & (size - 1);
+            while (index[slot] != NULL)
+                slot = (slot + 1) & (size - 1);
+            index[slot] = old;
+        }
+        free(cache->index);
+        cache->index = index;
+        cache->index_mask = size - 1;
+    }
+
+    size_t slot = record->level_hash & cache->index_mask;
+    while (cache->index[slot] != NULL &&
+           !same_search(cache->index[slot], record))
+        slot = (slot + 1) & cache->index_mask;
+    if (cache->index[slot] == NULL)
+        ++cache->index_count;
+    cache->index[slot] = record;
+    return true;
+}
+
+static bool read_contents(struct SolutionCache *cache, const char *path) {
+#ifdef CACHE_USE_MMAP
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    cache->data_size = st.st_size;
+    if (cache->data_size > 0) {
+        void *data =
+            mmap(NULL, cache->data_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        cache->data = data;
+        cache->mapped = true;
+    }
+    close(fd);
+    return true;
+#else
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return false;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = malloc(size > 0 ? size : 1);
+    if (data == NULL || fread(data, 1, size, file) != (size_t)size) {
+        free(data);
+        fclose(file);
+        return false;
+    }
+    fclose(file);
+    cache->data = data;
+    cache->data_size = size;
+    return true;
+#endif
+}
+
+// a writer that died while appending leaves a torn record behind, and the
+// records appended after it aren't aligned anymore; the scan steps over the
+// torn bytes one at a time until a valid record starts
+static bool index_contents(struct SolutionCache *cache) {
+    size_t offset = sizeof(struct CacheHeader);
+    while (offset + sizeof(struct CacheRecord) <= cache->data_size) {
+        const uint8_t *data = cache->data + offset;
+        if (!record_valid(data, cache->data_size - offset)) {
+            ++offset;
+            continue;
+        }
+
+        uint32_t size;
+        memcpy(&size, data + offsetof(struct CacheRecord, size), sizeof(size));
+        if (offset % 8 != 0) {
+            uint8_t *copy = own_record(cache, size);
+            if (copy == NULL)
+                return false;
+            memcpy(copy, data, size);
+            data = copy;
+        }
+        if (!index_put(cache, (const struct CacheRecord *)data))
+            return false;
+        offset += size;
+    }
+    return true;
+}
+
+struct SolutionCache *solution_cache_open(const char *path) {
+    struct SolutionCache *cache = calloc(1, sizeof(struct SolutionCache));
+    if (cache == NULL)
+        return NULL;
+
+    struct CacheHeader header = {
+        .magic = CACHE_MAGIC,
+        .version = CACHE_VERSION,
+        .board_width = BOARD_WIDTH,
+        .board_height = BOARD_HEIGHT,
+    };
+
+    // unbuffered, so that every record goes out in a single write and
+    // concurrent writers can't interleave their records
+    cache->append = fopen(path, "ab");
+    if (cache->append == NULL) {
+        solution_cache_close(&cache);
+        return NULL;
+    }
+    setvbuf(cache->append, NULL, _IONBF, 0);
+    fseek(cache->append, 0, SEEK_END);
+    if (ftell(cache->append) == 0 &&
+        fwrite(&header, sizeof(header), 1, cache->append) != 1) {
+        solution_cache_close(&cache);
+        return NULL;
+    }
+
+    if (!read_contents(cache, path) ||
+        cache->data_size < sizeof(struct CacheHeader) ||
+        memcmp(cache->data, &header, sizeof(header)) != 0 ||
+        !index_contents(cache)) {
+        solution_cache_close(&cache);
+        return NULL;
+    }
+    return cache;
+}
+
+void solution_cache_close(struct SolutionCache **cache) {
+    if (*cache == NULL)
+        return;
+    if ((*cache)->append != NULL)
+        fclose((*cache)->append);
+#ifdef CACHE_USE_MMAP
+    if ((*cache)->mapped)
+        munmap((void *)(*cache)->data, (*cache)->data_size);
+#else
+    free((void *)(*cache)->data);
+#endif
+    for (int i = 0; i < (*cache)->owned_count; ++i)
+        free((*cache)->owned[i]);
+    free((*cache)->owned);
+    free((*cache)->index);
+    free(*cache);
+    *cache = NULL;
+}
+
+uint64_t solution_cache_level_hash(const struct GameState *root) {
+    // block indices depend on the labeling, only what the cells hold counts
+    uint64_t h = hash_data(CACHE_MAGIC, 8, 0xcbf29ce484222325ull);
+    for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
+        for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
+            const struct Cell *cell = &root->board[i][j];
+            uint8_t bytes[4] = {cell->type, 0, 0, 0};
+            if (cell->type == CELL_PIECE) {
+                bytes[1] = cell->data.piece.color;
+                bytes[2] = cell->data.piece.no_connect;
+                bytes[3] = root->blocks[cell->data.piece.block].fixed;
+            } else if (cell->type == CELL_EMERGE) {
+                bytes[1] = cell->data.emerge.color;
+                bytes[2] = cell->data.emerge.dir;
+                bytes[3] = cell->data.emerge.fixed;
+            }
+            h = hash_data(bytes, sizeof(bytes), h);
+        }
+    }
+    return h;
+}
+
+bool solution_cache_find(
+    const struct SolutionCache *cache,
+    uint64_t level_hash,
+    const struct SolverOptions *options,
+    struct SolutionCacheEntry *dest) {
+    if (cache->index == NULL)
+        return false;
+
+    struct CacheRecord key = {
+        .level_hash = level_hash,
+        .mode = options->mode,
+        .options = search_options(options),
+    };
+    size_t slot = level_hash & cache->index_mask;
+    const struct CacheRecord *record;
+    while ((record = cache->index[slot]) != NULL && !same_search(record, &key))
+        slot = (slot + 1) & cache->index_mask;
+    if (record == NULL)
+        return false;
+
+    *dest = (struct SolutionCacheEntry){
+        .status = record->status,
+        .mode = record->mode,
+        .stats =
+            {
+                .expanded = record->expanded,
+                .generated = record->generated,
+                .duplicates = record->duplicates,
+                .pruned = record->pruned,
+                .depth = record->depth,
+                .h_root = record->h_root,
+            },
+        .solution_length = record->solution_length,
+        .solution = (const char *)(record + 1),
+    };
+    return true;
+}
+
+bool solution_cache_add(
+    struct SolutionCache *cache,
+    uint64_t level_hash,
+    const struct SolverOptions *options,
+    const struct Solver *solver) {
+    SolverStatus status = solver_get_status(solver);
+    if (status != SOLVER_SOLVED && status != SOLVER_UNSOLVABLE)
+        return true;
+
+    int length = 0;
+    const struct SolverMove *moves = solver_get_solution(solver, &length);
+    if (length > UINT16_MAX)
+        return true;
+    size_t text_size = solver_solution_to_string(moves, length, NULL, 0) + 1;
+    size_t size = sizeof(struct CacheRecord) + (text_size + 7) / 8 * 8 +
+                  sizeof(uint64_t);
+
+    uint8_t *data = own_record(cache, size);
+    if (data == NULL)
+        return false;
+
+    const struct SolverStats *stats = solver_get_stats(solver);
+    struct CacheRecord *record = (struct CacheRecord *)data;
+    *record = (struct CacheRecord){
+        .level_hash = level_hash,
+        .size = size,
+        .status = status,
+        .mode = options->mode,
+        .solution_length = length,
+        .expanded = stats->expanded,
+        .generated = stats->generated,
+        .duplicates = stats->duplicates,
+        .pruned = stats->pruned,
+        .depth = stats->depth,
+        .h_root = stats->h_root,
+        .options = search_options(options),
+    };
+    solver_solution_to_string(moves, length, (char *)(record + 1), text_size);
+    uint64_t checksum = record_checksum(data, size);
+    memcpy(data + size - sizeof(uint64_t), &checksum, sizeof(uint64_t));
+
+    if (fwrite(data, size, 1, cache->append) != 1)
+        return false;
+    return index_put(cache, record);
+}
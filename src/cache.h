@@ -0,0 +1,70 @@
+#pragma once
+
+#include "game.h"
+#include "solver.h"
+
+#include <stdint.h>
+
+/// @brief Results of previous searches, kept in a file across runs so that
+/// batch runs only solve the levels that changed. The file is append-only: a
+/// header followed by self-contained, 8 byte aligned records, each checked by
+/// a checksum, so it can be mapped into memory as is and read while other
+/// processes append to it; a torn record at the end is ignored. Results are
+/// kept per level, mode and the options that change what the search does, and
+/// only served to the same search; one solved again appends a new record, the
+/// last one wins.
+struct SolutionCache;
+
+/// @brief A cached search result. Unsolvable levels are cached as well, runs
+/// that hit a limit aren't.
+struct SolutionCacheEntry {
+    SolverStatus status;
+    /// @brief Mode of the search that produced the entry.
+    SolverMode mode;
+    /// @brief Stats of the search that produced the entry.
+    struct SolverStats stats;
+    int solution_length;
+    /// @brief In the format of `solver_solution_to_string`; owned by the cache.
+    const char *solution;
+};
+
+/// @brief Open a cache file, creating it if it doesn't exist yet.
+/// @param path
+/// @return `NULL` if the file can't be read or created, or was written by an
+/// incompatible version
+struct SolutionCache *solution_cache_open(const char *path);
+
+/// @brief Close and invalidate a cache.
+/// @param cache
+void solution_cache_close(struct SolutionCache **cache);
+
+/// @brief Hash identifying a level: its walls, emerge cells and pieces, but
+/// not its name or where it was loaded from.
+/// @param root Preprocessed game state
+uint64_t solution_cache_level_hash(const struct GameState *root);
+
+/// @brief Look up the latest result for a level searched with the same mode
+/// and options.
+/// @param cache
+/// @param level_hash
+/// @param options Options of the search the result would stand in for
+/// @param dest
+/// @return Whether or not the level was found
+bool solution_cache_find(
+    const struct SolutionCache *cache,
+    uint64_t level_hash,
+    const struct SolverOptions *options,
+    struct SolutionCacheEntry *dest);
+
+/// @brief Append the result of a finished search. Searches that hit a limit
+/// are skipped, successfully.
+/// @param cache
+/// @param level_hash
+/// @param options Options the solver was created with
+/// @param solver
+/// @return Whether or not the record could be written
+bool solution_cache_add(
+    struct SolutionCache *cache,
+    uint64_t level_hash,
+    const struct SolverOptions *options,
+    const struct Solver *solver);
@@ -0,0 +1,875 @@
+#include "census.h"
+#include "bigmem.h"
+#include "pack.h"
+#include "solver.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef JNB_THREADING
+    #include <stdatomic.h>
+    #include <threads.h>
+#endif
+
+#define CENSUS_MAX_THREADS 64
+
+// state ids are 32 bits, see state_id; a layer may go past max_states
+#define CENSUS_MAX_STATES ((size_t)1 << 30)
+
+#define CENSUS_DEFAULT_SAMPLE_NODES (1 << 20)
+
+// shortest walk a sample makes by default, for censuses that stop right away
+#define CENSUS_MIN_WALK 8
+
+#define STATE_NONE UINT32_MAX
+
+enum _CensusFlag { CENSUS_SOLVED = 1 };
+
+// a successor a work item found, followed by its packed state
+struct CensusRecord {
+    uint64_t hash;
+    // among the moves the item made in the current layer
+    uint32_t edge;
+    uint32_t solved;
+};
+
+struct CensusBuffer {
+    uint8_t *data;
+    size_t size;
+    size_t cap;
+};
+
+// the states whose hash picks the shard; a shard is only touched by the work
+// item with its number while deduplicating, the layers can be expanded by any
+// item since nothing grows then
+struct CensusShard {
+    uint8_t *keys;
+    uint16_t *depth;
+    uint8_t *flags;
+    // the moves of a state are the edges from edge_begin on, in the order of
+    // game_get_legal_moves; the edges of the layer being expanded count from
+    // the first move of their work item until the item's moves are placed
+    uint64_t *edge_begin;
+    uint16_t *edge_count;
+    uint32_t count;
+    uint32_t cap;
+    // open addressing set of state indices, keyed by the packed state
+    uint32_t *table;
+    uint32_t table_mask;
+    // states of the layer being expanded, and how many of the layer come
+    // before them in the shards before this one
+    uint32_t layer_begin;
+    uint32_t layer_end;
+    uint64_t layer_pos;
+    // the arrays above come from bigmem
+    BigMemMode memory_modes;
+};
+
+struct CensusWorker {
+    // the successors the work item found for every shard, from bigmem, so
+    // with NUMA binding they are on the node of the thread that filled them
+    // first
+    struct CensusBuffer out[CENSUS_MAX_THREADS];
+    BigMemMode memory_modes;
+    // moves the item made in the current layer, and where they start in the
+    // edges of the census
+    uint64_t edges;
+    uint64_t edge_offset;
+    bool failed;
+
+    uint64_t expanded;
+    uint64_t moves;
+    uint64_t flagged;
+    uint64_t branching[CENSUS_BRANCHING];
+
+    struct Solver *solver;
+    uint64_t sample_states;
+    uint64_t sample_branching[CENSUS_BRANCHING];
+    uint64_t sample_alive;
+    uint64_t sample_dead;
+    uint64_t sample_unknown;
+    uint64_t sample_distance;
+
+    struct LegalMoves legal;
+    uint8_t key[BOARD_WIDTH * BOARD_HEIGHT];
+    _Alignas(struct GameState) uint8_t state[GAME_STATE_MAX_SIZE];
+    _Alignas(struct GameState) uint8_t lanes[GAME_LANES][GAME_STATE_MAX_SIZE];
+};
+
+struct Census {
+    const struct GameState *root;
+    struct CensusOptions options;
+    int threads;
+    struct StatePacker packer;
+    size_t key_size;
+    size_t record_size;
+    struct CensusShard shards[CENSUS_MAX_THREADS];
+    struct CensusWorker *workers;
+    // the successor of every move, as a state id; STATE_NONE for a move that
+    // turned out to be blocked
+    uint32_t *edges;
+    uint64_t edge_count;
+    uint64_t edge_cap;
+    BigMemMode memory_modes;
+    uint32_t root_id;
+    // the layer being expanded and its number of states
+    int layer;
+    uint64_t frontier;
+};
+
+typedef void (*CensusTask)(struct Census *census, int item);
+
+struct CensusJob {
+    struct Census *census;
+    CensusTask task;
+#ifdef JNB_THREADING
+    atomic_int next;
+#else
+    int next;
+#endif
+};
+
+// multiply-xorshift over 8 byte words, like the solver's
+static uint64_t hash_bytes(const void *data, size_t size) {
+    const uint8_t *bytes = data;
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        h = (h ^ word) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, bytes + i, size - i);
+    h = (h ^ tail) * 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 29;
+    return h;
+}
+
+// splitmix64, like the generator's
+static uint64_t rng_next(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t saturating_add(uint64_t a, uint64_t b) {
+    return a > UINT64_MAX - b ? UINT64_MAX : a + b;
+}
+
+static inline int count_bucket(int moves) {
+    return moves < CENSUS_BRANCHING ? moves : CENSUS_BRANCHING - 1;
+}
+
+// a state is identified by its shard and its index in there
+static inline uint32_t
+    state_id(const struct Census *census, int shard, uint32_t index) {
+    return index * census->threads + shard;
+}
+
+static inline uint8_t *shard_key(
+    const struct Census *census,
+    const struct CensusShard *shard,
+    uint32_t index) {
+    return shard->keys + (size_t)index * census->key_size;
+}
+
+static inline int hash_shard(const struct Census *census, uint64_t hash) {
+    // the table takes the low bits
+    return (int)((hash >> 40) % census->threads);
+}
+
+static bool buffer_reserve(
+    const struct Census *census,
+    struct CensusWorker *worker,
+    struct CensusBuffer *buffer,
+    size_t size) {
+    if (buffer->size + size <= buffer->cap)
+        return true;
+    size_t cap = buffer->cap ? buffer->cap : 4096;
+    while (cap < buffer->size + size)
+        cap *= 2;
+    uint8_t *data = bigmem_realloc(
+        buffer->data, cap, &census->options.memory, &worker->memory_modes);
+    if (data == NULL)
+        return false;
+    buffer->data = data;
+    buffer->cap = cap;
+    return true;
+}
+
+static void shard_table_place(
+    const struct Census *census, struct CensusShard *shard, uint32_t index) {
+    uint64_t hash =
+        hash_bytes(shard_key(census, shard, index), census->key_size);
+    uint32_t slot = hash & shard->table_mask;
+    while (shard->table[slot] != STATE_NONE)
+        slot = (slot + 1) & shard->table_mask;
+    shard->table[slot] = index;
+}
+
+// room for one more state
+static bool shard_reserve(struct Census *census, struct CensusShard *shard) {
+    const struct BigMemOptions *memory = &census->options.memory;
+    if (shard->count == shard->cap) {
+        uint32_t cap = shard->cap ? shard->cap * 2 : 256;
+        uint8_t *keys = bigmem_realloc(
+            shard->keys, (size_t)cap * census->key_size, memory,
+            &shard->memory_modes);
+        if (keys == NULL)
+            return false;
+        shard->keys = keys;
+        uint16_t *depth = bigmem_realloc(
+            shard->depth, cap * sizeof(uint16_t), memory,
+            &shard->memory_modes);
+        if (depth == NULL)
+            return false;
+        shard->depth = depth;
+        uint8_t *flags =
+            bigmem_realloc(shard->flags, cap, memory, &shard->memory_modes);
+        if (flags == NULL)
+            return false;
+        shard->flags = flags;
+        uint64_t *edge_begin = bigmem_realloc(
+            shard->edge_begin, cap * sizeof(uint64_t), memory,
+            &shard->memory_modes);
+        if (edge_begin == NULL)
+            return false;
+        shard->edge_begin = edge_begin;
+        uint16_t *edge_count = bigmem_realloc(
+            shard->edge_count, cap * sizeof(uint16_t), memory,
+            &shard->memory_modes);
+        if (edge_count == NULL)
+            return false;
+        shard->edge_count = edge_count;
+        shard->cap = cap;
+    }
+
+    // at most half full
+    size_t slots = shard->table ? (size_t)shard->table_mask + 1 : 0;
+    if ((size_t)(shard->count + 1) * 2 <= slots)
+        return true;
+    slots = slots ? slots * 2 : 1024;
+    uint32_t *table = bigmem_alloc(
+        slots * sizeof(uint32_t), memory, &shard->memory_modes);
+    if (table == NULL)
+        return false;
+    bigmem_free(shard->table);
+    shard->table = table;
+    shard->table_mask = slots - 1;
+    memset(table, 0xff, slots * sizeof(uint32_t));
+    for (uint32_t i = 0; i < shard->count; ++i)
+        shard_table_place(census, shard, i);
+    return true;
+}
+
+// the index of the state, which is added unless it's there already;
+// STATE_NONE if memory allocation failed
+static uint32_t shard_insert(
+    struct Census *census,
+    struct CensusShard *shard,
+    const uint8_t *key,
+    uint64_t hash,
+    bool *added) {
+    *added = false;
+    if (!shard_reserve(census, shard))
+        return STATE_NONE;
+    uint32_t slot = hash & shard->table_mask;
+    for (; shard->table[slot] != STATE_NONE;
+         slot = (slot + 1) & shard->table_mask) {
+        uint32_t index = shard->table[slot];
+        if (memcmp(shard_key(census, shard, index), key, census->key_size) ==
+            0)
+            return index;
+    }
+
+    uint32_t index = shard->count++;
+    memcpy(shard_key(census, shard, index), key, census->key_size);
+    shard->table[slot] = index;
+    shard->edge_begin[index] = 0;
+    shard->edge_count[index] = 0;
+    *added = true;
+    return index;
+}
+
+static int census_worker(void *arg) {
+    struct CensusJob *job = arg;
+    for (;;) {
+#ifdef JNB_THREADING
+        int item =
+            atomic_fetch_add_explicit(&job->next, 1, memory_order_relaxed);
+#else
+        int item = job->next++;
+#endif
+        if (item >= job->census->threads)
+            return 0;
+        job->task(job->census, item);
+    }
+}
+
+// runs the task for every work item, one per thread; the items don't depend
+// on the thread that runs them, so threads that can't be started only make it
+// slower
+static void run_items(struct Census *census, CensusTask task) {
+    struct CensusJob job = {.census = census, .task = task};
+#ifdef JNB_THREADING
+    atomic_init(&job.next, 0);
+    thrd_t workers[CENSUS_MAX_THREADS];
+    int started = 0;
+    for (; started < census->threads - 1; ++started) {
+        if (thrd_create(&workers[started], census_worker, &job) !=
+            thrd_success)
+            break;
+    }
+    census_worker(&job);
+    for (int i = 0; i < started; ++i)
+        thrd_join(workers[i], NULL);
+#else
+    census_worker(&job);
+#endif
+}
+
+static void expand_lanes(
+    struct Census *census,
+    struct CensusWorker *worker,
+    const struct GameState *state,
+    const blockidx_t *blocks,
+    const MoveBlockDir *dirs,
+    int count) {
+    struct GameState *dests[GAME_LANES];
+    for (int i = 0; i < GAME_LANES; ++i)
+        dests[i] = (struct GameState *)worker->lanes[i];
+    uint32_t mask =
+        game_do_moves(state, &worker->legal, blocks, dirs, count, dests);
+
+    for (int i = 0; i < count; ++i) {
+        uint64_t edge = worker->edges++;
+        if (!((mask >> i) & 1))
+            continue;
+        state_pack(&census->packer, dests[i], worker->key);
+        struct CensusRecord record = {
+            .hash = hash_bytes(worker->key, census->key_size),
+            .edge = (uint32_t)edge,
+            .solved = game_is_solved(dests[i]),
+        };
+        struct CensusBuffer *out =
+            &worker->out[hash_shard(census, record.hash)];
+        if (!buffer_reserve(census, worker, out, census->record_size)) {
+            worker->failed = true;
+            return;
+        }
+        memcpy(out->data + out->size, &record, sizeof(record));
+        memcpy(
+            out->data + out->size + sizeof(record), worker->key,
+            census->key_size);
+        out->size += census->record_size;
+    }
+}
+
+static void expand_state(
+    struct Census *census,
+    struct CensusWorker *worker,
+    struct CensusShard *shard,
+    uint32_t index) {
+    shard->edge_begin[index] = worker->edges;
+    shard->edge_count[index] = 0;
+    if (shard->flags[index] & CENSUS_SOLVED)
+        return;
+
+    struct GameState *state = (struct GameState *)worker->state;
+    state_unpack(&census->packer, shard_key(census, shard, index), state);
+    ++worker->expanded;
+    worker->flagged += game_is_dead(state);
+    game_get_legal_moves(state, &worker->legal);
+
+    blockidx_t blocks[GAME_LANES];
+    MoveBlockDir dirs[GAME_LANES];
+    int lanes = 0;
+    int moves = 0;
+    for (blockidx_t block = 0; block < state->block_count; ++block) {
+        for (MoveBlockDir dir = MOVE_BLOCK_LEFT; dir <= MOVE_BLOCK_RIGHT;
+             ++dir) {
+            if (!block_set_has(&worker->legal.movable[dir], block))
+                continue;
+            blocks[lanes] = block;
+            dirs[lanes] = dir;
+            ++moves;
+            if (++lanes < GAME_LANES)
+                continue;
+            expand_lanes(census, worker, state, blocks, dirs, lanes);
+            lanes = 0;
+        }
+    }
+    if (lanes > 0)
+        expand_lanes(census, worker, state, blocks, dirs, lanes);
+
+    shard->edge_count[index] = moves;
+    worker->moves += moves;
+    ++worker->branching[count_bucket(moves)];
+}
+
+static inline uint64_t item_first(const struct Census *census, int item) {
+    return census->frontier * item / census->threads;
+}
+
+// expands a share of the layer, in the order of the shards
+static void expand_item(struct Census *census, int item) {
+    struct CensusWorker *worker = &census->workers[item];
+    worker->edges = 0;
+    for (int i = 0; i < census->threads; ++i)
+        worker->out[i].size = 0;
+
+    uint64_t last = item_first(census, item + 1);
+    int s = 0;
+    for (uint64_t pos = item_first(census, item); pos < last; ++pos) {
+        struct CensusShard *shard = &census->shards[s];
+        while (pos - shard->layer_pos >= shard->layer_end - shard->layer_begin)
+            shard = &census->shards[++s];
+        expand_state(
+            census, worker, shard,
+            shard->layer_begin + (uint32_t)(pos - shard->layer_pos));
+        if (worker->failed)
+            return;
+    }
+}
+
+// adds the successors that fell to the shard and fills in their edges
+static void dedup_item(struct Census *census, int item) {
+    struct CensusShard *shard = &census->shards[item];
+
+    // the expanded states of the shard learn where their moves ended up
+    int expander = 0;
+    for (uint32_t i = shard->layer_begin; i < shard->layer_end; ++i) {
+        uint64_t pos = shard->layer_pos + (i - shard->layer_begin);
+        while (pos >= item_first(census, expander + 1))
+            ++expander;
+        shard->edge_begin[i] += census->workers[expander].edge_offset;
+    }
+
+    for (int t = 0; t < census->threads; ++t) {
+        const struct CensusWorker *from = &census->workers[t];
+        const struct CensusBuffer *in = &from->out[item];
+        for (size_t off = 0; off < in->size; off += census->record_size) {
+            struct CensusRecord record;
+            memcpy(&record, in->data + off, sizeof(record));
+            bool added;
+            uint32_t index = shard_insert(
+                census, shard, in->data + off + sizeof(record), record.hash,
+                &added);
+            if (index == STATE_NONE) {
+                census->workers[item].failed = true;
+                return;
+            }
+            if (added) {
+                shard->depth[index] = census->layer + 1;
+                shard->flags[index] = record.solved ? CENSUS_SOLVED : 0;
+            }
+            census->edges[from->edge_offset + record.edge] =
+                state_id(census, item, index);
+        }
+    }
+}
+
+// makes the walks of a share of the samples; each sample has its own random
+// numbers, so the result doesn't depend on the number of threads
+static void sample_item(struct Census *census, int item) {
+    struct CensusWorker *worker = &census->workers[item];
+    const struct CensusOptions *options = &census->options;
+    struct SolverOptions solver_options = {
+        .mode = SOLVER_MODE_ASTAR,
+        .max_nodes = options->sample_nodes,
+        .memory = options->memory,
+    };
+
+    int first = (int)((int64_t)options->samples * item / census->threads);
+    int last = (int)((int64_t)options->samples * (item + 1) / census->threads);
+    for (int sample = first; sample < last; ++sample) {
+        uint64_t rng = options->seed;
+        rng = rng_next(&rng) ^ (uint64_t)sample;
+        int length = 1 + (int)(rng_next(&rng) % options->walk_length);
+
+        struct GameState *state = (struct GameState *)worker->state;
+        struct GameState *next = (struct GameState *)worker->lanes[0];
+        memcpy(state, census->root, game_get_size(census->root));
+        for (int step = 0; step < length && !game_is_solved(state); ++step) {
+            game_get_legal_moves(state, &worker->legal);
+            int moves = 0;
+            for (int dir = MOVE_BLOCK_LEFT; dir <= MOVE_BLOCK_RIGHT; ++dir) {
+                for (int i = 0; i < BLOCK_SET_WORDS; ++i)
+                    moves += __builtin_popcountll(
+                        worker->legal.movable[dir].bits[i]);
+            }
+            if (moves == 0)
+                break;
+            ++worker->sample_states;
+            ++worker->sample_branching[count_bucket(moves)];
+
+            int pick = (int)(rng_next(&rng) % moves);
+            for (blockidx_t block = 0; block < state->block_count; ++block) {
+                for (MoveBlockDir dir = MOVE_BLOCK_LEFT;
+                     dir <= MOVE_BLOCK_RIGHT; ++dir) {
+                    if (block_set_has(&worker->legal.movable[dir], block) &&
+                        pick-- == 0)
+                        game_do_move(state, block, dir, next);
+                }
+            }
+            struct GameState *tmp = state;
+            state = next;
+            next = tmp;
+        }
+
+        if (worker->solver == NULL
+                ? (worker->solver = solver_new(state, &solver_options)) ==
+                      NULL
+                : !solver_reset(worker->solver, state, &solver_options)) {
+            worker->failed = true;
+            return;
+        }
+        switch (solver_step(worker->solver, SIZE_MAX)) {
+        case SOLVER_SOLVED:
+            ++worker->sample_alive;
+            worker->sample_distance += solver_get_stats(worker->solver)->depth;
+            break;
+        case SOLVER_UNSOLVABLE:
+            ++worker->sample_dead;
+            break;
+        default:
+            ++worker->sample_unknown;
+            break;
+        }
+    }
+}
+
+static bool append_layer(struct CensusReport *dest, uint64_t states) {
+    uint64_t *layers =
+        realloc(dest->layers, (dest->layer_count + 1) * sizeof(uint64_t));
+    if (layers == NULL)
+        return false;
+    dest->layers = layers;
+    dest->layers[dest->layer_count++] = states;
+    return true;
+}
+
+static bool reserve_edges(struct Census *census, uint64_t count) {
+    if (count <= census->edge_cap)
+        return true;
+    uint64_t cap = census->edge_cap ? census->edge_cap : 4096;
+    while (cap < count)
+        cap *= 2;
+    uint32_t *edges = bigmem_realloc(
+        census->edges, cap * sizeof(uint32_t), &census->options.memory,
+        &census->memory_modes);
+    if (edges == NULL)
+        return false;
+    census->edges = edges;
+    census->edge_cap = cap;
+    return true;
+}
+
+// breadth-first over the layers; false if memory allocation failed
+static bool enumerate(struct Census *census, struct CensusReport *dest) {
+    uint8_t *key = census->workers[0].key;
+    state_pack(&census->packer, census->root, key);
+    uint64_t hash = hash_bytes(key, census->key_size);
+    int s = hash_shard(census, hash);
+    struct CensusShard *shard = &census->shards[s];
+    bool added;
+    if (shard_insert(census, shard, key, hash, &added) == STATE_NONE)
+        return false;
+    census->root_id = state_id(census, s, 0);
+    shard->depth[0] = 0;
+    shard->flags[0] = game_is_solved(census->root) ? CENSUS_SOLVED : 0;
+    shard->layer_end = 1;
+    if (!append_layer(dest, 1))
+        return false;
+    uint64_t states = 1;
+
+    for (census->layer = 0;; ++census->layer) {
+        census->frontier = 0;
+        for (int i = 0; i < census->threads; ++i) {
+            struct CensusShard *shard = &census->shards[i];
+            shard->layer_pos = census->frontier;
+            census->frontier += shard->layer_end - shard->layer_begin;
+        }
+        if (census->frontier == 0) {
+            dest->complete = true;
+            return true;
+        }
+
+        run_items(census, expand_item);
+        uint64_t edges = census->edge_count;
+        for (int i = 0; i < census->threads; ++i) {
+            struct CensusWorker *worker = &census->workers[i];
+            if (worker->failed)
+                return false;
+            worker->edge_offset = edges;
+            edges += worker->edges;
+        }
+        if (!reserve_edges(census, edges))
+            return false;
+        memset(
+            census->edges + census->edge_count, 0xff,
+            (edges - census->edge_count) * sizeof(uint32_t));
+        census->edge_count = edges;
+
+        run_items(census, dedup_item);
+        uint64_t added = 0;
+        for (int i = 0; i < census->threads; ++i) {
+            struct CensusShard *shard = &census->shards[i];
+            if (census->workers[i].failed)
+                return false;
+            added += shard->count - shard->layer_end;
+            shard->layer_begin = shard->layer_end;
+            shard->layer_end = shard->count;
+        }
+        if (added == 0)
+            continue;
+        if (!append_layer(dest, added))
+            return false;
+        states += added;
+        if (states > census->options.max_states)
+            return true;
+    }
+}
+
+// the solved states and the shortest solutions, along with the dead states
+// for a complete census, from the graph of the states; false if memory
+// allocation failed
+static bool analyze(struct Census *census, struct CensusReport *dest) {
+    int threads = census->threads;
+    uint64_t base[CENSUS_MAX_THREADS];
+    uint64_t n = 0;
+    for (int s = 0; s < threads; ++s) {
+        base[s] = n;
+        n += census->shards[s].count;
+    }
+    dest->states = n;
+    for (int s = 0; s < threads; ++s) {
+        const struct CensusShard *shard = &census->shards[s];
+        for (uint32_t i = 0; i < shard->count; ++i) {
+            if (!(shard->flags[i] & CENSUS_SOLVED))
+                continue;
+            ++dest->solved;
+            if (dest->optimal < 0 || shard->depth[i] < dest->optimal)
+                dest->optimal = shard->depth[i];
+        }
+    }
+
+    // paths from the root along the layers, which is where the shortest
+    // solutions run; states are stored in the order of their layers
+    if (dest->optimal >= 0) {
+        uint64_t *paths = calloc(n, sizeof(uint64_t));
+        if (paths == NULL)
+            return false;
+        paths[base[census->root_id % threads] + census->root_id / threads] =
+            1;
+        uint32_t cursor[CENSUS_MAX_THREADS] = {0};
+        for (int d = 0; d < dest->optimal; ++d) {
+            for (int s = 0; s < threads; ++s) {
+                const struct CensusShard *shard = &census->shards[s];
+                for (; cursor[s] < shard->count &&
+                       shard->depth[cursor[s]] == d;
+                     ++cursor[s]) {
+                    uint32_t i = cursor[s];
+                    uint64_t from = paths[base[s] + i];
+                    uint64_t edge = shard->edge_begin[i];
+                    for (int k = 0; from > 0 && k < shard->edge_count[i]; ++k) {
+                        uint32_t id = census->edges[edge + k];
+                        if (id == STATE_NONE)
+                            continue;
+                        int to = id % threads;
+                        uint32_t j = id / threads;
+                        if (census->shards[to].depth[j] == d + 1)
+                            paths[base[to] + j] =
+                                saturating_add(paths[base[to] + j], from);
+                    }
+                }
+            }
+        }
+        for (int s = 0; s < threads; ++s) {
+            const struct CensusShard *shard = &census->shards[s];
+            for (uint32_t i = 0; i < shard->count; ++i) {
+                if ((shard->flags[i] & CENSUS_SOLVED) &&
+                    shard->depth[i] == dest->optimal)
+                    dest->solutions =
+                        saturating_add(dest->solutions, paths[base[s] + i]);
+            }
+        }
+        free(paths);
+    }
+    if (!dest->complete)
+        return true;
+
+    // backwards from the solved states; the predecessors of state v end at
+    // rev_end[v] and start where the ones of v - 1 end
+    uint64_t *rev_end = calloc(n, sizeof(uint64_t));
+    uint32_t *rev = malloc((census->edge_count + 1) * sizeof(uint32_t));
+    uint32_t *queue = malloc(n * sizeof(uint32_t));
+    uint8_t *alive = calloc(n, 1);
+    bool res = rev_end != NULL && rev != NULL && queue != NULL && alive != NULL;
+    for (int pass = 0; res && pass < 2; ++pass) {
+        for (int s = 0; s < threads; ++s) {
+            const struct CensusShard *shard = &census->shards[s];
+            for (uint32_t i = 0; i < shard->count; ++i) {
+                uint64_t edge = shard->edge_begin[i];
+                for (int k = 0; k < shard->edge_count[i]; ++k) {
+                    uint32_t id = census->edges[edge + k];
+                    if (id == STATE_NONE)
+                        continue;
+                    uint64_t v = base[id % threads] + id / threads;
+                    if (pass == 0)
+                        ++rev_end[v];
+                    else
+                        rev[--rev_end[v]] = (uint32_t)(base[s] + i);
+                }
+            }
+        }
+        // counts to the ends of the ranges, which the second pass fills
+        // backwards, leaving them at their starts
+        if (pass == 0) {
+            for (uint64_t v = 1; v < n; ++v)
+                rev_end[v] += rev_end[v - 1];
+        }
+    }
+    if (res) {
+        uint64_t tail = 0;
+        for (int s = 0; s < threads; ++s) {
+            const struct CensusShard *shard = &census->shards[s];
+            for (uint32_t i = 0; i < shard->count; ++i) {
+                if (shard->flags[i] & CENSUS_SOLVED) {
+                    alive[base[s] + i] = 1;
+                    queue[tail++] = (uint32_t)(base[s] + i);
+                }
+            }
+        }
+        for (uint64_t head = 0; head < tail; ++head) {
+            uint32_t v = queue[head];
+            uint64_t end = v + 1 < n ? rev_end[v + 1] : census->edge_count;
+            for (uint64_t k = rev_end[v]; k < end; ++k) {
+                uint32_t u = rev[k];
+                if (!alive[u]) {
+                    alive[u] = 1;
+                    queue[tail++] = u;
+                }
+            }
+        }
+        dest->dead = n - tail;
+    }
+    free(alive);
+    free(queue);
+    free(rev);
+    free(rev_end);
+    return res;
+}
+
+static void census_free(struct Census *census) {
+    for (int i = 0; i < CENSUS_MAX_THREADS; ++i) {
+        struct CensusShard *shard = &census->shards[i];
+        bigmem_free(shard->keys);
+        bigmem_free(shard->depth);
+        bigmem_free(shard->flags);
+        bigmem_free(shard->edge_begin);
+        bigmem_free(shard->edge_count);
+        bigmem_free(shard->table);
+    }
+    for (int i = 0; census->workers != NULL && i < census->threads; ++i) {
+        struct CensusWorker *worker = &census->workers[i];
+        for (int k = 0; k < CENSUS_MAX_THREADS; ++k)
+            bigmem_free(worker->out[k].data);
+        solver_free(&worker->solver);
+    }
+    free(census->workers);
+    bigmem_free(census->edges);
+    free(census);
+}
+
+bool census_run(
+    const struct GameState *root,
+    const struct CensusOptions *options,
+    struct CensusReport *dest) {
+    *dest = (struct CensusReport){.optimal = -1};
+    struct Census *census = calloc(1, sizeof(struct Census));
+    if (census == NULL)
+        return false;
+    census->root = root;
+    census->options = *options;
+#ifdef JNB_THREADING
+    census->threads = options->threads < 1 ? 1 : options->threads;
+    if (census->threads > CENSUS_MAX_THREADS)
+        census->threads = CENSUS_MAX_THREADS;
+#else
+    census->threads = 1;
+#endif
+    if (census->options.max_states == 0 ||
+        census->options.max_states > CENSUS_MAX_STATES)
+        census->options.max_states = CENSUS_MAX_STATES;
+    if (census->options.sample_nodes == 0)
+        census->options.sample_nodes = CENSUS_DEFAULT_SAMPLE_NODES;
+
+    bool res = false;
+    if (!state_packer_init(&census->packer, root))
+        goto done;
+    census->key_size = census->packer.packed_size;
+    census->record_size =
+        sizeof(struct CensusRecord) + (census->key_size + 7) / 8 * 8;
+    census->workers = calloc(census->threads, sizeof(struct CensusWorker));
+    if (census->workers == NULL || !enumerate(census, dest) ||
+        !analyze(census, dest))
+        goto done;
+    for (int i = 0; i < census->threads; ++i) {
+        const struct CensusWorker *worker = &census->workers[i];
+        dest->expanded += worker->expanded;
+        dest->moves += worker->moves;
+        dest->flagged += worker->flagged;
+        for (int k = 0; k < CENSUS_BRANCHING; ++k)
+            dest->branching[k] += worker->branching[k];
+        dest->memory_modes |= worker->memory_modes;
+    }
+    dest->memory_modes |= census->memory_modes;
+    for (int i = 0; i < CENSUS_MAX_THREADS; ++i)
+        dest->memory_modes |= census->shards[i].memory_modes;
+
+    if (!dest->complete && options->samples > 0) {
+        int walk_length = census->options.walk_length;
+        if (walk_length <= 0) {
+            walk_length = 2 * (dest->layer_count - 1);
+            if (walk_length < CENSUS_MIN_WALK)
+                walk_length = CENSUS_MIN_WALK;
+        }
+        census->options.walk_length = walk_length;
+        run_items(census, sample_item);
+        uint64_t distance = 0;
+        for (int i = 0; i < census->threads; ++i) {
+            const struct CensusWorker *worker = &census->workers[i];
+            if (worker->failed)
+                goto done;
+            dest->sample_states += worker->sample_states;
+            for (int k = 0; k < CENSUS_BRANCHING; ++k)
+                dest->sample_branching[k] += worker->sample_branching[k];
+            dest->sample_alive += worker->sample_alive;
+            dest->sample_dead += worker->sample_dead;
+            dest->sample_unknown += worker->sample_unknown;
+            distance += worker->sample_distance;
+            if (worker->solver != NULL)
+                dest->memory_modes |=
+                    solver_get_stats(worker->solver)->memory_modes;
+        }
+        dest->samples = options->samples;
+        dest->walk_length = walk_length;
+        dest->sample_distance =
+            dest->sample_alive > 0 ? (double)distance / dest->sample_alive : 0;
+    }
+    res = true;
+
+done:
+    census_free(census);
+    return res;
+}
+
+void census_report_free(struct CensusReport *report) {
+    free(report->layers);
+    report->layers = NULL;
+    report->layer_count = 0;
+}
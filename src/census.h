@@ -0,0 +1,100 @@
+#pragma once
+
+#include "bigmem.h"
+#include "game.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// legal move counts the branching histograms tell apart; states with more
+// moves count for the last one
+#define CENSUS_BRANCHING 64
+
+/// @brief Settings of `census_run`.
+struct CensusOptions {
+    /// @brief Worker threads; 1 without `JNB_THREADING`.
+    int threads;
+    /// @brief Most states stored; the census stops after the first layer that
+    /// takes it over this, so it may store one layer more.
+    size_t max_states;
+    /// @brief Random walks made when the census doesn't get through every
+    /// state, see `struct CensusReport`.
+    int samples;
+    /// @brief Longest walk; 0 picks twice the depth the census got to.
+    int walk_length;
+    uint64_t seed;
+    /// @brief Node limit of the search that tells whether the state a walk
+    /// ends in can still be solved; 0 picks the default.
+    size_t sample_nodes;
+    /// @brief How the states, the edges and the successor buffers of the
+    /// workers are allocated, and the memory of the sample searches.
+    struct BigMemOptions memory;
+};
+
+/// @brief The reachable states of a level. Solved states end the game, so
+/// they are counted but never expanded. Everything but the samples is exact
+/// for the layers the census got through, and the same for any number of
+/// threads.
+struct CensusReport {
+    /// @brief Whether every reachable state was enumerated.
+    bool complete;
+    uint64_t states;
+    /// @brief States whose moves were made: the ones that aren't solved, of
+    /// every layer but the last one if the census is incomplete.
+    uint64_t expanded;
+    /// @brief Legal moves of the expanded states.
+    uint64_t moves;
+    uint64_t solved;
+    /// @brief Expanded states `game_is_dead` rejects.
+    uint64_t flagged;
+    /// @brief States no solved state can be reached from; only counted for a
+    /// complete census.
+    uint64_t dead;
+    /// @brief States by their distance from the root, `layer_count` of them.
+    uint64_t *layers;
+    int layer_count;
+    /// @brief Expanded states by their number of legal moves.
+    uint64_t branching[CENSUS_BRANCHING];
+    /// @brief Length of the shortest solution, -1 if none was reached.
+    int optimal;
+    /// @brief Distinct move sequences of that length that solve the level,
+    /// `UINT64_MAX` if there are more.
+    uint64_t solutions;
+
+    /// @brief Random walks made because the census is incomplete, each of
+    /// random legal moves from the root, up to `walk_length` of them, stopping
+    /// early in a state that is solved or has no moves left.
+    int samples;
+    int walk_length;
+    /// @brief States the walks visited and how many legal moves they had, the
+    /// last state of every walk excluded.
+    uint64_t sample_states;
+    uint64_t sample_branching[CENSUS_BRANCHING];
+    /// @brief How the walks ended: in a state that can still be solved, in a
+    /// dead one, or in one the search gave up on.
+    uint64_t sample_alive;
+    uint64_t sample_dead;
+    uint64_t sample_unknown;
+    /// @brief Mean length of the solutions of the alive ends.
+    double sample_distance;
+    /// @brief How the memory of the census was allocated, see
+    /// `struct BigMemOptions`.
+    BigMemMode memory_modes;
+};
+
+/// @brief Enumerate every state reachable from `root`, breadth-first, or as
+/// many as `max_states` allow, and sample the rest with random walks.
+/// @param root Preprocessed game state
+/// @param options
+/// @param dest Release with `census_report_free`, whatever the result
+/// @return `false` if memory allocation failed or the level has too many
+/// distinct pieces to pack its states
+bool census_run(
+    const struct GameState *root,
+    const struct CensusOptions *options,
+    struct CensusReport *dest);
+
+/// @brief Free the memory of a report.
+/// @param report
+void census_report_free(struct CensusReport *report);
@@ -0,0 +1,149 @@
+// preprocesses the levels of the web build ahead of time, writing them to a C
+// source file that defines `embedded_levels`, like `embed_levels
+// build/web_levels.c levels/web.txt`
+//
+// the bytes of a preprocessed state and of its level template depend on the
+// layout of the build, so build_wasm.sh compiles this with emcc as well and
+// runs it on node; only the boards' bytes are embedded, not their text, so a
+// build whose layout differs from `embedded_levels_layout` can't load them,
+// and load_level in web.c fails rather than preprocessing them again
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "game.h"
+#include "util.h"
+#include "web_levels.h"
+
+#define EMBED_BYTES_PER_LINE 12
+
+static void write_bytes(
+    FILE *file, const char *name, int index, const void *data, size_t size) {
+    const uint8_t *bytes = data;
+    fprintf(
+        file, "static const _Alignas(max_align_t) uint8_t %s_%d[] = {", name,
+        index);
+    for (size_t i = 0; i < size; ++i) {
+        if (i % EMBED_BYTES_PER_LINE == 0)
+            fprintf(file, "\n   ");
+        fprintf(file, " %u,", bytes[i]);
+    }
+    fprintf(file, "\n};\n\n");
+}
+
+// as a string literal, escaping everything that isn't printable
+static void write_string(FILE *file, const char *str) {
+    fputc('"', file);
+    for (const char *c = str; *c != '\0'; ++c) {
+        if (*c == '"' || *c == '\\')
+            fprintf(file, "\\%c", *c);
+        else if (*c >= ' ' && *c <= '~')
+            fputc(*c, file);
+        else
+            fprintf(file, "\\%03o", (unsigned char)*c);
+    }
+    fputc('"', file);
+}
+
+static bool write_levels(
+    FILE *file, const struct PackLevel *levels, int level_count) {
+    fprintf(
+        file,
+        "// generated by embed_levels, see build_wasm.sh\n\n"
+        "#include \"web_levels.h\"\n\n"
+        "#include <stddef.h>\n\n");
+
+    _Alignas(struct GameState) static uint8_t buffer[GAME_STATE_MAX_SIZE];
+    for (int i = 0; i < level_count; ++i) {
+        struct GameState *state = (struct GameState *)buffer;
+        memset(state, 0, sizeof(buffer));
+        memcpy(state->board, levels[i].board, sizeof(state->board));
+        if (!game_preprocess_alloc(state, &state)) {
+            fprintf(stderr, "failed to preprocess %s\n", levels[i].name);
+            return false;
+        }
+        // the template is embedded on its own
+        const struct LevelTemplate *level = state->level;
+        state->level = NULL;
+        write_bytes(file, "state", i, state, game_get_size(state));
+        state->level = level;
+        write_bytes(
+            file, "level", i, game_level_template(state),
+            game_level_template_size());
+        game_free_level(state);
+    }
+
+    fprintf(file, "const struct EmbeddedLevel embedded_levels[] = {\n");
+    for (int i = 0; i < level_count; ++i) {
+        fprintf(file, "    {");
+        write_string(file, levels[i].name);
+        fprintf(
+            file,
+            ", state_%d, sizeof(state_%d), level_%d, sizeof(level_%d)},\n", i,
+            i, i, i);
+    }
+    fprintf(
+        file,
+        "};\n\n"
+        "const int embedded_level_count = %d;\n\n"
+        "const uint64_t embedded_levels_layout = 0x%016" PRIx64 "ull;\n",
+        level_count, web_levels_layout());
+    return true;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s OUT level file...\n", program);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3 || argv[1][0] == '-') {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct PackLevel *levels = NULL;
+    int level_count = 0;
+    for (int i = 2; i < argc; ++i) {
+        struct PackLevel *pack;
+        int count = load_level_pack(argv[i], &pack);
+        struct PackLevel *grown =
+            count < 0 ? NULL
+                      : realloc(
+                            levels,
+                            (level_count + count + 1) *
+                                sizeof(struct PackLevel));
+        if (grown == NULL) {
+            fprintf(stderr, "failed to load %s\n", argv[i]);
+            free(pack);
+            free(levels);
+            return 1;
+        }
+        levels = grown;
+        memcpy(levels + level_count, pack, count * sizeof(struct PackLevel));
+        level_count += count;
+        free(pack);
+    }
+    if (level_count == 0) {
+        fprintf(stderr, "no levels to embed\n");
+        free(levels);
+        return 1;
+    }
+
+    FILE *file = fopen(argv[1], "w");
+    if (file == NULL) {
+        fprintf(stderr, "failed to open %s\n", argv[1]);
+        free(levels);
+        return 1;
+    }
+    bool ok = write_levels(file, levels, level_count);
+    ok &= fclose(file) == 0;
+    if (!ok) {
+        fprintf(stderr, "failed to write %s\n", argv[1]);
+        remove(argv[1]);
+    }
+    free(levels);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,786 @@
+// checks the move engines against a reference implementation of the rules, on
+// random levels and on random states reachable in them
+//
+// the reference is written to be obviously correct rather than fast: it
+// rescans the whole board instead of keeping any index, and it numbers the
+// blocks from scratch after every move; it freezes the semantics of
+// `game_do_move` as they are, so faster engines can be checked against it by
+// adding them to BACKENDS
+//
+// IDA* is checked against BFS on every level as well, as it keeps whole states
+// of its own rather than going through the packer; levels/regressions.txt has
+// levels that broke an engine or IDA* before
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "game.h"
+#include "generator.h"
+#include "solver.h"
+#include "util.h"
+
+#define DIFF_STATES_PER_LEVEL 32
+// random moves played from the start of a level to get a state to check
+#define DIFF_MAX_DEPTH 24
+// chance of a wall of a random level hiding a piece, if it's next to an empty
+// cell
+#define DIFF_EMERGE_PERCENT 4
+// mismatches printed in full; the rest are only counted
+#define DIFF_MAX_REPORTS 3
+// nodes BFS stores and expansions IDA* makes on a level before it is skipped
+#define DIFF_SOLVER_MAX_NODES 2000
+#define DIFF_IDA_BUDGET 20000
+
+// makes every move of a state, move m moving block m / 2 in direction m % 2,
+// telling whether it is legal and writing the state after it if it is
+typedef void (*DoMovesFn)(
+    struct GameState *game,
+    int count,
+    bool *legal,
+    uint8_t (*dests)[GAME_STATE_MAX_SIZE]);
+
+struct Backend {
+    const char *name;
+    DoMovesFn do_moves;
+};
+
+static void do_moves_one_by_one(
+    struct GameState *game,
+    int count,
+    bool *legal,
+    uint8_t (*dests)[GAME_STATE_MAX_SIZE]) {
+    for (int move = 0; move < count; ++move) {
+        legal[move] = game_do_move(
+            game, move / 2, move % 2, (struct GameState *)dests[move]);
+    }
+}
+
+// the way the solver makes them, legal moves included
+static void do_moves_in_lanes(
+    struct GameState *game,
+    int count,
+    bool *legal,
+    uint8_t (*dests)[GAME_STATE_MAX_SIZE]) {
+    static struct LegalMoves moves;
+    game_get_legal_moves(game, &moves);
+    for (int first = 0; first < count; first += GAME_LANES) {
+        int lanes = count - first < GAME_LANES ? count - first : GAME_LANES;
+        blockidx_t blocks[GAME_LANES];
+        MoveBlockDir dirs[GAME_LANES];
+        struct GameState *lane_dests[GAME_LANES];
+        for (int lane = 0; lane < lanes; ++lane) {
+            blocks[lane] = (first + lane) / 2;
+            dirs[lane] = (first + lane) % 2;
+            lane_dests[lane] = (struct GameState *)dests[first + lane];
+        }
+        uint32_t mask =
+            game_do_moves(game, &moves, blocks, dirs, lanes, lane_dests);
+        for (int lane = 0; lane < lanes; ++lane)
+            legal[first + lane] = mask >> lane & 1;
+    }
+}
+
+// the engines checked against the reference
+static const struct Backend BACKENDS[] = {
+    {"game_do_move", do_moves_one_by_one},
+    {"game_do_moves", do_moves_in_lanes},
+};
+#define BACKEND_COUNT ((int)(sizeof(BACKENDS) / sizeof(BACKENDS[0])))
+
+struct EngineStats {
+    uint64_t moves;
+    uint64_t mismatches;
+    double seconds;
+};
+
+static const struct BoardPos REF_DELTAS[MOVE_BLOCK_NONE] = {
+    {-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+
+static struct BoardPos ref_add_dir(struct BoardPos pos, MoveBlockDir dir) {
+    pos.x += REF_DELTAS[dir].x;
+    pos.y += REF_DELTAS[dir].y;
+    return pos;
+}
+
+static bool ref_on_board(struct BoardPos pos) {
+    return pos.x >= 0 && pos.x < BOARD_WIDTH && pos.y >= 0 &&
+           pos.y < BOARD_HEIGHT;
+}
+
+// finds the blocks that move along with block when moving it in dir; returns
+// false if a wall, an emerge cell, a fixed block or the end of the board is in
+// the way
+static bool ref_push(
+    const struct GameState *game,
+    blockidx_t block,
+    MoveBlockDir dir,
+    bool moving[MAX_BLOCKS]) {
+    if (game->blocks[block].fixed)
+        return false;
+
+    memset(moving, 0, MAX_BLOCKS * sizeof(bool));
+    moving[block] = true;
+    for (bool grown = true; grown;) {
+        grown = false;
+        for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
+            for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
+                const struct Cell *cell = &game->board[i][j];
+                if (cell->type != CELL_PIECE || !moving[cell->data.piece.block])
+                    continue;
+
+                struct BoardPos next = ref_add_dir(MAKE_BOARD_POS(j, i), dir);
+                if (!ref_on_board(next))
+                    return false;
+                const struct Cell *next_cell = &game->board[next.y][next.x];
+                if (next_cell->type == CELL_WALL ||
+                    next_cell->type == CELL_EMERGE)
+                    return false;
+                if (next_cell->type != CELL_PIECE)
+                    continue;
+
+                blockidx_t other = next_cell->data.piece.block;
+                if (moving[other])
+                    continue;
+                if (game->blocks[other].fixed)
+                    return false;
+                moving[other] = true;
+                grown = true;
+            }
+        }
+    }
+    return true;
+}
+
+// moves the cells of the moving blocks by one, marking the cells they leave
+// and enter
+static void ref_shift(
+    struct GameState *game,
+    const bool moving[MAX_BLOCKS],
+    MoveBlockDir dir,
+    bool changed[BOARD_HEIGHT][BOARD_WIDTH]) {
+    struct Cell before[BOARD_HEIGHT][BOARD_WIDTH];
+    memcpy(before, game->board, sizeof(before));
+
+    for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
+        for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
+            const struct Cell *cell = &before[i][j];
+            if (cell->type == CELL_PIECE && moving[cell->data.piece.block])
+                game->board[i][j] = (struct Cell){0};
+        }
+    }
+    for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
+        for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
+            const struct Cell *cell = &before[i][j];
+            if (cell->type != CELL_PIECE || !moving[cell->data.piece.block])
+                continue;
+            struct BoardPos target = ref_add_dir(MAKE_BOARD_POS(j, i), dir);
+            game->board[target.y][target.x] = *cell;
+            changed[i][j] = true;
+            changed[target.y][target.x] = true;
+        }
+    }
+}
+
+// lets every block fall, along with whatever it rests on, until none can
+static void ref_settle(
+    struct GameState *game, bool changed[BOARD_HEIGHT][BOARD_WIDTH]) {
+    bool moving[MAX_BLOCKS];
+    for (bool fell = true; fell;) {
+        fell = false;
+        for (int block = 0; block < game->block_count; ++block) {
+            if (ref_push(game, block, MOVE_BLOCK_DOWN, moving)) {
+                ref_shift(game, moving, MOVE_BLOCK_DOWN, changed);
+                fell = true;
+            }
+        }
+    }
+}
+
+// releases the piece of the emerge cell at pos if its mouth is empty and has
+// a piece of the same color next to it
+static bool ref_release(
+    struct GameState *game,
+    struct BoardPos pos,
+    bool changed[BOARD_HEIGHT][BOARD_WIDTH]) {
+    struct Cell *cell = &game->board[pos.y][pos.x];
+    struct EmergeCell hidden = cell->data.emerge;
+    struct BoardPos mouth = emerge_get_mouth(&hidden, pos);
+    if (!ref_on_board(mouth) ||
+        game->board[mouth.y][mouth.x].type != CELL_EMPTY)
+        return false;
+
+    bool triggered = false;
+    for (MoveBlockDir dir = 0; dir < MOVE_BLOCK_NONE; ++dir) {
+        struct BoardPos next = ref_add_dir(mouth, dir);
+        triggered |= ref_on_board(next) &&
+                     game->board[next.y][next.x].type == CELL_PIECE &&
+                     game->board[next.y][next.x].data.piece.color ==
+                         hidden.color;
+    }
+    if (!triggered)
+        return false;
+
+    *cell = (struct Cell){.type = CELL_WALL};
+    blockidx_t block = game->block_count++;
+    game->blocks[block] = (struct Block){.pos = mouth, .fixed = hidden.fixed};
+    game->board[mouth.y][mouth.x] = (struct Cell){
+        .type = CELL_PIECE,
+        .data.piece = {.color = hidden.color, .block = block},
+    };
+    changed[mouth.y][mouth.x] = true;
+    return true;
+}
+
+// an emerge cell only looks at its mouth and the cells around it, and only
+// when one of them changed; the changed cells are visited in row-major order,
+// a row being taken as it is when the pass gets to it, and the emerge cells
+// watching a cell in row-major order as well
+static bool ref_emerge_pass(
+    struct GameState *game, bool changed[BOARD_HEIGHT][BOARD_WIDTH]) {
+    bool released = false;
+    for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
+        bool row[BOARD_WIDTH];
+        memcpy(row, changed[i], sizeof(row));
+        memset(changed[i], 0, sizeof(row));
+
+        for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
+            if (!row[j])
+                continue;
+            for (board_coord_t y = 0; y < BOARD_HEIGHT; ++y) {
+                for (board_coord_t x = 0; x < BOARD_WIDTH; ++x) {
+                    const struct Cell *cell = &game->board[y][x];
+                    if (cell->type != CELL_EMERGE)
+                        continue;
+                    struct BoardPos mouth = emerge_get_mouth(
+                        &cell->data.emerge, MAKE_BOARD_POS(x, y));
+                    if (abs(mouth.x - j) + abs(mouth.y - i) > 1)
+                        continue;
+                    released |=
+                        ref_release(game, MAKE_BOARD_POS(x, y), changed);
+                }
+            }
+        }
+    }
+    return released;
+}
+
+static bool ref_can_connect(
+    const struct PieceCell *from,
+    const struct PieceCell *to,
+    MoveBlockDir dir) {
+    return ((from->color ^ to->color) & 0x7f) == 0 &&
+           !(from->no_connect & (1 << dir)) &&
+           !(to->no_connect & (1 << DIR_OPPOSITE(dir)));
+}
+
+// numbers the blocks in row-major order of their top left cell; pieces belong
+// to the same block if they did before or if they can connect now, and a block
+// is fixed if any of the blocks it's made of was
+static void ref_relabel(struct GameState *game) {
+    int labels[BOARD_HEIGHT][BOARD_WIDTH];
+    memset(labels, 0xff, sizeof(labels));
+    struct Block blocks[MAX_BLOCKS];
+    struct BoardPos stack[BOARD_HEIGHT * BOARD_WIDTH];
+    int count = 0;
+
+    for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
+        for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
+            if (game->board[i][j].type != CELL_PIECE || labels[i][j] >= 0)
+                continue;
+
+            blocks[count] = (struct Block){.pos = MAKE_BOARD_POS(j, i)};
+            int top = 0;
+            stack[0] = MAKE_BOARD_POS(j, i);
+            labels[i][j] = count;
+            while (top >= 0) {
+                struct BoardPos pos = stack[top--];
+                const struct PieceCell *from =
+                    &game->board[pos.y][pos.x].data.piece;
+                blocks[count].fixed |= game->blocks[from->block].fixed;
+
+                for (MoveBlockDir dir = 0; dir < MOVE_BLOCK_NONE; ++dir) {
+                    struct BoardPos next = ref_add_dir(pos, dir);
+                    if (!ref_on_board(next) || labels[next.y][next.x] >= 0)
+                        continue;
+                    const struct Cell *cell = &game->board[next.y][next.x];
+                    if (cell->type != CELL_PIECE)
+                        continue;
+                    const struct PieceCell *to = &cell->data.piece;
+                    if (to->block != from->block &&
+                        !ref_can_connect(from, to, dir))
+                        continue;
+                    labels[next.y][next.x] = count;
+                    stack[++top] = next;
+                }
+            }
+            ++count;
+        }
+    }
+
+    for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
+        for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
+            if (labels[i][j] >= 0)
+                game->board[i][j].data.piece.block = labels[i][j];
+        }
+    }
+    memcpy(game->blocks, blocks, count * sizeof(struct Block));
+    game->block_count = count;
+}
+
+static bool ref_do_move(
+    const struct GameState *game,
+    blockidx_t block,
+    MoveBlockDir dir,
+    struct GameState *dest) {
+    bool moving[MAX_BLOCKS];
+    if (!ref_push(game, block, dir, moving))
+        return false;
+
+    bool changed[BOARD_HEIGHT][BOARD_WIDTH] = {0};
+    memcpy(dest, game, game_get_size(game));
+    ref_shift(dest, moving, dir, changed);
+    ref_settle(dest, changed);
+    while (ref_emerge_pass(dest, changed))
+        ref_settle(dest, changed);
+    ref_relabel(dest);
+    return true;
+}
+
+// compares two states up to the numbering of their blocks
+static bool states_equal(const struct GameState *a, const struct GameState *b) {
+    if (a->block_count != b->block_count)
+        return false;
+
+    int a_to_b[MAX_BLOCKS];
+    int b_to_a[MAX_BLOCKS];
+    memset(a_to_b, 0xff, sizeof(a_to_b));
+    memset(b_to_a, 0xff, sizeof(b_to_a));
+    int matched = 0;
+
+    for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
+        for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
+            const struct Cell *x = &a->board[i][j];
+            const struct Cell *y = &b->board[i][j];
+            if (x->type != y->type)
+                return false;
+            if (x->type == CELL_EMERGE &&
+                (x->data.emerge.color != y->data.emerge.color ||
+                 x->data.emerge.dir != y->data.emerge.dir ||
+                 x->data.emerge.fixed != y->data.emerge.fixed))
+                return false;
+            if (x->type != CELL_PIECE)
+                continue;
+
+            const struct PieceCell *p = &x->data.piece;
+            const struct PieceCell *q = &y->data.piece;
+            if (p->color != q->color || p->no_connect != q->no_connect ||
+                p->block >= a->block_count || q->block >= b->block_count)
+                return false;
+            if (a_to_b[p->block] < 0 && b_to_a[q->block] < 0) {
+                a_to_b[p->block] = q->block;
+                b_to_a[q->block] = p->block;
+                ++matched;
+            }
+            if (a_to_b[p->block] != q->block)
+                return false;
+        }
+    }
+    if (matched != a->block_count)
+        return false;
+
+    for (int block = 0; block < a->block_count; ++block) {
+        const struct Block *x = &a->blocks[block];
+        const struct Block *y = &b->blocks[a_to_b[block]];
+        if (x->fixed != y->fixed || x->pos.x != y->pos.x ||
+            x->pos.y != y->pos.y)
+            return false;
+    }
+    return true;
+}
+
+// splitmix64, like the generator's
+static uint64_t rng_next(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// turns some of the walls next to an empty cell into emerge cells
+static void add_emerge_cells(
+    struct Cell board[BOARD_HEIGHT][BOARD_WIDTH], uint64_t *rng) {
+    int colors = 0;
+    for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
+        for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
+            const struct Cell *cell = &board[i][j];
+            if (cell->type == CELL_PIECE &&
+                (cell->data.piece.color & 0x7f) >= colors)
+                colors = (cell->data.piece.color & 0x7f) + 1;
+        }
+    }
+    if (colors == 0)
+        return;
+
+    for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
+        for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
+            if (board[i][j].type != CELL_WALL ||
+                (int)(rng_next(rng) % 100) >= DIFF_EMERGE_PERCENT)
+                continue;
+            MoveBlockDir dir = rng_next(rng) % MOVE_BLOCK_NONE;
+            struct BoardPos mouth = ref_add_dir(MAKE_BOARD_POS(j, i), dir);
+            if (!ref_on_board(mouth) ||
+                board[mouth.y][mouth.x].type != CELL_EMPTY)
+                continue;
+            board[i][j] = (struct Cell){
+                .type = CELL_EMERGE,
+                .data.emerge = {
+                    .color = rng_next(rng) % colors,
+                    .dir = dir,
+                    .fixed = rng_next(rng) % 10 == 0,
+                }};
+        }
+    }
+}
+
+static double wall_seconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct Harness {
+    uint64_t rng;
+    // every move of the state being checked, by the reference and by an
+    // engine, at index `block * 2 + dir`
+    uint8_t (*expected)[GAME_STATE_MAX_SIZE];
+    uint8_t (*got)[GAME_STATE_MAX_SIZE];
+    bool legal[MAX_BLOCKS * 2];
+    struct LegalMoves moves;
+    struct EngineStats reference;
+    struct EngineStats legal_moves;
+    struct EngineStats backends[BACKEND_COUNT];
+    int reports;
+    // reset for every level
+    struct Solver *bfs;
+    struct Solver *ida;
+    uint64_t solved_levels;
+    uint64_t solver_mismatches;
+};
+
+static void report_mismatch(
+    struct Harness *harness,
+    const char *engine,
+    const char *level,
+    const struct GameState *state,
+    int move,
+    const char *what) {
+    if (harness->reports++ >= DIFF_MAX_REPORTS)
+        return;
+
+    const struct Block *block = &state->blocks[move / 2];
+    printf(
+        "%s: %s of %c%c%c in level %s\n", engine, what, 'a' + block->pos.x,
+        'a' + block->pos.y, move % 2 == MOVE_BLOCK_LEFT ? 'L' : 'R', level);
+    print_game(state);
+}
+
+static void check_state(
+    struct Harness *harness, const char *level, struct GameState *state) {
+    int count = state->block_count * 2;
+
+    double start = wall_seconds();
+    for (int move = 0; move < count; ++move) {
+        harness->legal[move] = ref_do_move(
+            state, move / 2, move % 2,
+            (struct GameState *)harness->expected[move]);
+    }
+    harness->reference.seconds += wall_seconds() - start;
+    harness->reference.moves += count;
+
+    // the blocks every legal move pushes, as game_get_legal_moves has them
+    start = wall_seconds();
+    game_get_legal_moves(state, &harness->moves);
+    harness->legal_moves.seconds += wall_seconds() - start;
+    harness->legal_moves.moves += count;
+    for (int move = 0; move < count; ++move) {
+        blockidx_t block = move / 2;
+        MoveBlockDir dir = move % 2;
+        bool movable = block_set_has(&harness->moves.movable[dir], block);
+        bool same = movable == harness->legal[move];
+
+        bool pushed[MAX_BLOCKS];
+        if (same && movable) {
+            ref_push(state, block, dir, pushed);
+            const struct BlockSet *set = &harness->moves.pushed[block][dir];
+            for (int other = 0; other < state->block_count; ++other)
+                same &= pushed[other] == block_set_has(set, other);
+        }
+        if (!same) {
+            ++harness->legal_moves.mismatches;
+            report_mismatch(
+                harness, "game_get_legal_moves", level, state, move,
+                "wrong pushed blocks");
+        }
+    }
+
+    for (int k = 0; k < BACKEND_COUNT; ++k) {
+        struct EngineStats *stats = &harness->backends[k];
+        bool legal[MAX_BLOCKS * 2];
+        start = wall_seconds();
+        BACKENDS[k].do_moves(state, count, legal, harness->got);
+        stats->seconds += wall_seconds() - start;
+        stats->moves += count;
+
+        for (int move = 0; move < count; ++move) {
+            const char *what = NULL;
+            if (legal[move] != harness->legal[move])
+                what = legal[move] ? "allowed illegal move" : "refused move";
+            else if (
+                legal[move] &&
+                !states_equal(
+                    (struct GameState *)harness->expected[move],
+                    (struct GameState *)harness->got[move]))
+                what = "wrong state after move";
+            if (what != NULL) {
+                ++stats->mismatches;
+                report_mismatch(
+                    harness, BACKENDS[k].name, level, state, move, what);
+            }
+        }
+    }
+}
+
+// false if the solver can't be set up
+static bool start_solver(
+    struct Solver **solver,
+    const struct GameState *root,
+    const struct SolverOptions *options) {
+    if (*solver == NULL)
+        *solver = solver_new(root, options);
+    else if (!solver_reset(*solver, root, options))
+        return false;
+    return *solver != NULL;
+}
+
+// both searches are optimal, so they have to agree on the length of the
+// solution, or on there being none; levels one of them doesn't finish within
+// its limit are skipped, IDA* only searching the ones BFS finished
+static void check_solvers(
+    struct Harness *harness, const char *level, const struct GameState *root) {
+    struct SolverOptions bfs_options = {
+        .mode = SOLVER_MODE_BFS,
+        .max_nodes = DIFF_SOLVER_MAX_NODES,
+    };
+    struct SolverOptions ida_options = {
+        .mode = SOLVER_MODE_IDA,
+        .max_nodes = DIFF_SOLVER_MAX_NODES,
+    };
+    if (!start_solver(&harness->bfs, root, &bfs_options) ||
+        solver_step(harness->bfs, SIZE_MAX) == SOLVER_LIMIT ||
+        !start_solver(&harness->ida, root, &ida_options))
+        return;
+    SolverStatus expected = solver_get_status(harness->bfs);
+    SolverStatus got = solver_step(harness->ida, DIFF_IDA_BUDGET);
+    if (got == SOLVER_RUNNING || got == SOLVER_LIMIT)
+        return;
+
+    int expected_length = 0;
+    int got_length = 0;
+    solver_get_solution(harness->bfs, &expected_length);
+    solver_get_solution(harness->ida, &got_length);
+    ++harness->solved_levels;
+    if (got == expected && got_length == expected_length)
+        return;
+    ++harness->solver_mismatches;
+    if (harness->reports++ >= DIFF_MAX_REPORTS)
+        return;
+    printf(
+        "IDA*: %s in %d moves, BFS: %s in %d moves, in level %s\n",
+        got == SOLVER_SOLVED ? "solved" : "unsolvable", got_length,
+        expected == SOLVER_SOLVED ? "solved" : "unsolvable", expected_length,
+        level);
+    print_game(root);
+}
+
+// plays random moves from the start of the level, checking every state on
+// the way
+static void check_level(
+    struct Harness *harness,
+    const char *level,
+    struct GameState *root,
+    uint64_t *iterations) {
+    // the engines only let pieces fall once something under them moved, so
+    // the start of a level is settled like any state after a move
+    _Alignas(struct GameState) uint8_t bufs[2][GAME_STATE_MAX_SIZE];
+    struct GameState *state = (struct GameState *)bufs[0];
+    struct GameState *next = (struct GameState *)bufs[1];
+    bool changed[BOARD_HEIGHT][BOARD_WIDTH] = {0};
+    memcpy(state, root, game_get_size(root));
+    ref_settle(state, changed);
+    ref_relabel(state);
+    memcpy(root, state, game_get_size(state));
+    check_solvers(harness, level, root);
+
+    for (int k = 0; k < DIFF_STATES_PER_LEVEL && *iterations > 0; ++k) {
+        memcpy(state, root, game_get_size(root));
+        int depth = rng_next(&harness->rng) % (DIFF_MAX_DEPTH + 1);
+        for (int d = 0; d < depth; ++d) {
+            int count = state->block_count * 2;
+            int move = count > 0 ? rng_next(&harness->rng) % count : 0;
+            // the first legal move from a random one on
+            bool moved = false;
+            for (int tries = 0; tries < count && !moved; ++tries) {
+                int m = (move + tries) % count;
+                moved = ref_do_move(state, m / 2, m % 2, next);
+            }
+            if (!moved)
+                break;
+            struct GameState *tmp = state;
+            state = next;
+            next = tmp;
+        }
+
+        check_state(harness, level, state);
+        --*iterations;
+    }
+}
+
+static void print_stats(const char *name, const struct EngineStats *stats) {
+    printf(
+        "%-24s %12" PRIu64 " %12" PRIu64 " %10.1f\n", name, stats->moves,
+        stats->mismatches,
+        stats->moves > 0 ? stats->seconds * 1e9 / stats->moves : 0.0);
+}
+
+static void usage(const char *program) {
+    fprintf(
+        stderr, "usage: %s [--seed S] [--iterations N] [level file...]\n",
+        program);
+}
+
+int main(int argc, char **argv) {
+    uint64_t seed = 1;
+    uint64_t iterations = 10000;
+    const char **paths = malloc(argc * sizeof(const char *));
+    int path_count = 0;
+    if (paths == NULL)
+        return 1;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = strtoull(argv[++i], NULL, 10);
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            free(paths);
+            return 1;
+        } else {
+            paths[path_count++] = argv[i];
+        }
+    }
+
+    // the levels to play, random ones if there are no files
+    struct PackLevel *levels = NULL;
+    int level_count = 0;
+    for (int i = 0; i < path_count; ++i) {
+        struct PackLevel *pack;
+        int count = load_level_pack(paths[i], &pack);
+        struct PackLevel *grown =
+            count < 0 ? NULL
+                      : realloc(
+                            levels,
+                            (level_count + count + 1) *
+                                sizeof(struct PackLevel));
+        if (grown == NULL) {
+            fprintf(stderr, "failed to load %s\n", paths[i]);
+            free(pack);
+            free(levels);
+            free(paths);
+            return 1;
+        }
+        levels = grown;
+        memcpy(levels + level_count, pack, count * sizeof(struct PackLevel));
+        level_count += count;
+        free(pack);
+    }
+    free(paths);
+
+    struct Harness *harness = calloc(1, sizeof(struct Harness));
+    if (harness != NULL) {
+        harness->expected = malloc(MAX_BLOCKS * 2 * GAME_STATE_MAX_SIZE);
+        harness->got = malloc(MAX_BLOCKS * 2 * GAME_STATE_MAX_SIZE);
+    }
+    if (harness == NULL || harness->expected == NULL || harness->got == NULL) {
+        fprintf(stderr, "out of memory\n");
+        if (harness != NULL) {
+            free(harness->expected);
+            free(harness->got);
+        }
+        free(harness);
+        free(levels);
+        return 1;
+    }
+    harness->rng = seed;
+
+    struct GeneratorOptions options = {.seed = seed};
+    generator_default_options(&options);
+
+    uint64_t remaining = iterations;
+    uint64_t level_number = 0;
+    for (; remaining > 0; ++level_number) {
+        struct GameState tmp = {0};
+        char name[LEVEL_NAME_SIZE];
+        if (level_count > 0) {
+            const struct PackLevel *level = &levels[level_number % level_count];
+            memcpy(tmp.board, level->board, sizeof(tmp.board));
+            snprintf(name, sizeof(name), "%s", level->name);
+        } else {
+            generator_build_candidate(&options, level_number, tmp.board);
+            uint64_t rng = seed ^ level_number;
+            rng_next(&rng);
+            add_emerge_cells(tmp.board, &rng);
+            snprintf(name, sizeof(name), "#%" PRIu64, level_number);
+        }
+
+        struct GameState *root = NULL;
+        if (!game_preprocess_alloc(&tmp, &root)) {
+            fprintf(stderr, "out of memory\n");
+            game_free(&root);
+            break;
+        }
+        check_level(harness, name, root, &remaining);
+        game_free(&root);
+    }
+
+    printf(
+        "seed %" PRIu64 ", %" PRIu64 " states of %" PRIu64 " levels\n", seed,
+        iterations - remaining, level_number);
+    printf(
+        "%-24s %12s %12s %10s\n", "engine", "moves", "mismatches",
+        "ns/move");
+    print_stats("reference", &harness->reference);
+    print_stats("game_get_legal_moves", &harness->legal_moves);
+    uint64_t mismatches = harness->legal_moves.mismatches;
+    for (int k = 0; k < BACKEND_COUNT; ++k) {
+        print_stats(BACKENDS[k].name, &harness->backends[k]);
+        mismatches += harness->backends[k].mismatches;
+    }
+    printf(
+        "IDA* against BFS: %" PRIu64 " levels, %" PRIu64 " mismatches\n",
+        harness->solved_levels, harness->solver_mismatches);
+    mismatches += harness->solver_mismatches;
+
+    solver_free(&harness->bfs);
+    solver_free(&harness->ida);
+
+    free(harness->expected);
+    free(harness->got);
+    free(harness);
+    free(levels);
+    return mismatches == 0 && remaining == 0 ? 0 : 1;
+}
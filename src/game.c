@@ -11,6 +11,49 @@
 static const struct BoardPos DIR_DELTAS[5] = {
     {-1, 0}, {1, 0}, {0, -1}, {0, 1}, {0, 0}};
 
+static const struct BoardBounds FULL_BOUNDS = {
+    0, 0, BOARD_HEIGHT - 1, BOARD_WIDTH - 1};
+
+// a row of the board, one bit per column
+#if BOARD_WIDTH <= 16
+typedef uint16_t board_row_t;
+#else
+typedef uint32_t board_row_t;
+#endif
+
+struct LevelTemplate {
+    struct BoardBounds bounds;
+    // walls, emerge cells and initially fixed pieces, one bit per column
+    board_row_t obstacles[BOARD_HEIGHT];
+    // leftmost and rightmost column a piece can slide to from each cell before
+    // hitting an obstacle or the edge of the board
+    int8_t reach_left[BOARD_HEIGHT][BOARD_WIDTH];
+    int8_t reach_right[BOARD_HEIGHT][BOARD_WIDTH];
+    // lowest row a piece can fall to from each cell
+    int8_t floor[BOARD_HEIGHT][BOARD_WIDTH];
+    struct BoardPos emerge[BOARD_WIDTH * BOARD_HEIGHT];
+    int emerge_count;
+    // the emerge cells watching each cell, the ones whose mouth is the cell or
+    // next to it, as indices into `emerge`: the entries from
+    // watch_start[y * BOARD_WIDTH + x] up to the next cell's start; cells that
+    // never change aren't watched
+    int16_t watch_start[BOARD_WIDTH * BOARD_HEIGHT + 1];
+    int16_t watch_list[4 * BOARD_WIDTH * BOARD_HEIGHT];
+    // cells watched by any emerge cell
+    board_row_t watched[BOARD_HEIGHT];
+    // colors of the pieces and the emerge cells; blocks are single-colored and
+    // no color ever runs out of blocks, so once every hidden piece is out,
+    // every state has at least this many blocks, and exactly this many once
+    // solved
+    int color_count;
+
+    // every cell a piece could ever reach from each cell, as a column mask per
+    // row: pieces only ever move sideways and down
+    board_row_t dead_reach[BOARD_HEIGHT][BOARD_WIDTH][BOARD_HEIGHT];
+    // the level can't be solved wherever the pieces are
+    bool always_dead;
+};
+
 // we can have this globals due to the fact that we only use them during one
 // exposed function call; otherwise, they would have to tied to the game state
 
@@ -27,10 +70,27 @@ static JNB_THREADLOCAL blockidx_t
     g_blocks_need_gravity[BOARD_HEIGHT * BOARD_WIDTH];
 static JNB_THREADLOCAL int g_blocks_need_gravity_top = -1;
 
-static JNB_THREADLOCAL _Alignas(
-    struct GameState) uint8_t _buf[2][GAME_STATE_MAX_SIZE];
-static JNB_THREADLOCAL struct GameState *g_tmp_state1 = (void *)_buf[0];
-static JNB_THREADLOCAL struct GameState *g_tmp_state2 = (void *)_buf[1];
+// cells that moved pieces left or entered during a move, the events the emerge
+// cells react to
+static JNB_THREADLOCAL board_row_t g_changed[BOARD_HEIGHT];
+
+// blocks directly adjacent to each block, per horizontal direction
+static JNB_THREADLOCAL struct BlockSet g_adjacent[MAX_BLOCKS][2];
+static JNB_THREADLOCAL blockidx_t g_block_stack[MAX_BLOCKS];
+
+// cells found by find_pushed_cells, which shift_pushed_cells moves, and room
+// for their contents while they're lifted off the board
+static JNB_THREADLOCAL struct BoardPos g_moved[BOARD_HEIGHT * BOARD_WIDTH];
+static JNB_THREADLOCAL int g_moved_count;
+static JNB_THREADLOCAL struct Cell g_moved_cells[BOARD_HEIGHT * BOARD_WIDTH];
+
+// the cells of every block of the state game_do_moves works on, block b's
+// from g_block_cells[g_block_start[b]] up to the next block's start
+static JNB_THREADLOCAL struct BoardPos
+    g_block_cells[BOARD_HEIGHT * BOARD_WIDTH];
+static JNB_THREADLOCAL int16_t g_block_start[MAX_BLOCKS + 1];
+
+static JNB_THREADLOCAL struct Block g_tmp_blocks[MAX_BLOCKS];
 
 // safety measure to avoid incorrect global usage
 // this should maximize the chance of catching bugs
@@ -44,8 +104,11 @@ static inline void public_safe_globals(void) {
     memset(&g_pos_stack, 0xff, sizeof(g_pos_stack));
     memset(&g_blocks_need_gravity, 0xff, sizeof(g_blocks_need_gravity));
     memset(&g_blocks_need_gravity_top, 0xff, sizeof(g_blocks_need_gravity_top));
-    memset(g_tmp_state1, 0xff, GAME_STATE_MAX_SIZE);
-    memset(g_tmp_state2, 0xff, GAME_STATE_MAX_SIZE);
+    memset(&g_moved, 0xff, sizeof(g_moved));
+    memset(&g_moved_cells, 0xff, sizeof(g_moved_cells));
+    memset(&g_block_cells, 0xff, sizeof(g_block_cells));
+    memset(&g_block_start, 0xff, sizeof(g_block_start));
+    memset(&g_tmp_blocks, 0xff, sizeof(g_tmp_blocks));
 #endif
 }
 
@@ -137,31 +200,215 @@ static void fill_block_initial(
     }
 }
 
+// labels the blocks of a board that was written directly, taking the fixed
+// property from the initial color representation; there are only walls
+// outside of `bounds`
+static void label_blocks_initial(
+    struct GameState *game,
+    struct Block *blocks,
+    const struct BoardBounds *bounds) {
+    memset(g_visited, 0, sizeof(g_visited));
+    game->block_count = 0;
+
+    for (board_coord_t i = bounds->top; i <= bounds->bottom; ++i) {
+        for (board_coord_t j = bounds->left; j <= bounds->right; ++j) {
+            if (g_visited[i][j] || game->board[i][j].type != CELL_PIECE)
+                continue;
+
+            // 0-initialization is important for the fixed field
+            blocks[game->block_count] = (struct Block){0};
+            fill_block_initial(
+                game, MAKE_BOARD_POS(j, i), &blocks[game->block_count]);
+            ++game->block_count;
+        }
+    }
+}
+
 // this is only be meant to be called in the initial state, the blocks can be
 // updated after that
 static struct Block *find_blocks(struct GameState *game) {
-    memset(g_visited, 0, sizeof(g_visited));
-
     // we could use a static array instead of allocating this dynamically, but
     // calling game_preprocess_alloc is not a common operation
-    // 0-initialization is important for the fixed field
-    struct Block *blocks =
-        calloc(1, BOARD_HEIGHT * BOARD_WIDTH * sizeof(struct Block));
+    struct Block *blocks = malloc(MAX_BLOCKS * sizeof(struct Block));
     if (blocks == NULL)
         return NULL;
 
+    // the level template with the bounds is built from the blocks
+    label_blocks_initial(game, blocks, &FULL_BOUNDS);
+
+    // a level without pieces would make this a 0 byte realloc
+    if (game->block_count == 0)
+        return blocks;
+    return realloc(blocks, game->block_count * sizeof(struct Block));
+}
+
+// grows `region` inside `mask` until it stops changing; sideways and down only
+// if `down_only`, in every direction otherwise; `mask` is empty outside of
+// the rows from `top` to `bottom`
+static void flood_rows(
+    board_row_t region[BOARD_HEIGHT],
+    const board_row_t mask[BOARD_HEIGHT],
+    int top,
+    int bottom,
+    bool down_only) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = top; i <= bottom; ++i) {
+            board_row_t row = region[i];
+            row |= (row << 1) | (row >> 1);
+            if (i > top)
+                row |= region[i - 1];
+            if (!down_only && i < bottom)
+                row |= region[i + 1];
+            row &= mask[i];
+            if (row != region[i]) {
+                region[i] = row;
+                changed = true;
+            }
+        }
+    }
+}
+
+// an emerge cell can only react to the cells its trigger depends on: its mouth
+// and the ones next to the mouth; the obstacles among them never change
+// returns false if some emerge cell can never release its piece, as its mouth
+// isn't a cell a piece can be in
+static bool build_watch_index(
+    struct LevelTemplate *level, const struct GameState *game) {
+    int16_t counts[BOARD_WIDTH * BOARD_HEIGHT + 1] = {0};
+    bool usable = true;
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int k = 0; k < level->emerge_count; ++k) {
+            struct BoardPos pos = level->emerge[k];
+            const struct Cell *cell = &game->board[pos.y][pos.x];
+            struct BoardPos mouth = emerge_get_mouth(&cell->data.emerge, pos);
+            if (mouth.x < 0 || mouth.x >= BOARD_WIDTH || mouth.y < 0 ||
+                mouth.y >= BOARD_HEIGHT ||
+                (level->obstacles[mouth.y] >> mouth.x & 1)) {
+                usable = false;
+                continue;
+            }
+
+            for (MoveBlockDir dir = 0; dir <= MOVE_BLOCK_NONE; ++dir) {
+                struct BoardPos watch = add_dir(mouth, dir);
+                if (watch.x < 0 || watch.x >= BOARD_WIDTH || watch.y < 0 ||
+                    watch.y >= BOARD_HEIGHT ||
+                    (level->obstacles[watch.y] >> watch.x & 1))
+                    continue;
+                int index = watch.y * BOARD_WIDTH + watch.x;
+                if (pass == 0) {
+                    ++counts[index + 1];
+                    level->watched[watch.y] |= (board_row_t)1 << watch.x;
+                } else {
+                    level->watch_list[counts[index]++] = k;
+                }
+            }
+        }
+
+        if (pass == 0) {
+            for (int i = 0; i < BOARD_WIDTH * BOARD_HEIGHT; ++i)
+                counts[i + 1] += counts[i];
+            memcpy(level->watch_start, counts, sizeof(counts));
+        }
+    }
+    return usable;
+}
+
+static struct LevelTemplate *level_template_new(const struct GameState *game) {
+    static_assert(
+        BOARD_WIDTH <= sizeof(board_row_t) * 8, "rows are column bit masks");
+    struct LevelTemplate *level = calloc(1, sizeof(struct LevelTemplate));
+    if (level == NULL)
+        return NULL;
+
+    int pieces[INT8_MAX + 1] = {0};
+    bool isolated[INT8_MAX + 1] = {false};
+
+    // empty until the first cell that isn't a wall
+    struct BoardBounds *bounds = &level->bounds;
+    *bounds = (struct BoardBounds){BOARD_HEIGHT, BOARD_WIDTH, -1, -1};
+
     for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
         for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
-            if (g_visited[i][j] || game->board[i][j].type != CELL_PIECE)
+            const struct Cell *cell = &game->board[i][j];
+            if (cell->type != CELL_WALL) {
+                if (bounds->top > i)
+                    bounds->top = i;
+                if (bounds->left > j)
+                    bounds->left = j;
+                bounds->bottom = i;
+                if (bounds->right < j)
+                    bounds->right = j;
+            }
+            if (cell->type == CELL_EMERGE) {
+                level->emerge[level->emerge_count++] = MAKE_BOARD_POS(j, i);
+                color_t color = cell->data.emerge.color;
+                level->color_count += pieces[color] == 0;
+                ++pieces[color];
+            }
+            if (cell->type == CELL_WALL || cell->type == CELL_EMERGE)
+                level->obstacles[i] |= 1 << j;
+            if (cell->type != CELL_PIECE)
                 continue;
 
-            fill_block_initial(
-                game, MAKE_BOARD_POS(j, i), &blocks[game->block_count]);
-            ++game->block_count;
+            const struct PieceCell *piece = &cell->data.piece;
+            level->color_count += pieces[piece->color] == 0;
+            ++pieces[piece->color];
+            if (piece->no_connect == (1 << MOVE_BLOCK_NONE) - 1)
+                isolated[piece->color] = true;
+            if (game->blocks[piece->block].fixed)
+                level->obstacles[i] |= 1 << j;
         }
     }
 
-    return realloc(blocks, game->block_count * sizeof(struct Block));
+    for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
+        // runs of free cells between obstacles
+        int start = 0;
+        for (board_coord_t j = 0; j <= BOARD_WIDTH; ++j) {
+            if (j < BOARD_WIDTH && !(level->obstacles[i] >> j & 1))
+                continue;
+            for (int k = start; k < j; ++k) {
+                level->reach_left[i][k] = start;
+                level->reach_right[i][k] = j - 1;
+            }
+            start = j + 1;
+        }
+    }
+
+    for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
+        int bottom = BOARD_HEIGHT - 1;
+        for (board_coord_t i = BOARD_HEIGHT - 1; i >= 0; --i) {
+            if (level->obstacles[i] >> j & 1)
+                bottom = i - 1;
+            level->floor[i][j] = bottom;
+        }
+    }
+
+    if (!build_watch_index(level, game))
+        level->always_dead = true;
+
+    // separate fixed blocks can still be joined by pieces moved in between
+    // them, only a piece that can't connect at all keeps a color apart
+    for (int color = 0; color <= INT8_MAX; ++color) {
+        if (isolated[color] && pieces[color] > 1)
+            level->always_dead = true;
+    }
+
+    board_row_t open[BOARD_HEIGHT];
+    for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i)
+        open[i] = ~level->obstacles[i] & (((board_row_t)1 << BOARD_WIDTH) - 1);
+    for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
+        for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
+            if (!(open[i] >> j & 1))
+                continue;
+            board_row_t *reach = level->dead_reach[i][j];
+            reach[i] = (board_row_t)1 << j;
+            flood_rows(reach, open, bounds->top, bounds->bottom, true);
+        }
+    }
+
+    return level;
 }
 
 bool game_preprocess_alloc(struct GameState *initial, struct GameState **dest) {
@@ -177,13 +424,18 @@ bool game_preprocess_alloc(struct GameState *initial, struct GameState **dest) {
     }
 
     if (*dest != initial) {
-        memcpy(*dest, initial, sizeof(struct GameState));
+        memcpy(*dest, initial, offsetof(struct GameState, blocks));
     }
 
     memcpy(
         (*dest)->blocks, blocks, initial->block_count * sizeof(struct Block));
     free(blocks);
 
+    // the template needs the fixed property of the blocks
+    (*dest)->level = level_template_new(*dest);
+    if ((*dest)->level == NULL)
+        return false;
+
     // not exactly needed
     // if (*dest != initial) {
     //     initial->block_count = 0;
@@ -193,26 +445,61 @@ bool game_preprocess_alloc(struct GameState *initial, struct GameState **dest) {
     return true;
 }
 
+void game_rebuild_blocks(struct GameState *game) {
+    label_blocks_initial(game, game->blocks, &game->level->bounds);
+    public_safe_globals();
+}
+
 void game_free(struct GameState **game) {
+    if (*game == NULL)
+        return;
+    game_free_level(*game);
     free(*game);
     *game = NULL;
 }
 
-static inline bool
-    is_stop_cell(const struct GameState *game, const struct Cell *cell) {
-    if (cell->type == CELL_EMPTY)
-        return false;
+void game_free_level(struct GameState *game) {
+    free((void *)game->level);
+    game->level = NULL;
+}
 
-    if (cell->type == CELL_WALL || cell->type == CELL_EMERGE)
-        return true;
+size_t game_level_template_size(void) {
+    return sizeof(struct LevelTemplate);
+}
 
-    // in case more types are added and I forget
-    assert(cell->type == CELL_PIECE);
-    const struct PieceCell *piece = &cell->data.piece;
-    return game->blocks[piece->block].fixed;
+const void *game_level_template(const struct GameState *game) {
+    return game->level;
+}
+
+bool game_attach_level_template(
+    struct GameState *game, const void *data, size_t size) {
+    if (size != sizeof(struct LevelTemplate))
+        return false;
+    struct LevelTemplate *level = malloc(sizeof(struct LevelTemplate));
+    if (level == NULL)
+        return false;
+    memcpy(level, data, sizeof(struct LevelTemplate));
+    game->level = level;
+    return true;
+}
+
+// whether moving a piece from pos in dir hits something that never moves
+static inline bool level_stops(
+    const struct LevelTemplate *level, struct BoardPos pos, MoveBlockDir dir) {
+    switch (dir) {
+    case MOVE_BLOCK_LEFT:
+        return pos.x <= level->reach_left[pos.y][pos.x];
+    case MOVE_BLOCK_RIGHT:
+        return pos.x >= level->reach_right[pos.y][pos.x];
+    case MOVE_BLOCK_DOWN:
+        return pos.y >= level->floor[pos.y][pos.x];
+    default:
+        return pos.y == 0 || (level->obstacles[pos.y - 1] >> pos.x & 1);
+    }
 }
 
 // adds adjacent blocks to g_blocks_need_move
+// adds the cells of the block to g_moved
 // marks blocks on top in g_blocks_need_gravity
 // returns whether or not it found something that can't be moved
 // relies on g_visited being cleared before the call loop
@@ -230,9 +517,15 @@ static bool block_add_adjacent_blocks(
 
     while (stack_top >= 0) {
         struct BoardPos pos = g_pos_stack[stack_top];
-        g_visited[pos.y][pos.x] = true;
         --stack_top;
 
+        // a cell can be pushed twice before it's reached, and a block can be
+        // pushed by more than one of the blocks moving along
+        if (g_visited[pos.y][pos.x])
+            continue;
+        g_visited[pos.y][pos.x] = true;
+        g_moved[g_moved_count++] = pos;
+
         // gravity
         if (dir != MOVE_BLOCK_UP) {
             struct BoardPos above = add_dir(pos, MOVE_BLOCK_UP);
@@ -266,27 +559,25 @@ static bool block_add_adjacent_blocks(
 
         // we don't need to iterate directions for this, only look to one side
 
-        struct BoardPos next_pos = add_dir(pos, dir);
-        const struct Cell *cell = game_get_pos_safe(game, next_pos);
-
-        // end of board
+        // the end of the board, walls, emerge cells and the initially fixed
+        // pieces never change, so the level template knows about them
         // TODO: maybe make this configurable for wraparound?
-        if (cell == NULL)
+        if (level_stops(game->level, pos, dir))
             return true;
 
+        struct BoardPos next_pos = add_dir(pos, dir);
+        const struct Cell *cell = game_get_pos(game, next_pos);
+
         if (cell->type == CELL_EMPTY)
             continue;
 
-        if (is_stop_cell(game, cell))
-            return true;
-
-        // if it's visited and it's not a stop cell, it's a piece of a block
-        // processed previously from move_block
+        // if it's visited, it's a piece of a block processed previously from
+        // move_block
         if (g_visited[next_pos.y][next_pos.x])
             continue;
 
+        // everything else that isn't empty is a piece
         assert(cell->type == CELL_PIECE);
-        // all non-stop cells are pieces, so we can safely do this
         const struct PieceCell *new_piece = &cell->data.piece;
 
         if (new_piece->block == block) {
@@ -310,25 +601,18 @@ static bool block_add_adjacent_blocks(
     return false;
 }
 
-// just moves a block, which can result in a temporarily unresolved state
-// returns whether or not the move was successful
+// finds all cells that need to be moved in order to move the given block by
+// doing a DFS starting at the block using block_add_adjacent_blocks, leaving
+// them in g_moved; nothing is written to the state
+// returns whether or not the block can be moved
 // marks moved blocks in g_blocks_need_gravity as well
-static bool move_block(
-    struct GameState *restrict game,
-    blockidx_t block,
-    MoveBlockDir dir,
-    struct GameState *restrict dest) {
-    // finds all blocks that need to be moved in order to move the given block
-    // by doing a DFS starting at the block using block_add_adjacent_blocks,
-    // then performs the move if the destination is not NULL
-
-    assert(dest != game);
-
+static bool find_pushed_cells(
+    struct GameState *game, blockidx_t block, MoveBlockDir dir) {
     if (game->blocks[block].fixed == true)
         return false;
 
     memset(g_visited, 0, sizeof(g_visited));
-    memset(g_blocks_need_move, 0, sizeof(g_blocks_need_move));
+    g_moved_count = 0;
     g_blocks_need_move_top = 0;
     g_blocks_need_move[0] = block;
 
@@ -360,113 +644,79 @@ static bool move_block(
         }
     }
 
-    if (dest == NULL) {
-        // theoretically unneeded since this use case doesn't happen within the
-        // internal game logic
-        g_blocks_need_gravity_top = gravity_top_before;
-        return true;
-    }
-
-    // important! clear the board
-    memset(dest, 0, game_get_size(game));
-
-    // at this point, the state of g_visited is useful to us as a mask for
-    // the cells that need to be moved, so all we have to do is iterate over
-    // all the cells
-
-    // copy the block data
-    game_copy_block_data(dest, game);
-
-#if 1
-    for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
-        for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
-            MoveBlockDir needed_dir = g_visited[i][j] ? dir : MOVE_BLOCK_NONE;
-            struct BoardPos target = add_dir(MAKE_BOARD_POS(j, i), needed_dir);
-            struct Cell *dest_cell = game_get_pos(dest, target);
-
-            if (dest_cell->type != CELL_EMPTY)
-                // this means something was moved here at a previous step
-                continue;
-
-            *dest_cell = *game_get_pos(game, MAKE_BOARD_POS(j, i));
-
-            struct Block *block_of = &dest->blocks[dest_cell->data.piece.block];
-            if (block_of->pos.x == j && block_of->pos.y == i) {
-                // we can update the block pos in the dest now
-                block_of->pos = target;
-            }
-        }
-    }
-
-#else
-    // in this branch, we are going to do 2 passes to make sure overlaps don't
-    // occur
-
-    // the first pass will be to copy the blocks that don't need to be moved
-    for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
-        for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
-            // if we need to move it, leave it to the second pass
-            if (g_visited[i][j])
-                continue;
+    return true;
+}
 
-            struct Cell *dest_cell = game_get_pos(dest, MAKE_BOARD_POS(j, i));
-            *dest_cell = *game_get_pos(game, MAKE_BOARD_POS(j, i));
-        }
+// moves the cells found by find_pushed_cells one cell in dir, in place; only
+// the moved cells and the block data are written, so a move costs as much as
+// the cells it moves rather than a copy of the whole state
+static void shift_pushed_cells(struct GameState *game, MoveBlockDir dir) {
+    // lift every cell off the board first, as the target of a cell can be
+    // where another one still has to move from
+    for (int k = 0; k < g_moved_count; ++k) {
+        struct Cell *cell = game_get_pos(game, g_moved[k]);
+        g_moved_cells[k] = *cell;
+        *cell = (struct Cell){0};
     }
 
-    // the second pass will be to move the blocks that need to be moved
-    for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
-        for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
-            if (!g_visited[i][j])
-                continue;
+    // a moved cell never leaves the bounds, as it can't move into a wall
+    for (int k = 0; k < g_moved_count; ++k) {
+        struct BoardPos pos = g_moved[k];
+        struct BoardPos target = add_dir(pos, dir);
+        struct Cell *cell = game_get_pos(game, target);
+        assert(cell->type == CELL_EMPTY);
+        *cell = g_moved_cells[k];
 
-            struct BoardPos target = add_dir(MAKE_BOARD_POS(j, i), dir);
-            struct Cell *dest_cell = game_get_pos(dest, target);
-            assert(dest_cell->type == CELL_EMPTY);
-            *dest_cell = *game_get_pos(game, MAKE_BOARD_POS(j, i));
+        // any cell of the block will do as its position until
+        // update_block_connections finds the top left one
+        game->blocks[cell->data.piece.block].pos = target;
 
-            struct Block *block_of = &dest->blocks[dest_cell->data.piece.block];
-            if (block_of->pos.x == j && block_of->pos.y == i) {
-                // we can update the block pos in the dest now
-                block_of->pos = target;
-            }
-        }
+        g_changed[pos.y] |= (board_row_t)1 << pos.x;
+        g_changed[target.y] |= (board_row_t)1 << target.x;
     }
-#endif
+}
 
+// just moves a block in place, which can result in a temporarily unresolved
+// state
+// returns whether or not the move was successful
+// marks moved blocks in g_blocks_need_gravity as well
+static bool
+    move_block(struct GameState *game, blockidx_t block, MoveBlockDir dir) {
+    if (!find_pushed_cells(game, block, dir))
+        return false;
+    shift_pushed_cells(game, dir);
     return true;
 }
 
-static inline struct BoardPos min_pos(struct BoardPos a, struct BoardPos b) {
-    if (a.y == b.y) {
-        return a.x < b.x ? a : b;
-    }
-    return a.y < b.y ? a : b;
-}
+// flood fills the block containing pos, relabeling every cell with new_idx
+// and writing the merged block data to dest; cells connect either because
+// they were already part of the same block or because they can connect now
+static void connect_adjacent_blocks(
+    struct GameState *game,
+    struct BoardPos pos,
+    blockidx_t new_idx,
+    struct Block *dest) {
+    // we scan the board in row-major order, so the first cell we get called
+    // with is already the lexically smallest position of the block
+    dest->pos = pos;
+    dest->fixed = false;
 
-static void connect_adjacent_blocks(struct GameState *game, blockidx_t block) {
     int stack_top = 0;
-    struct BoardPos pos = game->blocks[block].pos;
     g_pos_stack[stack_top] = pos;
-
-    struct Block *block_ptr = &game->blocks[block];
+    g_visited[pos.y][pos.x] = true;
 
     while (stack_top >= 0) {
         struct BoardPos pos = g_pos_stack[stack_top];
-        g_visited[pos.y][pos.x] = true;
         --stack_top;
 
         struct Cell *cell = game_get_pos(game, pos);
         assert(cell->type == CELL_PIECE);
 
-        // update the lexically smallest position representing the block
-        // this is only going to do anything when the previous block assigned to
-        // the cell at pos was different from our block, but doing it
-        // unconditionally is probably faster
-        // if (cell->data.piece.block != block)
-        block_ptr->pos = min_pos(block_ptr->pos, pos);
-        // change the block index on the board
-        cell->data.piece.block = block;
+        // unvisited cells still hold their old block index, so we have to
+        // remember ours before overwriting it
+        blockidx_t old_idx = cell->data.piece.block;
+        dest->fixed |= game->blocks[old_idx].fixed;
+        cell->data.piece.block = new_idx;
 
         for (MoveBlockDir dir = 0; dir < MOVE_BLOCK_NONE; ++dir) {
             struct BoardPos next_pos = add_dir(pos, dir);
@@ -481,7 +731,8 @@ static void connect_adjacent_blocks(struct GameState *game, blockidx_t block) {
             const struct PieceCell *from = &cell->data.piece;
             const struct PieceCell *to = &new_cell->data.piece;
 
-            if (to->block == block || pieces_can_connect(from, to, dir)) {
+            if (to->block == old_idx || pieces_can_connect(from, to, dir)) {
+                g_visited[next_pos.y][next_pos.x] = true;
                 ++stack_top;
                 g_pos_stack[stack_top] = next_pos;
             }
@@ -491,29 +742,121 @@ static void connect_adjacent_blocks(struct GameState *game, blockidx_t block) {
 
 static void
     update_block_connections(struct GameState *game, struct Block *tmp_buf) {
-    // iterate over blocks, updating the connections for each
-    // blocks will also get reindexed and it's important that we iterate over
-    // them in order, so that the resulting block array is contiguous
-    // first, we are going to be modifying them in-place, which will cause some
-    // of the blocks to become invalid, then we will reindex them using tmp
+    // relabel the blocks in row-major order of their top left corner, merging
+    // the ones that became connected; the old block data stays intact in
+    // game->blocks until the end, because the fixed property has to be
+    // inherited from it
+    // this also makes the block numbering canonical: the same board always
+    // ends up with the same block indices, so equal positions are byte-equal
+    // game states (the solver relies on this for deduplication)
 
     memset(g_visited, 0, sizeof(g_visited));
 
+    const struct BoardBounds *bounds = &game->level->bounds;
     int dest_idx = 0;
-    for (blockidx_t src_idx = 0; src_idx < game->block_count; ++src_idx) {
-        struct Block *src = &game->blocks[src_idx];
+    for (board_coord_t i = bounds->top; i <= bounds->bottom; ++i) {
+        for (board_coord_t j = bounds->left; j <= bounds->right; ++j) {
+            if (g_visited[i][j] || game->board[i][j].type != CELL_PIECE)
+                continue;
 
-        if (g_visited[src->pos.y][src->pos.x])
-            continue;
+            connect_adjacent_blocks(
+                game, MAKE_BOARD_POS(j, i), dest_idx, &tmp_buf[dest_idx]);
+            ++dest_idx;
+        }
+    }
+
+    memcpy(game->blocks, tmp_buf, dest_idx * sizeof(struct Block));
+    game->block_count = dest_idx;
+}
 
-        connect_adjacent_blocks(game, src_idx);
+// moves the blocks marked in g_blocks_need_gravity down until they can't be
+// moved any more
+static void apply_gravity(struct GameState *game) {
+    while (g_blocks_need_gravity_top >= 0) {
+        blockidx_t block = g_blocks_need_gravity[g_blocks_need_gravity_top];
+        --g_blocks_need_gravity_top;
 
-        tmp_buf[dest_idx] = *src;
-        ++dest_idx;
+        while (move_block(game, block, MOVE_BLOCK_DOWN))
+            ;
     }
+}
 
-    memcpy(game->blocks, tmp_buf, game->block_count * sizeof(struct Block));
-    game->block_count = dest_idx;
+// releases the piece of an emerge cell if its trigger holds, as a new block
+// marked for gravity
+static bool emerge_piece(struct GameState *game, int emerge) {
+    struct BoardPos pos = game->level->emerge[emerge];
+    struct Cell *cell = game_get_pos(game, pos);
+    if (cell->type != CELL_EMERGE)
+        // already out
+        return false;
+
+    struct BoardPos mouth = emerge_get_mouth(&cell->data.emerge, pos);
+    struct Cell *mouth_cell = game_get_pos(game, mouth);
+    if (mouth_cell->type != CELL_EMPTY)
+        return false;
+
+    struct EmergeCell hidden = cell->data.emerge;
+    bool triggered = false;
+    for (MoveBlockDir dir = 0; dir < MOVE_BLOCK_NONE && !triggered; ++dir) {
+        const struct Cell *next = game_get_pos_safe(game, add_dir(mouth, dir));
+        triggered = next != NULL && next->type == CELL_PIECE &&
+                    next->data.piece.color == hidden.color;
+    }
+    if (!triggered)
+        return false;
+
+    *cell = (struct Cell){.type = CELL_WALL};
+    blockidx_t block = game->block_count++;
+    game->blocks[block] = (struct Block){.pos = mouth, .fixed = hidden.fixed};
+    *mouth_cell = (struct Cell){
+        .type = CELL_PIECE,
+        .data.piece = {.color = hidden.color, .block = block},
+    };
+    g_changed[mouth.y] |= (board_row_t)1 << mouth.x;
+
+    ++g_blocks_need_gravity_top;
+    g_blocks_need_gravity[g_blocks_need_gravity_top] = block;
+    return true;
+}
+
+// checks the emerge cells watching the cells that changed since the last call
+// returns whether or not any piece came out
+static bool emerge_pieces(struct GameState *game) {
+    const struct LevelTemplate *level = game->level;
+    bool emerged = false;
+    for (board_coord_t i = level->bounds.top; i <= level->bounds.bottom; ++i) {
+        board_row_t row = g_changed[i] & level->watched[i];
+        // pieces coming out mark their mouth again, for the next call
+        g_changed[i] = 0;
+        while (row != 0) {
+            int cell = i * BOARD_WIDTH + __builtin_ctz(row);
+            row &= row - 1;
+            for (int w = level->watch_start[cell];
+                 w < level->watch_start[cell + 1]; ++w)
+                emerged |= emerge_piece(game, level->watch_list[w]);
+        }
+    }
+    return emerged;
+}
+
+// everything a move does after the pushed cells were shifted: the pieces fall,
+// come out of emerge cells and connect
+static void finish_move(struct GameState *game) {
+    // apply gravity by moving all the blocks down until they can't be moved any
+    // more
+    // first we move the newly moved blocks
+    // after that, we can move the blocks marked as above the moved blocks in
+    // their intial position
+    apply_gravity(game);
+
+    // pieces coming out of emerge cells fall as well, which can trigger more
+    // emerge cells
+    if (game->level->emerge_count > 0) {
+        while (emerge_pieces(game))
+            apply_gravity(game);
+    }
+
+    update_block_connections(game, g_tmp_blocks);
 }
 
 // TODO: add a higher level version of this function that returns some sort
@@ -531,11 +874,9 @@ bool game_do_move(
     // above them
     memset(g_blocks_need_gravity, 0, sizeof(g_blocks_need_gravity));
     g_blocks_need_gravity_top = -1;
+    memset(g_changed, 0, sizeof(g_changed));
 
-    struct GameState *front = g_tmp_state1;
-    struct GameState *back = g_tmp_state2;
-
-    bool could_move = move_block(game, block, dir, front);
+    bool could_move = find_pushed_cells(game, block, dir);
     if (!could_move)
         return false;
 
@@ -544,28 +885,301 @@ bool game_do_move(
     if (dest == NULL)
         return true;
 
-    // apply gravity by moving all the blocks down until they can't be moved any
-    // more
-    // first we move the newly moved blocks
-    // after that, we can move the blocks marked as above the moved blocks in
-    // their intial position
+    // this is the only copy of the state a move makes; everything after it
+    // works in place, touching just the cells that move
+    memcpy(dest, game, game_get_size(game));
+    shift_pushed_cells(dest, dir);
+    finish_move(dest);
 
-    while (g_blocks_need_gravity_top >= 0) {
-        blockidx_t block = g_blocks_need_gravity[g_blocks_need_gravity_top];
-        --g_blocks_need_gravity_top;
+    public_safe_globals();
+    return true;
+}
 
-        while (move_block(front, block, MOVE_BLOCK_DOWN, back)) {
-            struct GameState *tmp = front;
-            front = back;
-            back = tmp;
+// lists the cells of every block in g_block_cells, for gather_pushed_cells
+static void index_block_cells(const struct GameState *game) {
+    memset(g_block_start, 0, (game->block_count + 1) * sizeof(int16_t));
+    const struct BoardBounds *bounds = &game->level->bounds;
+    for (board_coord_t i = bounds->top; i <= bounds->bottom; ++i) {
+        for (board_coord_t j = bounds->left; j <= bounds->right; ++j) {
+            const struct Cell *cell = &game->board[i][j];
+            if (cell->type == CELL_PIECE)
+                ++g_block_start[cell->data.piece.block + 1];
         }
     }
+    for (int block = 0; block < game->block_count; ++block)
+        g_block_start[block + 1] += g_block_start[block];
+
+    // every block's start moves up by its size while filling, so afterwards
+    // each start is where the next block's was, and shifting them back by one
+    // restores them
+    for (board_coord_t i = bounds->top; i <= bounds->bottom; ++i) {
+        for (board_coord_t j = bounds->left; j <= bounds->right; ++j) {
+            const struct Cell *cell = &game->board[i][j];
+            if (cell->type == CELL_PIECE)
+                g_block_cells[g_block_start[cell->data.piece.block]++] =
+                    MAKE_BOARD_POS(j, i);
+        }
+    }
+    memmove(
+        g_block_start + 1, g_block_start,
+        game->block_count * sizeof(int16_t));
+    g_block_start[0] = 0;
+}
 
-    // resulting state is now in front
-    memcpy(dest, front, game_get_size(front));
+// does what find_pushed_cells does for a move that game_get_legal_moves
+// already found the pushed blocks of: the cells come from the index of
+// index_block_cells instead of a search of the board, and the pushed blocks
+// and the blocks resting on them are marked for gravity
+static void gather_pushed_cells(
+    const struct GameState *game, const struct BlockSet *pushed) {
+    g_moved_count = 0;
+    for (int w = 0; w < BLOCK_SET_WORDS; ++w) {
+        for (uint64_t bits = pushed->bits[w]; bits != 0; bits &= bits - 1) {
+            blockidx_t block = w * 64 + __builtin_ctzll(bits);
+            ++g_blocks_need_gravity_top;
+            g_blocks_need_gravity[g_blocks_need_gravity_top] = block;
+
+            for (int k = g_block_start[block]; k < g_block_start[block + 1];
+                 ++k) {
+                struct BoardPos pos = g_block_cells[k];
+                g_moved[g_moved_count++] = pos;
+                if (pos.y == 0)
+                    continue;
+                const struct Cell *above = &game->board[pos.y - 1][pos.x];
+                if (above->type == CELL_PIECE &&
+                    !block_set_has(pushed, above->data.piece.block)) {
+                    ++g_blocks_need_gravity_top;
+                    g_blocks_need_gravity[g_blocks_need_gravity_top] =
+                        above->data.piece.block;
+                }
+            }
+        }
+    }
+}
+
+uint32_t game_do_moves(
+    const struct GameState *game,
+    const struct LegalMoves *legal,
+    const blockidx_t *blocks,
+    const MoveBlockDir *dirs,
+    int count,
+    struct GameState *const *dests) {
+    assert(count <= GAME_LANES);
+
+    // the cells of the pushed blocks are found once for every lane, and the
+    // blocks each lane pushes are already known, so a lane doesn't search the
+    // board at all before its cells move
+    index_block_cells(game);
+
+    uint32_t legal_lanes = 0;
+    for (int lane = 0; lane < count; ++lane) {
+        blockidx_t block = blocks[lane];
+        MoveBlockDir dir = dirs[lane];
+        assert(DIR_IS_HORIZONTAL(dir));
+        if (!block_set_has(&legal->movable[dir], block))
+            continue;
+        legal_lanes |= (uint32_t)1 << lane;
+
+        g_blocks_need_gravity_top = -1;
+        memset(g_changed, 0, sizeof(g_changed));
+        gather_pushed_cells(game, &legal->pushed[block][dir]);
 
-    update_block_connections(dest, back->blocks);
+        struct GameState *dest = dests[lane];
+        memcpy(dest, game, game_get_size(game));
+        shift_pushed_cells(dest, dir);
+        finish_move(dest);
+    }
 
     public_safe_globals();
+    return legal_lanes;
+}
+
+void game_get_legal_moves(
+    const struct GameState *game, struct LegalMoves *dest) {
+    // instead of doing a separate push DFS for every block, like move_block,
+    // we gather the blocks each block directly touches and whether it directly
+    // touches an obstacle with a single board pass, then close the adjacency
+    // sets over the (tiny) block graph
+
+    // blocks that touch something unmovable, per direction
+    struct BlockSet obstructed[2];
+    memset(obstructed, 0, sizeof(obstructed));
+    memset(g_adjacent, 0, game->block_count * sizeof(g_adjacent[0]));
+
+    const struct BoardBounds *bounds = &game->level->bounds;
+    for (board_coord_t i = bounds->top; i <= bounds->bottom; ++i) {
+        for (board_coord_t j = bounds->left; j <= bounds->right; ++j) {
+            const struct Cell *cell = &game->board[i][j];
+            if (cell->type != CELL_PIECE)
+                continue;
+            blockidx_t block = cell->data.piece.block;
+
+            for (MoveBlockDir dir = MOVE_BLOCK_LEFT; dir <= MOVE_BLOCK_RIGHT;
+                 ++dir) {
+                struct BoardPos pos = MAKE_BOARD_POS(j, i);
+                if (level_stops(game->level, pos, dir)) {
+                    block_set_add(&obstructed[dir], block);
+                    continue;
+                }
+
+                struct BoardPos next_pos = add_dir(pos, dir);
+                const struct Cell *next = &game->board[next_pos.y][next_pos.x];
+                if (next->type == CELL_EMPTY)
+                    continue;
+                // pieces that merged into a fixed block after the start
+                if (game->blocks[next->data.piece.block].fixed) {
+                    block_set_add(&obstructed[dir], block);
+                    continue;
+                }
+                if (next->data.piece.block != block)
+                    block_set_add(
+                        &g_adjacent[block][dir], next->data.piece.block);
+            }
+        }
+    }
+
+    dest->block_count = game->block_count;
+    memset(dest->movable, 0, sizeof(dest->movable));
+
+    for (blockidx_t block = 0; block < game->block_count; ++block) {
+        for (MoveBlockDir dir = MOVE_BLOCK_LEFT; dir <= MOVE_BLOCK_RIGHT;
+             ++dir) {
+            struct BlockSet *pushed = &dest->pushed[block][dir];
+            memset(pushed, 0, sizeof(*pushed));
+
+            if (game->blocks[block].fixed)
+                continue;
+
+            // DFS over the block graph; cycles are possible with interlocking
+            // blocks, the visited set takes care of them
+            bool blocked = false;
+            int stack_top = 0;
+            g_block_stack[stack_top] = block;
+            block_set_add(pushed, block);
+            while (stack_top >= 0 && !blocked) {
+                blockidx_t cur = g_block_stack[stack_top];
+                --stack_top;
+
+                if (block_set_has(&obstructed[dir], cur)) {
+                    blocked = true;
+                    break;
+                }
+
+                const struct BlockSet *adjacent = &g_adjacent[cur][dir];
+                for (int w = 0; w < BLOCK_SET_WORDS; ++w) {
+                    uint64_t new_bits = adjacent->bits[w] & ~pushed->bits[w];
+                    pushed->bits[w] |= new_bits;
+                    while (new_bits) {
+                        ++stack_top;
+                        g_block_stack[stack_top] =
+                            w * 64 + __builtin_ctzll(new_bits);
+                        new_bits &= new_bits - 1;
+                    }
+                }
+            }
+
+            if (!blocked)
+                block_set_add(&dest->movable[dir], block);
+        }
+    }
+}
+
+bool game_is_solved(const struct GameState *game) {
+    // the block count is kept up to date by every merge, so this is all it
+    // takes, apart from the hidden pieces
+    const struct LevelTemplate *level = game->level;
+    if (game->block_count != level->color_count)
+        return false;
+    for (int k = 0; k < level->emerge_count; ++k) {
+        struct BoardPos pos = level->emerge[k];
+        if (game->board[pos.y][pos.x].type == CELL_EMERGE)
+            return false;
+    }
     return true;
 }
+
+int game_colors_remaining(const struct GameState *game) {
+    // blocks are single-colored, so a color is done when it has a single block
+    uint8_t groups[INT8_MAX + 1] = {0};
+    int remaining = 0;
+    for (int i = 0; i < game->block_count; ++i) {
+        struct BoardPos pos = game->blocks[i].pos;
+        color_t color = game->board[pos.y][pos.x].data.piece.color;
+        remaining += ++groups[color] == 2;
+    }
+    // a hidden piece is a block of its color that's still apart
+    const struct LevelTemplate *level = game->level;
+    for (int k = 0; k < level->emerge_count; ++k) {
+        struct BoardPos pos = level->emerge[k];
+        const struct Cell *cell = &game->board[pos.y][pos.x];
+        if (cell->type == CELL_EMERGE)
+            remaining += ++groups[cell->data.emerge.color] == 2;
+    }
+    return remaining;
+}
+
+bool game_is_dead(const struct GameState *game) {
+    const struct LevelTemplate *level = game->level;
+    if (level->always_dead)
+        return true;
+
+    // per color, every cell its pieces could end up in, along with the cells
+    // of its fixed pieces; the final block of the color has to fit in there,
+    // and it's connected, so the region has to be connected as well
+    int8_t slots[INT8_MAX + 1];
+    memset(slots, -1, sizeof(slots));
+    board_row_t regions[INT8_MAX + 1][BOARD_HEIGHT];
+    struct BoardPos seeds[INT8_MAX + 1];
+    int slot_count = 0;
+
+    const struct BoardBounds *bounds = &level->bounds;
+    for (board_coord_t i = bounds->top; i <= bounds->bottom; ++i) {
+        for (board_coord_t j = bounds->left; j <= bounds->right; ++j) {
+            const struct Cell *cell = &game->board[i][j];
+            struct BoardPos pos = MAKE_BOARD_POS(j, i);
+            color_t color;
+            bool fixed;
+            if (cell->type == CELL_PIECE) {
+                color = cell->data.piece.color;
+                fixed = game->blocks[cell->data.piece.block].fixed;
+            } else if (cell->type == CELL_EMERGE) {
+                // a hidden piece starts out in the mouth, which always_dead
+                // guarantees to be a cell a piece can be in
+                color = cell->data.emerge.color;
+                fixed = cell->data.emerge.fixed;
+                pos = emerge_get_mouth(&cell->data.emerge, pos);
+            } else {
+                continue;
+            }
+
+            if (slots[color] < 0) {
+                slots[color] = slot_count;
+                memset(regions[slot_count], 0, sizeof(regions[slot_count]));
+                seeds[slot_count] = pos;
+                ++slot_count;
+            }
+
+            board_row_t *region = regions[slots[color]];
+            if (fixed) {
+                region[pos.y] |= (board_row_t)1 << pos.x;
+                continue;
+            }
+            for (int k = pos.y; k <= bounds->bottom; ++k)
+                region[k] |= level->dead_reach[pos.y][pos.x][k];
+        }
+    }
+
+    for (int slot = 0; slot < slot_count; ++slot) {
+        board_row_t connected[BOARD_HEIGHT] = {0};
+        connected[seeds[slot].y] = (board_row_t)1 << seeds[slot].x;
+        flood_rows(
+            connected, regions[slot], bounds->top, bounds->bottom, false);
+        if (memcmp(connected, regions[slot], sizeof(connected)) != 0)
+            return true;
+    }
+    return false;
+}
+
+const struct BoardBounds *game_get_bounds(const struct GameState *game) {
+    return &game->level->bounds;
+}
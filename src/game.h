@@ -6,8 +6,20 @@
 #include <stdint.h>
 #include <string.h>
 
-#define BOARD_WIDTH 14
-#define BOARD_HEIGHT 10
+// the largest board the engine handles, set with the `board_width` and
+// `board_height` build options; smaller levels fill the rest with walls, and
+// the hot loops only visit the part of the board a level actually uses (see
+// `game_get_bounds`)
+#ifndef BOARD_WIDTH
+    #define BOARD_WIDTH 14
+#endif
+#ifndef BOARD_HEIGHT
+    #define BOARD_HEIGHT 10
+#endif
+
+// solution strings name the columns and rows with a single lowercase letter
+static_assert(
+    BOARD_WIDTH <= 26 && BOARD_HEIGHT <= 26, "boards are at most 26x26");
 
 typedef int8_t board_coord_t;
 
@@ -36,9 +48,31 @@ typedef int8_t PieceConnect;
 #define DIR_OPPOSITE(dir) ((dir) ^ 1)
 #define DIR_IS_HORIZONTAL(dir) ((dir) < MOVE_BLOCK_UP)
 
+// every cell can be a separate block
+#define MAX_BLOCKS (BOARD_WIDTH * BOARD_HEIGHT)
+
 // signed is not enough (in theory)
 // index of a block in the game state
+#if MAX_BLOCKS <= 256
 typedef uint8_t blockidx_t;
+#else
+typedef uint16_t blockidx_t;
+#endif
+#define BLOCK_SET_WORDS ((MAX_BLOCKS + 63) / 64)
+
+/// @brief Bit set of block indices.
+struct BlockSet {
+    uint64_t bits[BLOCK_SET_WORDS];
+};
+
+static inline void block_set_add(struct BlockSet *set, blockidx_t block) {
+    set->bits[block / 64] |= (uint64_t)1 << (block % 64);
+}
+
+static inline bool
+    block_set_has(const struct BlockSet *set, blockidx_t block) {
+    return (set->bits[block / 64] >> (block % 64)) & 1;
+}
 
 // reserve highest bit for holding fixed state until we process the blocks and
 // discard it
@@ -53,9 +87,16 @@ static inline color_t piece_make_color(int8_t color, bool fixed) {
     return (color & 0x7f) | (fixed << 7);
 }
 
+/// @brief A wall with a piece hidden in it. The piece comes out into the
+/// mouth, the cell next to it in `dir`, after a move that leaves the mouth
+/// empty with a piece of the same color next to it; the emerge cell turns into
+/// a plain wall then. The new piece falls and connects like any other, and a
+/// level is only solved once every hidden piece is out.
 struct EmergeCell {
+    /// @brief Color of the hidden piece, without the fixed bit.
     color_t color;
     MoveBlockDir dir;
+    /// @brief Whether or not the piece is fixed once it's out.
     bool fixed;
 };
 
@@ -82,6 +123,25 @@ struct BoardPos {
 
 #define MAKE_BOARD_POS(x, y) ((struct BoardPos){(x), (y)})
 
+/// @brief Get the mouth of the emerge cell at `pos`, the cell its piece comes
+/// out into.
+static inline struct BoardPos
+    emerge_get_mouth(const struct EmergeCell *emerge, struct BoardPos pos) {
+    MoveBlockDir dir = emerge->dir;
+    pos.x += (dir == MOVE_BLOCK_RIGHT) - (dir == MOVE_BLOCK_LEFT);
+    pos.y += (dir == MOVE_BLOCK_DOWN) - (dir == MOVE_BLOCK_UP);
+    return pos;
+}
+
+/// @brief The smallest rectangle holding every cell of a level that isn't a
+/// wall; everything outside of it is a wall in every state. Inclusive.
+struct BoardBounds {
+    board_coord_t top;
+    board_coord_t left;
+    board_coord_t bottom;
+    board_coord_t right;
+};
+
 /// @brief A block is a set of connected piece-type cells. NOTE: the pieces are
 /// not necessarily the same color, but any new pieces that connect have to be
 /// the same color as the adjacent ones that are already part of the block.
@@ -92,12 +152,21 @@ struct Block {
     bool fixed;
 };
 
+/// @brief Everything about a level that can't change by playing it: where the
+/// walls, emerge cells and initially fixed pieces are, how far a piece can
+/// slide or fall before hitting one of them, and the dead state data. Built
+/// once by `game_preprocess_alloc` and shared by every state of the level.
+struct LevelTemplate;
+
 /// @brief Load something by writing to the board. Then use `game_finish_init`
 /// to finish initialization. To release resources, use `game_free`.
 struct GameState {
     /// @brief The game board; to be altered before calling
     /// `game_preprocess_alloc`.
     struct Cell board[BOARD_HEIGHT][BOARD_WIDTH];
+    /// @brief Set by `game_preprocess_alloc`, the same for every state of the
+    /// level, so it doesn't make equal states compare different.
+    const struct LevelTemplate *level;
     int block_count;
     // opted for flexible array member because this will make working with an
     // array of game states more efficient, although we will lose some memory,
@@ -106,13 +175,19 @@ struct GameState {
     struct Block blocks[];
 };
 
-#define GAME_STATE_MAX_SIZE     \
-    (sizeof(struct GameState) + \
-     BOARD_WIDTH * BOARD_HEIGHT * sizeof(struct Block))
+// rounded up to the alignment, so that arrays of state buffers keep every
+// state aligned
+#define GAME_STATE_MAX_SIZE                               \
+    ((sizeof(struct GameState) +                          \
+      BOARD_WIDTH * BOARD_HEIGHT * sizeof(struct Block) + \
+      _Alignof(struct GameState) - 1) /                   \
+     _Alignof(struct GameState) * _Alignof(struct GameState))
 
-/// @brief Get the size of a game state.
+/// @brief Get the size of a game state. The blocks start before the end of the
+/// struct's padding, so nothing past the last block is counted.
 static inline size_t game_get_size(const struct GameState *game) {
-    return sizeof(struct GameState) + game->block_count * sizeof(struct Block);
+    return offsetof(struct GameState, blocks) +
+           game->block_count * sizeof(struct Block);
 }
 
 static inline void game_copy_block_data(
@@ -137,14 +212,24 @@ static inline struct Cell *
 
 /// @brief Do preprocessing before the game state is ready to be used or after
 /// it has been modified (doesn't reuse information). If `*dest` is `NULL`, then
-/// it will also perform allocation.
+/// it will also perform allocation. A new level template is built every time,
+/// see `game_free_level`.
 /// @param game
 /// @return Whether or not memory allocation succeeded
 bool game_preprocess_alloc(struct GameState *game, struct GameState **dest);
 
+/// @brief Recompute the block data of a state from its board alone, in place.
+/// Fixed pieces have to be marked with `piece_make_color`, the same way as for
+/// `game_preprocess_alloc`. Blocks are the connected components of the pieces
+/// that can connect, which is what every reachable state consists of, so this
+/// reproduces the exact state `game_do_move` would have written.
+/// @param game Has to have room for `MAX_BLOCKS` blocks
+void game_rebuild_blocks(struct GameState *game);
+
 /// @brief Tries to do a game move by moving a block either left or right.
 /// Writes the updated game state to `dest` if it's not `NULL`. Caller is
-/// responsible for properly allocating dest.
+/// responsible for properly allocating dest. Gravity and the pieces coming
+/// out of emerge cells are part of the move.
 /// @param game
 /// @param block
 /// @param dir Direction of move
@@ -156,7 +241,104 @@ bool game_do_move(
     MoveBlockDir dir,
     struct GameState *restrict dest);
 
-/// @brief Free and invalidate a game state. This only makes sense if `*dest`
-/// was `NULL` for `game_preprocess_alloc`.
+/// @brief Every legal move of a game state, along with the blocks each of them
+/// pushes. Only the first `block_count` entries of `pushed` are written.
+struct LegalMoves {
+    int block_count;
+    /// @brief Blocks that can be moved, indexed by horizontal direction.
+    struct BlockSet movable[2];
+    /// @brief Blocks that move when moving a block in a direction, including
+    /// the block itself. Only meaningful for movable blocks.
+    struct BlockSet pushed[MAX_BLOCKS][2];
+};
+
+/// @brief Compute every legal move at once, which is much cheaper than trying
+/// `game_do_move` with a `NULL` destination for every block and direction.
+/// @param game
+/// @param dest
+void game_get_legal_moves(
+    const struct GameState *game, struct LegalMoves *dest);
+
+// moves `game_do_moves` makes at once, at most 32 for its mask
+#define GAME_LANES 16
+
+/// @brief Make up to `GAME_LANES` moves from the same state at once, lane `i`
+/// moving `blocks[i]` in `dirs[i]`. Equivalent to a `game_do_move` for every
+/// lane, but cheaper from the second lane on, as the lanes share an index of
+/// the state's blocks and reuse the pushed blocks from `legal`, so no lane
+/// searches the board for the cells it pushes. Meant for generating the
+/// successors of a state a batch at a time.
+/// @param game
+/// @param legal The legal moves of `game`, from `game_get_legal_moves`
+/// @param blocks
+/// @param dirs Horizontal directions
+/// @param count Number of lanes used
+/// @param dests Destination of every lane; none of them can be `game`
+/// @return Mask of the lanes whose move could be made; the destinations of
+/// the other lanes are left untouched
+uint32_t game_do_moves(
+    const struct GameState *game,
+    const struct LegalMoves *legal,
+    const blockidx_t *blocks,
+    const MoveBlockDir *dirs,
+    int count,
+    struct GameState *const *dests);
+
+/// @brief Check whether every color has been merged into a single block. This
+/// is a constant time check against the number of colors of the level, along
+/// with one for every emerge cell of the level, as every hidden piece has to be
+/// out.
+/// @param game
+/// @return Whether or not the game state is a winning one
+bool game_is_solved(const struct GameState *game);
+
+/// @brief Count the colors that are still split into more than one block.
+/// @param game
+/// @return 0 exactly when the game state is solved
+int game_colors_remaining(const struct GameState *game);
+
+/// @brief Cheap test for states that can't be solved anymore: a color whose
+/// pieces can't all end up in one connected region, like a piece stuck in a
+/// pit or pieces separated by walls, or a level where some color has a piece
+/// that can't connect at all and isn't alone in its color.
+/// Never true for a solvable state.
+/// @param game
+/// @return Whether or not the state is known to be dead
+bool game_is_dead(const struct GameState *game);
+
+/// @brief Get the part of the board the level uses, see `struct BoardBounds`.
+/// @param game Preprocessed game state
+const struct BoardBounds *game_get_bounds(const struct GameState *game);
+
+/// @brief Free and invalidate a game state, along with its level template.
+/// This only makes sense if `*dest` was `NULL` for `game_preprocess_alloc`, and
+/// no other state of the level may be used afterwards.
 /// @param game
 void game_free(struct GameState **game);
+
+/// @brief Free the level template of a state that wasn't allocated by
+/// `game_preprocess_alloc`. No state of the level may be used afterwards.
+/// @param game
+void game_free_level(struct GameState *game);
+
+/// @brief Size of a level template, see `game_level_template`.
+size_t game_level_template_size(void);
+
+/// @brief The level template of a preprocessed state, as bytes, for levels
+/// that are preprocessed ahead of time. It holds no pointers, but its layout
+/// depends on the build.
+/// @param game Preprocessed game state
+/// @return `game_level_template_size()` bytes
+const void *game_level_template(const struct GameState *game);
+
+/// @brief Give a copy of a preprocessed state a level template of its own
+/// again, so that it can be used without `game_preprocess_alloc`. It is
+/// released with `game_free_level`, like one that was built.
+/// @param game The state's bytes from a build with the same layout; `level`
+/// is overwritten
+/// @param data Bytes from `game_level_template`
+/// @param size
+/// @return `false` if memory allocation failed or `size` doesn't match this
+/// build
+bool game_attach_level_template(
+    struct GameState *game, const void *data, size_t size);
@@ -0,0 +1,334 @@
+#include "generator.h"
+
+#include "solver.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef JNB_THREADING
+    #include <stdatomic.h>
+    #include <threads.h>
+#endif
+
+// candidates checked between two acceptance scans; fixed, so that the
+// candidates tried don't depend on the number of threads
+#define GENERATOR_BATCH 128
+
+#define GENERATOR_MAX_THREADS 64
+
+enum _CandidateResult {
+    CANDIDATE_REJECTED_CHEAP = 0,
+    CANDIDATE_REJECTED_SEARCH,
+    CANDIDATE_ACCEPTED
+};
+typedef int8_t CandidateResult;
+
+struct Candidate {
+    CandidateResult result;
+    struct GeneratedLevel level;
+};
+
+struct GeneratorBatch {
+    const struct GeneratorOptions *options;
+    uint64_t first;
+    struct Candidate *candidates;
+#ifdef JNB_THREADING
+    atomic_int next;
+#else
+    int next;
+#endif
+};
+
+// splitmix64, seeded from the seed and the candidate index, so candidates can
+// be built in any order
+static uint64_t rng_next(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// in [min, max]
+static int rng_range(uint64_t *state, int min, int max) {
+    return min + (int)(rng_next(state) % (uint64_t)(max - min + 1));
+}
+
+static bool rng_percent(uint64_t *state, int percent) {
+    return (int)(rng_next(state) % 100) < percent;
+}
+
+void generator_default_options(struct GeneratorOptions *options) {
+    if (options->count == 0)
+        options->count = 10;
+    if (options->max_candidates == 0)
+        options->max_candidates = 1 << 20;
+    if (options->threads == 0)
+        options->threads = 1;
+    if (options->min_colors == 0)
+        options->min_colors = 2;
+    if (options->max_colors == 0)
+        options->max_colors = 4;
+    if (options->min_pieces == 0)
+        options->min_pieces = 2;
+    if (options->max_pieces == 0)
+        options->max_pieces = 3;
+    if (options->wall_percent == 0)
+        options->wall_percent = 15;
+    if (options->fixed_percent == 0)
+        options->fixed_percent = 5;
+    if (options->no_connect_percent == 0)
+        options->no_connect_percent = 3;
+    if (options->min_moves == 0)
+        options->min_moves = 8;
+    if (options->max_moves == 0)
+        options->max_moves = 40;
+    if (options->max_nodes == 0)
+        options->max_nodes = 1 << 14;
+
+#ifdef JNB_THREADING
+    if (options->threads > GENERATOR_MAX_THREADS)
+        options->threads = GENERATOR_MAX_THREADS;
+#else
+    options->threads = 1;
+#endif
+    // colors are written as single digits by `write_level`
+    if (options->max_colors > 10)
+        options->max_colors = 10;
+    if (options->min_colors > options->max_colors)
+        options->min_colors = options->max_colors;
+    if (options->min_pieces > options->max_pieces)
+        options->min_pieces = options->max_pieces;
+}
+
+// movable pieces fall straight down onto whatever is below them, so the
+// level doesn't start with pieces in the air
+static void settle_pieces(struct Cell board[BOARD_HEIGHT][BOARD_WIDTH]) {
+    for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
+        for (board_coord_t i = BOARD_HEIGHT - 2; i >= 0; --i) {
+            struct Cell *cell = &board[i][j];
+            if (cell->type != CELL_PIECE || (cell->data.piece.color & 0x80))
+                continue;
+            board_coord_t y = i;
+            while (y + 1 < BOARD_HEIGHT && board[y + 1][j].type == CELL_EMPTY)
+                ++y;
+            if (y != i) {
+                board[y][j] = *cell;
+                *cell = (struct Cell){0};
+            }
+        }
+    }
+}
+
+void generator_build_candidate(
+    const struct GeneratorOptions *options,
+    uint64_t index,
+    struct Cell board[BOARD_HEIGHT][BOARD_WIDTH]) {
+    uint64_t rng = options->seed;
+    rng = rng_next(&rng) ^ index;
+
+    memset(board, 0, BOARD_HEIGHT * BOARD_WIDTH * sizeof(struct Cell));
+    int empty_count = 0;
+    for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
+        for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
+            bool border = i == 0 || j == 0 || i == BOARD_HEIGHT - 1 ||
+                          j == BOARD_WIDTH - 1;
+            if (border || rng_percent(&rng, options->wall_percent))
+                board[i][j].type = CELL_WALL;
+            else
+                ++empty_count;
+        }
+    }
+
+    int colors = rng_range(&rng, options->min_colors, options->max_colors);
+    for (int color = 0; color < colors; ++color) {
+        int pieces = rng_range(&rng, options->min_pieces, options->max_pieces);
+        for (int k = 0; k < pieces && empty_count > 0; ++k) {
+            // pick the n-th empty cell
+            int n = rng_range(&rng, 0, empty_count - 1);
+            struct Cell *cell = NULL;
+            for (board_coord_t i = 0; cell == NULL && i < BOARD_HEIGHT; ++i) {
+                for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
+                    if (board[i][j].type == CELL_EMPTY && n-- == 0) {
+                        cell = &board[i][j];
+                        break;
+                    }
+                }
+            }
+
+            bool fixed = rng_percent(&rng, options->fixed_percent);
+            cell->type = CELL_PIECE;
+            cell->data.piece.color = piece_make_color(color, fixed);
+            if (rng_percent(&rng, options->no_connect_percent))
+                cell->data.piece.no_connect =
+                    rng_range(&rng, 1, (1 << MOVE_BLOCK_NONE) - 1);
+            --empty_count;
+        }
+    }
+
+    settle_pieces(board);
+}
+
+// everything that can be decided without a search, from cheapest to most
+// expensive
+static bool passes_cheap_filters(
+    const struct GeneratorOptions *options,
+    const struct GameState *game,
+    struct LegalMoves *moves) {
+    if (game_is_solved(game) || game_is_dead(game) ||
+        solver_heuristic(game) > options->max_moves)
+        return false;
+
+    game_get_legal_moves(game, moves);
+    for (int k = 0; k < BLOCK_SET_WORDS; ++k) {
+        if (moves->movable[0].bits[k] | moves->movable[1].bits[k])
+            return true;
+    }
+    return false;
+}
+
+static CandidateResult check_candidate(
+    const struct GeneratorOptions *options,
+    uint64_t index,
+    struct GeneratedLevel *dest,
+    struct GameState *game,
+    struct LegalMoves *moves) {
+    struct GameState tmp = {0};
+    generator_build_candidate(options, index, tmp.board);
+    if (!game_preprocess_alloc(&tmp, &game))
+        return CANDIDATE_REJECTED_CHEAP;
+
+    CandidateResult result = CANDIDATE_REJECTED_CHEAP;
+    if (!passes_cheap_filters(options, game, moves)) {
+        game_free_level(game);
+        return result;
+    }
+
+    // A* finds optimal solutions just like BFS, with far fewer nodes
+    struct SolverOptions solver_options = {
+        .mode = SOLVER_MODE_ASTAR,
+        .max_nodes = options->max_nodes,
+    };
+    struct Solver *solver = solver_new(game, &solver_options);
+    result = CANDIDATE_REJECTED_SEARCH;
+    if (solver != NULL && solver_step(solver, SIZE_MAX) == SOLVER_SOLVED) {
+        const struct SolverStats *stats = solver_get_stats(solver);
+        int length;
+        solver_get_solution(solver, &length);
+        if (length >= options->min_moves && length <= options->max_moves) {
+            dest->index = index;
+            memcpy(dest->board, tmp.board, sizeof(dest->board));
+            dest->moves = length;
+            dest->branching = stats->expanded > 0 ? (double)stats->generated /
+                                                        stats->expanded
+                                                  : 0;
+            dest->score = length * log2(1 + dest->branching);
+            result = CANDIDATE_ACCEPTED;
+        }
+    }
+    solver_free(&solver);
+    game_free_level(game);
+    return result;
+}
+
+static int batch_worker(void *arg) {
+    struct GeneratorBatch *batch = arg;
+    _Alignas(struct GameState) uint8_t buf[GAME_STATE_MAX_SIZE];
+    struct LegalMoves *moves = malloc(sizeof(struct LegalMoves));
+    if (moves == NULL)
+        return 1;
+
+    for (;;) {
+#ifdef JNB_THREADING
+        int i = atomic_fetch_add_explicit(
+            &batch->next, 1, memory_order_relaxed);
+#else
+        int i = batch->next++;
+#endif
+        if (i >= GENERATOR_BATCH)
+            break;
+        struct Candidate *candidate = &batch->candidates[i];
+        candidate->result = check_candidate(
+            batch->options, batch->first + i, &candidate->level,
+            (struct GameState *)buf, moves);
+    }
+    free(moves);
+    return 0;
+}
+
+static bool run_batch(struct GeneratorBatch *batch, int threads) {
+#ifdef JNB_THREADING
+    atomic_init(&batch->next, 0);
+    thrd_t workers[GENERATOR_MAX_THREADS];
+    int started = 0;
+    for (; started < threads - 1; ++started) {
+        if (thrd_create(&workers[started], batch_worker, batch) !=
+            thrd_success)
+            break;
+    }
+    int res = batch_worker(batch);
+    for (int i = 0; i < started; ++i) {
+        int worker_res;
+        thrd_join(workers[i], &worker_res);
+        res |= worker_res;
+    }
+    return res == 0 && started == threads - 1;
+#else
+    (void)threads;
+    batch->next = 0;
+    return batch_worker(batch) == 0;
+#endif
+}
+
+static int compare_levels(const void *a, const void *b) {
+    const struct GeneratedLevel *x = a;
+    const struct GeneratedLevel *y = b;
+    if (x->score != y->score)
+        return x->score < y->score ? 1 : -1;
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+int generate_levels(
+    const struct GeneratorOptions *options,
+    struct GeneratedLevel *dest,
+    struct GeneratorStats *stats) {
+    struct GeneratorOptions opts = *options;
+    generator_default_options(&opts);
+    *stats = (struct GeneratorStats){0};
+
+    struct GeneratorBatch batch = {
+        .options = &opts,
+        .candidates = malloc(GENERATOR_BATCH * sizeof(struct Candidate)),
+    };
+    if (batch.candidates == NULL)
+        return -1;
+
+    int count = 0;
+    while (count < opts.count && batch.first < opts.max_candidates) {
+        if (!run_batch(&batch, opts.threads)) {
+            free(batch.candidates);
+            return -1;
+        }
+
+        // in index order, and only up to the last accepted candidate once
+        // done, so the stats don't depend on the threads either
+        for (int i = 0; i < GENERATOR_BATCH && count < opts.count &&
+                        batch.first + i < opts.max_candidates;
+             ++i) {
+            const struct Candidate *candidate = &batch.candidates[i];
+            ++stats->candidates;
+            if (candidate->result == CANDIDATE_ACCEPTED)
+                dest[count++] = candidate->level;
+            else if (candidate->result == CANDIDATE_REJECTED_SEARCH)
+                ++stats->rejected_search;
+            else
+                ++stats->rejected_cheap;
+        }
+        batch.first += GENERATOR_BATCH;
+    }
+    stats->accepted = count;
+    free(batch.candidates);
+
+    qsort(dest, count, sizeof(struct GeneratedLevel), compare_levels);
+    return count;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "game.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief Parameters of the random levels and of the filtering. Zero fields
+/// are replaced by the defaults of `generator_default_options`.
+struct GeneratorOptions {
+    uint64_t seed;
+    /// @brief Number of levels to produce.
+    int count;
+    /// @brief Give up after this many candidates.
+    uint64_t max_candidates;
+    /// @brief Worker threads; 1 without `JNB_THREADING`.
+    int threads;
+    int min_colors;
+    int max_colors;
+    /// @brief Pieces of each color.
+    int min_pieces;
+    int max_pieces;
+    /// @brief Chance of an inner cell being a wall.
+    int wall_percent;
+    /// @brief Chance of a piece being fixed.
+    int fixed_percent;
+    /// @brief Chance of a piece having some of its connections disabled.
+    int no_connect_percent;
+    /// @brief Range of optimal solution lengths that is accepted.
+    int min_moves;
+    int max_moves;
+    /// @brief Node limit of the search for each candidate that passes the
+    /// cheap checks; candidates that hit it are rejected.
+    size_t max_nodes;
+};
+
+/// @brief A level that passed the filters.
+struct GeneratedLevel {
+    /// @brief Along with the seed, this is all it takes to build the level
+    /// again, see `generator_build_candidate`.
+    uint64_t index;
+    /// @brief Fixed pieces are marked with `piece_make_color`, as for
+    /// `game_preprocess_alloc`.
+    struct Cell board[BOARD_HEIGHT][BOARD_WIDTH];
+    int moves;
+    /// @brief Moves available in the states the search expanded, on average.
+    double branching;
+    /// @brief Higher for longer solutions with more choices along the way.
+    double score;
+};
+
+struct GeneratorStats {
+    uint64_t candidates;
+    /// @brief Candidates rejected without searching: solved or dead from the
+    /// start, without moves or with a heuristic above `max_moves`.
+    uint64_t rejected_cheap;
+    /// @brief Candidates rejected by the search: unsolvable, over the node
+    /// limit, or with a solution length out of range.
+    uint64_t rejected_search;
+    uint64_t accepted;
+};
+
+/// @brief Fill in the default value of every zero field.
+/// @param options
+void generator_default_options(struct GeneratorOptions *options);
+
+/// @brief Build the board of a candidate; the same seed and index always give
+/// the same board.
+/// @param options
+/// @param index
+/// @param board
+void generator_build_candidate(
+    const struct GeneratorOptions *options,
+    uint64_t index,
+    struct Cell board[BOARD_HEIGHT][BOARD_WIDTH]);
+
+/// @brief Generate levels until `options->count` of them pass the filters or
+/// `options->max_candidates` were tried. Candidates are checked in parallel,
+/// but in batches that are accepted in index order, so the result only
+/// depends on the options and not on the number of threads or their timing.
+/// @param options
+/// @param dest Has to have room for `options->count` levels; sorted by score,
+/// highest first
+/// @param stats
+/// @return The number of levels, or -1 if memory allocation or starting the
+/// threads failed
+int generate_levels(
+    const struct GeneratorOptions *options,
+    struct GeneratedLevel *dest,
+    struct GeneratorStats *stats);
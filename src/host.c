@@ -0,0 +1,627 @@
+#include "host.h"
+
+#include "b64.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef JNB_THREADING
+    #include <stdatomic.h>
+    #include <threads.h>
+#endif
+
+#define HOST_MAX_THREADS 64
+
+#define HOST_DEFAULT_MAX_SESSIONS (1 << 16)
+
+// sessions allocated at once; a slab is never freed before the host, so a
+// session stays where it is
+#define HOST_SLAB_SESSIONS 1024
+
+// state buffers a pool allocates at once
+#define HOST_SLAB_STATES 256
+
+// commands queued per worker before submitting waits, which bounds the memory
+// of the queues
+#define HOST_QUEUE_SIZE 4096
+
+// commands a worker takes off its queue at once
+#define HOST_BATCH 256
+
+#define STATE_NONE UINT32_MAX
+
+// counters of a worker are only written by it, and read by host_get_stats from
+// any thread
+#ifdef JNB_THREADING
+typedef _Atomic uint64_t host_counter_t;
+    #define COUNTER_ADD(counter, delta)                                       \
+        atomic_store_explicit(                                                \
+            &(counter),                                                       \
+            atomic_load_explicit(&(counter), memory_order_relaxed) + (delta), \
+            memory_order_relaxed)
+    #define COUNTER_LOAD(counter) \
+        atomic_load_explicit(&(counter), memory_order_relaxed)
+#else
+typedef uint64_t host_counter_t;
+    #define COUNTER_ADD(counter, delta) ((counter) += (delta))
+    #define COUNTER_LOAD(counter) (counter)
+#endif
+
+struct HostSession {
+    // guarded by the host lock: whether the session was handed out and not
+    // closed yet, the next session of the free list once the worker is done
+    // with it, and the generation stamped on its commands, which changes
+    // every time the number is handed out
+    bool open;
+    int next_free;
+    uint32_t generation;
+
+    // everything else belongs to the worker of the session
+    // generation of the commands it handles, 0 once closed; the others were
+    // submitted for an earlier session of the same number and are dropped
+    uint32_t serving;
+    int level;
+    // ring of states, as indices into the pool of the worker, where only the
+    // current one and the undo_avail ones before it are allocated
+    uint32_t states[HOST_MAX_UNDO];
+    int current;
+    int move_count;
+    int undo_avail;
+};
+
+// a command as queued, with the generation of its session when it was
+// submitted
+struct HostQueued {
+    struct HostCommand command;
+    uint32_t generation;
+};
+
+struct HostWorker {
+    struct Host *host;
+    // pool of state buffers; a free buffer holds the index of the next one
+    uint8_t **slabs;
+    int slab_count;
+    uint32_t free_state;
+    host_counter_t states_allocated;
+    host_counter_t states_in_use;
+    host_counter_t commands;
+    host_counter_t batches;
+    // the encoded state of every result
+    char *encoded;
+
+#ifdef JNB_THREADING
+    thrd_t thread;
+    // guards the queue, busy and stopping
+    mtx_t lock;
+    cnd_t ready;
+    // signaled when commands are taken off the queue and when they are done
+    cnd_t space;
+#endif
+    // ring of queued commands, oldest first
+    struct HostQueued queue[HOST_QUEUE_SIZE];
+    int head;
+    int count;
+    // a batch is being handled
+    bool busy;
+    bool stopping;
+    // only touched by the worker
+    struct HostQueued batch[HOST_BATCH];
+};
+
+struct Host {
+    struct GameState **roots;
+    int level_count;
+    struct HostOptions options;
+    struct HostWorker *workers;
+    int started;
+
+#ifdef JNB_THREADING
+    bool locked;
+    // guards the free list and the open flags of the sessions
+    mtx_t lock;
+#endif
+    struct HostSession **slabs;
+    int slab_count;
+    // sessions handed out at least once
+    int session_count;
+    int open_count;
+    int free_session;
+};
+
+static void host_lock(struct Host *host) {
+#ifdef JNB_THREADING
+    mtx_lock(&host->lock);
+#else
+    (void)host;
+#endif
+}
+
+static void host_unlock(struct Host *host) {
+#ifdef JNB_THREADING
+    mtx_unlock(&host->lock);
+#else
+    (void)host;
+#endif
+}
+
+static inline struct HostSession *
+    host_session(const struct Host *host, int session) {
+    return &host->slabs[session / HOST_SLAB_SESSIONS]
+                       [session % HOST_SLAB_SESSIONS];
+}
+
+// sessions are spread over the workers by number
+static inline struct HostWorker *
+    session_worker(const struct Host *host, int session) {
+    return &host->workers[session % host->options.threads];
+}
+
+static inline struct GameState *
+    pool_state(const struct HostWorker *worker, uint32_t index) {
+    return (struct GameState *)(worker->slabs[index / HOST_SLAB_STATES] +
+                                (size_t)(index % HOST_SLAB_STATES) *
+                                    GAME_STATE_MAX_SIZE);
+}
+
+static uint32_t pool_alloc(struct HostWorker *worker) {
+    if (worker->free_state == STATE_NONE) {
+        uint8_t **slabs = realloc(
+            worker->slabs, (worker->slab_count + 1) * sizeof(uint8_t *));
+        if (slabs == NULL)
+            return STATE_NONE;
+        worker->slabs = slabs;
+        // malloc aligns for any type, and GAME_STATE_MAX_SIZE is a multiple
+        // of the alignment of a state
+        uint8_t *slab = malloc((size_t)HOST_SLAB_STATES * GAME_STATE_MAX_SIZE);
+        if (slab == NULL)
+            return STATE_NONE;
+        slabs[worker->slab_count] = slab;
+        uint32_t first = (uint32_t)worker->slab_count * HOST_SLAB_STATES;
+        ++worker->slab_count;
+        COUNTER_ADD(worker->states_allocated, HOST_SLAB_STATES);
+        // linked in reverse, so that the first one is handed out first
+        for (uint32_t i = HOST_SLAB_STATES; i-- > 0;) {
+            memcpy(
+                pool_state(worker, first + i), &worker->free_state,
+                sizeof(uint32_t));
+            worker->free_state = first + i;
+        }
+    }
+
+    uint32_t index = worker->free_state;
+    memcpy(&worker->free_state, pool_state(worker, index), sizeof(uint32_t));
+    COUNTER_ADD(worker->states_in_use, 1);
+    return index;
+}
+
+static void pool_release(struct HostWorker *worker, uint32_t index) {
+    memcpy(pool_state(worker, index), &worker->free_state, sizeof(uint32_t));
+    worker->free_state = index;
+    COUNTER_ADD(worker->states_in_use, -1);
+}
+
+static void session_release(struct HostWorker *worker, struct HostSession *s) {
+    for (int i = 0; i < HOST_MAX_UNDO; ++i) {
+        if (s->states[i] != STATE_NONE)
+            pool_release(worker, s->states[i]);
+        s->states[i] = STATE_NONE;
+    }
+}
+
+static bool session_start(struct HostWorker *worker, struct HostSession *s) {
+    for (int i = 0; i < HOST_MAX_UNDO; ++i)
+        s->states[i] = STATE_NONE;
+    s->current = 0;
+    s->move_count = 0;
+    s->undo_avail = 0;
+
+    uint32_t state = pool_alloc(worker);
+    if (state == STATE_NONE)
+        return false;
+    s->states[0] = state;
+    const struct GameState *root = worker->host->roots[s->level];
+    memcpy(pool_state(worker, state), root, game_get_size(root));
+    return true;
+}
+
+static bool session_move(
+    struct HostWorker *worker,
+    struct HostSession *s,
+    struct BoardPos pos,
+    MoveBlockDir dir) {
+    if (s->states[s->current] == STATE_NONE ||
+        (dir != MOVE_BLOCK_LEFT && dir != MOVE_BLOCK_RIGHT) || pos.x < 0 ||
+        pos.x >= BOARD_WIDTH || pos.y < 0 || pos.y >= BOARD_HEIGHT)
+        return false;
+    struct GameState *current = pool_state(worker, s->states[s->current]);
+    const struct Cell *cell = game_get_pos(current, pos);
+    if (cell->type != CELL_PIECE)
+        return false;
+
+    // the next slot holds the oldest state once the ring is full, which the
+    // move replaces; a failed move doesn't write it
+    int next = (s->current + 1) % HOST_MAX_UNDO;
+    bool allocated = s->states[next] == STATE_NONE;
+    if (allocated) {
+        s->states[next] = pool_alloc(worker);
+        if (s->states[next] == STATE_NONE)
+            return false;
+    }
+    if (!game_do_move(
+            current, cell->data.piece.block, dir,
+            pool_state(worker, s->states[next]))) {
+        if (allocated) {
+            pool_release(worker, s->states[next]);
+            s->states[next] = STATE_NONE;
+        }
+        return false;
+    }
+
+    s->current = next;
+    ++s->move_count;
+    s->undo_avail += s->undo_avail < HOST_MAX_UNDO - 1;
+    return true;
+}
+
+static bool session_undo(struct HostWorker *worker, struct HostSession *s) {
+    if (s->states[s->current] == STATE_NONE || s->undo_avail == 0)
+        return false;
+    pool_release(worker, s->states[s->current]);
+    s->states[s->current] = STATE_NONE;
+    s->current = (s->current + HOST_MAX_UNDO - 1) % HOST_MAX_UNDO;
+    --s->undo_avail;
+    --s->move_count;
+    return true;
+}
+
+static void handle_command(
+    struct HostWorker *worker, const struct HostQueued *queued) {
+    struct Host *host = worker->host;
+    const struct HostCommand *command = &queued->command;
+    struct HostSession *s = host_session(host, command->session);
+    if (command->op == HOST_OPEN)
+        s->serving = queued->generation;
+    else if (queued->generation != s->serving)
+        return;
+    struct HostResult result = {
+        .session = command->session,
+        .op = command->op,
+        .tag = command->tag,
+    };
+
+    switch (command->op) {
+    case HOST_OPEN:
+        result.ok = session_start(worker, s);
+        break;
+    case HOST_MOVE:
+        result.ok = session_move(worker, s, command->pos, command->dir);
+        break;
+    case HOST_UNDO:
+        result.ok = session_undo(worker, s);
+        break;
+    case HOST_CLOSE:
+        session_release(worker, s);
+        s->serving = 0;
+        result.ok = true;
+        break;
+    }
+    COUNTER_ADD(worker->commands, 1);
+
+    if (s->states[s->current] != STATE_NONE) {
+        const struct GameState *state =
+            pool_state(worker, s->states[s->current]);
+        result.move_count = s->move_count;
+        result.undo_avail = s->undo_avail;
+        result.solved = game_is_solved(state);
+        result.state = state;
+        if (host->options.encode_states) {
+            b64_encode(worker->encoded, state, game_get_size(state));
+            result.state_b64 = worker->encoded;
+        }
+    }
+    if (host->options.on_result != NULL)
+        host->options.on_result(&result, host->options.result_data);
+
+    if (command->op == HOST_CLOSE) {
+        host_lock(host);
+        s->next_free = host->free_session;
+        host->free_session = command->session;
+        --host->open_count;
+        host_unlock(host);
+    }
+}
+
+// with the worker lock held
+static int take_batch(struct HostWorker *worker) {
+    int count = worker->count < HOST_BATCH ? worker->count : HOST_BATCH;
+    for (int i = 0; i < count; ++i)
+        worker->batch[i] = worker->queue[(worker->head + i) % HOST_QUEUE_SIZE];
+    worker->head = (worker->head + count) % HOST_QUEUE_SIZE;
+    worker->count -= count;
+    COUNTER_ADD(worker->batches, 1);
+    return count;
+}
+
+#ifdef JNB_THREADING
+static int worker_main(void *arg) {
+    struct HostWorker *worker = arg;
+    for (;;) {
+        mtx_lock(&worker->lock);
+        worker->busy = false;
+        cnd_broadcast(&worker->space);
+        while (worker->count == 0 && !worker->stopping)
+            cnd_wait(&worker->ready, &worker->lock);
+        if (worker->count == 0) {
+            mtx_unlock(&worker->lock);
+            return 0;
+        }
+        int count = take_batch(worker);
+        worker->busy = true;
+        cnd_broadcast(&worker->space);
+        mtx_unlock(&worker->lock);
+
+        for (int i = 0; i < count; ++i)
+            handle_command(worker, &worker->batch[i]);
+    }
+}
+#else
+// handles the commands of a worker on the calling thread
+static void drain_worker(struct HostWorker *worker) {
+    while (worker->count > 0) {
+        int count = take_batch(worker);
+        for (int i = 0; i < count; ++i)
+            handle_command(worker, &worker->batch[i]);
+    }
+}
+#endif
+
+static void enqueue(
+    struct Host *host, const struct HostCommand *command, uint32_t generation) {
+    struct HostWorker *worker = session_worker(host, command->session);
+#ifdef JNB_THREADING
+    mtx_lock(&worker->lock);
+    while (worker->count == HOST_QUEUE_SIZE)
+        cnd_wait(&worker->space, &worker->lock);
+#else
+    if (worker->count == HOST_QUEUE_SIZE)
+        drain_worker(worker);
+#endif
+    worker->queue[(worker->head + worker->count) % HOST_QUEUE_SIZE] =
+        (struct HostQueued){.command = *command, .generation = generation};
+    ++worker->count;
+#ifdef JNB_THREADING
+    // the worker only waits for an empty queue
+    if (worker->count == 1)
+        cnd_signal(&worker->ready);
+    mtx_unlock(&worker->lock);
+#endif
+}
+
+struct Host *host_new(
+    const struct PackLevel *levels,
+    int level_count,
+    const struct HostOptions *options) {
+    struct Host *host = calloc(1, sizeof(struct Host));
+    if (host == NULL)
+        return NULL;
+    host->options = *options;
+    host->level_count = level_count;
+    host->free_session = -1;
+#ifdef JNB_THREADING
+    if (host->options.threads < 1)
+        host->options.threads = 1;
+    if (host->options.threads > HOST_MAX_THREADS)
+        host->options.threads = HOST_MAX_THREADS;
+#else
+    host->options.threads = 1;
+#endif
+    if (host->options.max_sessions <= 0)
+        host->options.max_sessions = HOST_DEFAULT_MAX_SESSIONS;
+    host->slab_count = (host->options.max_sessions + HOST_SLAB_SESSIONS - 1) /
+                       HOST_SLAB_SESSIONS;
+
+    host->roots = calloc(level_count + 1, sizeof(struct GameState *));
+    host->slabs = calloc(host->slab_count, sizeof(struct HostSession *));
+    host->workers = calloc(host->options.threads, sizeof(struct HostWorker));
+    if (host->roots == NULL || host->slabs == NULL || host->workers == NULL)
+        goto fail;
+    for (int i = 0; i < level_count; ++i) {
+        struct GameState tmp = {0};
+        memcpy(tmp.board, levels[i].board, sizeof(tmp.board));
+        if (!game_preprocess_alloc(&tmp, &host->roots[i]))
+            goto fail;
+    }
+
+    for (int i = 0; i < host->options.threads; ++i) {
+        struct HostWorker *worker = &host->workers[i];
+        worker->host = host;
+        worker->free_state = STATE_NONE;
+        worker->encoded = malloc(b64_encoded_size(GAME_STATE_MAX_SIZE) + 1);
+        if (worker->encoded == NULL)
+            goto fail;
+    }
+
+#ifdef JNB_THREADING
+    if (mtx_init(&host->lock, mtx_plain) != thrd_success)
+        goto fail;
+    host->locked = true;
+    for (; host->started < host->options.threads; ++host->started) {
+        struct HostWorker *worker = &host->workers[host->started];
+        if (mtx_init(&worker->lock, mtx_plain) != thrd_success)
+            goto fail;
+        if (cnd_init(&worker->ready) != thrd_success) {
+            mtx_destroy(&worker->lock);
+            goto fail;
+        }
+        if (cnd_init(&worker->space) != thrd_success) {
+            cnd_destroy(&worker->ready);
+            mtx_destroy(&worker->lock);
+            goto fail;
+        }
+        worker->busy = true;
+        if (thrd_create(&worker->thread, worker_main, worker) !=
+            thrd_success) {
+            cnd_destroy(&worker->space);
+            cnd_destroy(&worker->ready);
+            mtx_destroy(&worker->lock);
+            goto fail;
+        }
+    }
+#endif
+    return host;
+
+fail:
+    host_free(&host);
+    return NULL;
+}
+
+void host_free(struct Host **host) {
+    if (*host == NULL)
+        return;
+    struct Host *h = *host;
+
+#ifdef JNB_THREADING
+    // the queues are drained before the workers stop
+    for (int i = 0; i < h->started; ++i) {
+        struct HostWorker *worker = &h->workers[i];
+        mtx_lock(&worker->lock);
+        worker->stopping = true;
+        cnd_signal(&worker->ready);
+        mtx_unlock(&worker->lock);
+        thrd_join(worker->thread, NULL);
+        cnd_destroy(&worker->space);
+        cnd_destroy(&worker->ready);
+        mtx_destroy(&worker->lock);
+    }
+    if (h->locked)
+        mtx_destroy(&h->lock);
+#else
+    if (h->workers != NULL)
+        drain_worker(&h->workers[0]);
+#endif
+
+    for (int i = 0; h->workers != NULL && i < h->options.threads; ++i) {
+        struct HostWorker *worker = &h->workers[i];
+        for (int k = 0; k < worker->slab_count; ++k)
+            free(worker->slabs[k]);
+        free(worker->slabs);
+        free(worker->encoded);
+    }
+    free(h->workers);
+    for (int i = 0; h->slabs != NULL && i < h->slab_count; ++i)
+        free(h->slabs[i]);
+    free(h->slabs);
+    // every state of a level shares the template of its root
+    for (int i = 0; h->roots != NULL && i < h->level_count; ++i)
+        game_free(&h->roots[i]);
+    free(h->roots);
+    free(h);
+    *host = NULL;
+}
+
+int host_open(struct Host *host, int level) {
+    if (level < 0 || level >= host->level_count)
+        return -1;
+
+    host_lock(host);
+    int session = host->free_session;
+    if (session >= 0) {
+        host->free_session = host_session(host, session)->next_free;
+    } else if (host->session_count < host->options.max_sessions) {
+        session = host->session_count;
+        struct HostSession **slab = &host->slabs[session / HOST_SLAB_SESSIONS];
+        if (*slab == NULL)
+            *slab = calloc(HOST_SLAB_SESSIONS, sizeof(struct HostSession));
+        if (*slab != NULL)
+            ++host->session_count;
+        else
+            session = -1;
+    }
+    uint32_t generation = 0;
+    if (session >= 0) {
+        struct HostSession *s = host_session(host, session);
+        s->open = true;
+        // 0 is left for closed sessions
+        if (++s->generation == 0)
+            s->generation = 1;
+        generation = s->generation;
+        // nothing else touches the session until its worker opens it
+        s->level = level;
+        ++host->open_count;
+    }
+    host_unlock(host);
+
+    if (session >= 0)
+        enqueue(
+            host, &(struct HostCommand){.session = session, .op = HOST_OPEN},
+            generation);
+    return session;
+}
+
+bool host_close(struct Host *host, int session) {
+    if (session < 0 || session >= host->options.max_sessions)
+        return false;
+    host_lock(host);
+    bool open = session < host->session_count &&
+                host_session(host, session)->open;
+    uint32_t generation = 0;
+    // commands submitted from now on fail
+    if (open) {
+        host_session(host, session)->open = false;
+        generation = host_session(host, session)->generation;
+    }
+    host_unlock(host);
+    if (open) {
+        enqueue(
+            host, &(struct HostCommand){.session = session, .op = HOST_CLOSE},
+            generation);
+    }
+    return open;
+}
+
+bool host_submit(struct Host *host, const struct HostCommand *command) {
+    if (command->session < 0 ||
+        command->session >= host->options.max_sessions ||
+        (command->op != HOST_MOVE && command->op != HOST_UNDO))
+        return false;
+    // the command is only queued after the lock is released, by which time
+    // the session may have been closed and its number handed out again; the
+    // generation keeps it from being handled for the new session
+    host_lock(host);
+    bool open = command->session < host->session_count &&
+                host_session(host, command->session)->open;
+    uint32_t generation =
+        open ? host_session(host, command->session)->generation : 0;
+    host_unlock(host);
+    if (open)
+        enqueue(host, command, generation);
+    return open;
+}
+
+void host_wait(struct Host *host) {
+    for (int i = 0; i < host->options.threads; ++i) {
+        struct HostWorker *worker = &host->workers[i];
+#ifdef JNB_THREADING
+        mtx_lock(&worker->lock);
+        while (worker->count > 0 || worker->busy)
+            cnd_wait(&worker->space, &worker->lock);
+        mtx_unlock(&worker->lock);
+#else
+        drain_worker(worker);
+#endif
+    }
+}
+
+void host_get_stats(struct Host *host, struct HostStats *dest) {
+    *dest = (struct HostStats){0};
+    host_lock(host);
+    dest->sessions = host->open_count;
+    host_unlock(host);
+    for (int i = 0; i < host->options.threads; ++i) {
+        struct HostWorker *worker = &host->workers[i];
+        dest->states_allocated += COUNTER_LOAD(worker->states_allocated);
+        dest->states_in_use += COUNTER_LOAD(worker->states_in_use);
+        dest->commands += COUNTER_LOAD(worker->commands);
+        dest->batches += COUNTER_LOAD(worker->batches);
+    }
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "game.h"
+#include "util.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// states a session keeps, the current one included, so that it can undo one
+// move less than this
+#define HOST_MAX_UNDO 10
+
+enum _HostOp { HOST_OPEN = 0, HOST_MOVE, HOST_UNDO, HOST_CLOSE };
+typedef int8_t HostOp;
+
+/// @brief A move or an undo for a session, see `host_submit`.
+struct HostCommand {
+    int session;
+    /// @brief `HOST_MOVE` or `HOST_UNDO`.
+    HostOp op;
+    /// @brief A cell of the block to move and the direction, for `HOST_MOVE`.
+    struct BoardPos pos;
+    MoveBlockDir dir;
+    /// @brief Passed back with the result, for matching them up.
+    uint64_t tag;
+};
+
+/// @brief What a command did. Only valid for the duration of the callback.
+struct HostResult {
+    int session;
+    HostOp op;
+    /// @brief 0 for opening and closing a session.
+    uint64_t tag;
+    /// @brief Whether the session could be opened, or the move or the undo
+    /// could be made; a failed command leaves the session as it was.
+    bool ok;
+    /// @brief Moves from the start, undone ones not counted.
+    int move_count;
+    int undo_avail;
+    bool solved;
+    /// @brief The current state, `NULL` once closed or if opening failed.
+    const struct GameState *state;
+    /// @brief The current state in base64, like `GAME_get_current_state_b64`
+    /// has it, if `encode_states` is set; `NULL` otherwise.
+    const char *state_b64;
+};
+
+typedef void (*HostResultFn)(const struct HostResult *result, void *data);
+
+/// @brief Settings of `host_new`.
+struct HostOptions {
+    /// @brief Worker threads; without `JNB_THREADING`, the commands are handled
+    /// by the thread that submits them.
+    int threads;
+    /// @brief Most sessions open at once; 0 picks the default.
+    int max_sessions;
+    /// @brief Called by the worker of the session for every command once it
+    /// was handled, opening and closing included; may be `NULL`.
+    HostResultFn on_result;
+    void *result_data;
+    /// @brief Fill in `state_b64` of the results.
+    bool encode_states;
+};
+
+/// @brief Counters of a host, see `host_get_stats`.
+struct HostStats {
+    int sessions;
+    /// @brief State buffers allocated by the pools, and how many of them hold
+    /// a state of a session; the rest wait to be reused.
+    uint64_t states_allocated;
+    uint64_t states_in_use;
+    uint64_t commands;
+    /// @brief Times a worker took commands off its queue.
+    uint64_t batches;
+};
+
+/// @brief Many games played at once, like the ones of the web build, for
+/// hosting them natively. Sessions and their states come from pools that only
+/// grow, so a host that has warmed up doesn't allocate anymore, and a session
+/// only holds the states it can undo to rather than all of them. Every session
+/// belongs to one of the workers, which takes the commands off its queue in
+/// batches, so the commands of a session are handled in order and sessions
+/// need no locking.
+struct Host;
+
+/// @brief Start a host for the levels of a pack, along with its workers.
+/// @param levels Copied, so they can be discarded
+/// @param level_count
+/// @param options
+/// @return `NULL` if memory allocation or starting the workers failed
+struct Host *host_new(
+    const struct PackLevel *levels,
+    int level_count,
+    const struct HostOptions *options);
+
+/// @brief Handle every submitted command, stop the workers and free and
+/// invalidate a host. Sessions still open are closed without a result.
+/// @param host
+void host_free(struct Host **host);
+
+/// @brief Open a session at the start of a level. The session can be used
+/// right away; its result says whether opening succeeded.
+/// @param host
+/// @param level Index of the level in the pack
+/// @return The session, or -1 if the level doesn't exist or `max_sessions`
+/// are open
+int host_open(struct Host *host, int level);
+
+/// @brief Close a session once the commands submitted for it are handled. Its
+/// number can be handed out again right after the result of closing it.
+/// @param host
+/// @param session
+/// @return `false` if the session isn't open
+bool host_close(struct Host *host, int session);
+
+/// @brief Queue a command for the worker of its session, waiting for room if
+/// its queue is full.
+/// @param host
+/// @param command Copied
+/// @return `false` if the command isn't a move or an undo of an open session;
+/// a session that failed to open fails its commands instead, and a command
+/// that races with closing its session is dropped without a result
+bool host_submit(struct Host *host, const struct HostCommand *command);
+
+/// @brief Wait until every command submitted so far was handled.
+/// @param host
+void host_wait(struct Host *host);
+
+/// @brief Get the counters of a host; they are only exact after `host_wait`.
+/// @param host
+/// @param dest
+void host_get_stats(struct Host *host, struct HostStats *dest);
@@ -1,9 +1,25 @@
+#if defined(__unix__) || defined(__APPLE__)
+    // for SIGUSR1
+    #define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <inttypes.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
+#include "cache.h"
+#include "census.h"
 #include "game.h"
+#include "generator.h"
+#include "host.h"
+#include "server.h"
+#include "solver.h"
 #include "util.h"
+#include "verifier.h"
 
 struct GameState *make_simple_game(void) {
     struct GameState tmp;
@@ -57,9 +73,631 @@ struct GameState *make_simple_game(void) {
     return dest;
 }
 
-int main(void) {
-    // TODO: first, test the current collision implementation thoroughly
+static void usage(const char *name) {
+    printf(
+        "usage: %s [--bfs | --astar | --ida | --external DIR]\n"
+        "       [--max-nodes N] [--memory BYTES] [--no-pruning] [--symmetry]\n"
+        "       [--macro-moves] [--cache FILE] [--stats-interval SECONDS]\n"
+        "       [--huge-pages] [--numa] [level file...]\n"
+        "       %s --census [--max-nodes N] [--threads T] [--samples N]\n"
+        "       [--walk-length N] [--seed S] [--huge-pages] [--numa]\n"
+        "       [level file...]\n"
+        "       %s --generate N [--seed S] [--threads T] [--max-nodes N]\n"
+        "       [--min-moves N] [--max-moves N] [--out FILE]\n"
+        "       %s --verify SUBMISSIONS [--threads T] level file...\n"
+        "       %s --serve [--socket PATH] [--threads T] [--max-nodes N]\n"
+        "       [--bfs | --astar | --ida] [--huge-pages] [--numa] level "
+        "file...\n"
+        "       %s --host-bench SESSIONS [--seed S] [--threads T] level "
+        "file...\n",
+        name, name, name, name, name, name);
+}
+
+static const char *status_string(SolverStatus status) {
+    switch (status) {
+    case SOLVER_RUNNING:
+        return "running";
+    case SOLVER_SOLVED:
+        return "solved";
+    case SOLVER_UNSOLVABLE:
+        return "unsolvable";
+    case SOLVER_LIMIT:
+        return "node limit reached";
+    }
+    return "unknown";
+}
+
+static const char *mode_string(SolverMode mode) {
+    switch (mode) {
+    case SOLVER_MODE_BFS:
+        return "BFS";
+    case SOLVER_MODE_ASTAR:
+        return "A*";
+    case SOLVER_MODE_IDA:
+        return "IDA*";
+    case SOLVER_MODE_EXTERNAL:
+        return "external";
+    }
+    return "unknown";
+}
+
+static void print_solution(const struct SolverMove *moves, int length) {
+    for (int i = 0; i < length; ++i) {
+        printf(
+            "%d: (%d, %d) %s\n", i + 1, moves[i].pos.x, moves[i].pos.y,
+            moves[i].dir == MOVE_BLOCK_LEFT ? "left" : "right");
+    }
+
+    size_t size = solver_solution_to_string(moves, length, NULL, 0) + 1;
+    char *text = malloc(size);
+    if (text == NULL)
+        return;
+    solver_solution_to_string(moves, length, text, size);
+    printf("solution %s\n", text);
+    free(text);
+}
+
+static void print_stats(const struct SolverStats *stats, double seconds) {
+    printf(
+        "expanded %" PRIu64 ", generated %" PRIu64 ", duplicates %" PRIu64
+        "\n",
+        stats->expanded, stats->generated, stats->duplicates);
+    printf(
+        "pruned %" PRIu64 " (%.1f%% of generated)\n", stats->pruned,
+        stats->generated > 0 ? 100.0 * stats->pruned / stats->generated : 0);
+    printf(
+        "depth %d, h(root) %d, h quality %.3f\n", stats->depth, stats->h_root,
+        stats->h_quality);
+    printf(
+        "%.3f s, %.0f nodes/s\n", seconds,
+        seconds > 0 ? stats->expanded / seconds : 0);
+}
+
+// only when huge pages or NUMA binding were asked for, since they can fall
+// back
+static void
+    print_memory(const struct BigMemOptions *options, BigMemMode modes) {
+    if (!options->huge_pages && !options->numa_local)
+        return;
+    char str[64];
+    bigmem_modes_string(modes, str, sizeof(str));
+    printf("memory %s\n", str);
+}
+
+// progress of a running search, on stderr so that it doesn't get mixed with
+// the results
+static void print_snapshot(const struct SolverSnapshot *snapshot, void *data) {
+    (void)data;
+    fprintf(
+        stderr,
+        "[%.1f s] depth %d, expanded %" PRIu64 " (%.0f nodes/s), generated "
+        "%" PRIu64 ", duplicates %.1f%%, pruned %" PRIu64 "\n",
+        snapshot->seconds, snapshot->depth, snapshot->expanded,
+        snapshot->nodes_per_second, snapshot->generated,
+        100 * snapshot->duplicate_rate, snapshot->pruned);
+    fprintf(
+        stderr,
+        "  open %" PRIu64 ", memory %.1f MiB, table %" PRIu64 " of %" PRIu64
+        "\n",
+        snapshot->open, snapshot->memory / 1048576.0, snapshot->table_entries,
+        snapshot->table_capacity);
+
+    int layers = SOLVER_TELEMETRY_LAYERS;
+    while (layers > 0 && snapshot->layers[layers - 1] == 0)
+        --layers;
+    if (layers == 0)
+        return;
+    fprintf(stderr, "  layers");
+    for (int i = 0; i < layers; ++i)
+        fprintf(stderr, " %" PRIu64, snapshot->layers[i]);
+    fprintf(stderr, "\n");
+}
+
+#ifdef SIGUSR1
+static void request_snapshot(int sig) {
+    (void)sig;
+    solver_request_snapshot();
+}
+#endif
+
+// a cached solution is replayed before it is trusted
+static bool print_cached(
+    const struct GameState *game, const struct SolutionCacheEntry *entry) {
+    struct SolverMove *moves =
+        malloc((entry->solution_length + 1) * sizeof(struct SolverMove));
+    if (moves == NULL)
+        return false;
+    int length = solver_solution_from_string(
+        game, entry->solution, moves, entry->solution_length);
+    if (length != entry->solution_length) {
+        free(moves);
+        return false;
+    }
+    if (entry->status == SOLVER_SOLVED) {
+        _Alignas(struct GameState) uint8_t bufs[2][GAME_STATE_MAX_SIZE];
+        struct GameState *state = (struct GameState *)bufs[0];
+        struct GameState *next = (struct GameState *)bufs[1];
+        memcpy(state, game, game_get_size(game));
+        for (int i = 0; i < length; ++i) {
+            game_do_move(state, moves[i].block, moves[i].dir, next);
+            struct GameState *tmp = state;
+            state = next;
+            next = tmp;
+        }
+        if (!game_is_solved(state)) {
+            free(moves);
+            return false;
+        }
+    }
+
+    printf(
+        "%s (cached, %s)\n", status_string(entry->status),
+        mode_string(entry->mode));
+    if (entry->status == SOLVER_SOLVED)
+        print_solution(moves, length);
+    free(moves);
+    printf(
+        "expanded %" PRIu64 ", generated %" PRIu64 ", duplicates %" PRIu64
+        "\n",
+        entry->stats.expanded, entry->stats.generated,
+        entry->stats.duplicates);
+    printf(
+        "depth %d, h(root) %d\n", entry->stats.depth, entry->stats.h_root);
+    return true;
+}
+
+static double wall_seconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// a line of `name value:count` pairs for the non-zero counts
+static void
+    print_histogram(const char *name, const uint64_t *counts, int size) {
+    printf("%s", name);
+    for (int i = 0; i < size; ++i) {
+        if (counts[i] > 0)
+            printf(
+                " %d%s:%" PRIu64, i, i == size - 1 ? "+" : "", counts[i]);
+    }
+    printf("\n");
+}
+
+static double percent(uint64_t part, uint64_t whole) {
+    return whole > 0 ? 100.0 * part / whole : 0;
+}
+
+// returns the exit code for the level: 0 if the census got through every
+// state, 2 if it had to stop, 1 on errors
+static int run_census(
+    struct GameState *game, const struct CensusOptions *options) {
+    print_game(game);
+
+    struct CensusReport report;
+    double start = wall_seconds();
+    if (!census_run(game, options, &report)) {
+        fprintf(stderr, "the census failed\n");
+        census_report_free(&report);
+        return 1;
+    }
+    double seconds = wall_seconds() - start;
+
+    printf(
+        "states %" PRIu64 " (%s), expanded %" PRIu64 ", moves %" PRIu64
+        ", branching %.2f\n",
+        report.states, report.complete ? "complete" : "stopped",
+        report.expanded, report.moves,
+        report.expanded > 0 ? (double)report.moves / report.expanded : 0);
+    printf("solved %" PRIu64, report.solved);
+    if (report.optimal >= 0) {
+        printf(", optimal %d moves, ", report.optimal);
+        if (report.solutions == UINT64_MAX)
+            printf("more than %" PRIu64 " solutions\n", UINT64_MAX - 1);
+        else
+            printf("%" PRIu64 " solutions\n", report.solutions);
+    } else {
+        printf(", no solution reached\n");
+    }
+    if (report.complete)
+        printf(
+            "dead %" PRIu64 " (%.1f%%), ", report.dead,
+            percent(report.dead, report.states));
+    printf(
+        "flagged by game_is_dead %" PRIu64 " (%.1f%% of expanded)\n",
+        report.flagged, percent(report.flagged, report.expanded));
+    printf("layers");
+    for (int i = 0; i < report.layer_count; ++i)
+        printf(" %" PRIu64, report.layers[i]);
+    printf("\n");
+    print_histogram("branching", report.branching, CENSUS_BRANCHING);
+
+    if (report.samples > 0) {
+        printf(
+            "samples %d walks of up to %d moves: alive %" PRIu64
+            " (%.1f%%, %.1f moves to solve), dead %" PRIu64
+            " (%.1f%%), unknown %" PRIu64 "\n",
+            report.samples, report.walk_length, report.sample_alive,
+            percent(report.sample_alive, report.samples),
+            report.sample_distance, report.sample_dead,
+            percent(report.sample_dead, report.samples),
+            report.sample_unknown);
+        print_histogram(
+            "sampled branching", report.sample_branching, CENSUS_BRANCHING);
+    }
+    print_memory(&options->memory, report.memory_modes);
+    printf("%.3f s\n", seconds);
+
+    int res = report.complete ? 0 : 2;
+    census_report_free(&report);
+    return res;
+}
+
+// returns the exit code for the level: 0 if solved, 2 if not, 1 on errors
+static int run_level(
+    struct GameState *game,
+    const struct SolverOptions *options,
+    struct SolutionCache *cache) {
+    print_game(game);
+
+    uint64_t level_hash = 0;
+    struct SolutionCacheEntry entry;
+    if (cache != NULL) {
+        level_hash = solution_cache_level_hash(game);
+        if (solution_cache_find(cache, level_hash, options, &entry) &&
+            print_cached(game, &entry))
+            return entry.status == SOLVER_SOLVED ? 0 : 2;
+    }
+
+    struct Solver *solver = solver_new(game, options);
+    if (solver == NULL) {
+        fprintf(stderr, "failed to allocate the solver\n");
+        return 1;
+    }
+
+    clock_t start = clock();
+    SolverStatus status = solver_step(solver, SIZE_MAX);
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("%s\n", status_string(status));
+    int length;
+    const struct SolverMove *moves = solver_get_solution(solver, &length);
+    if (moves != NULL)
+        print_solution(moves, length);
+    print_stats(solver_get_stats(solver), seconds);
+    print_memory(&options->memory, solver_get_stats(solver)->memory_modes);
+
+    if (cache != NULL &&
+        !solution_cache_add(cache, level_hash, options, solver))
+        fprintf(stderr, "failed to write to the cache\n");
+
+    solver_free(&solver);
+    return status == SOLVER_SOLVED ? 0 : 2;
+}
+
+// writes the pack of generated levels to `path`, or stdout if it's NULL
+static int run_generator(
+    const struct GeneratorOptions *options, const char *path) {
+    struct GeneratorOptions opts = *options;
+    generator_default_options(&opts);
+    struct GeneratedLevel *levels =
+        malloc(opts.count * sizeof(struct GeneratedLevel));
+    if (levels == NULL)
+        return 1;
+
+    struct GeneratorStats stats;
+    clock_t start = clock();
+    int count = generate_levels(&opts, levels, &stats);
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    if (count < 0) {
+        fprintf(stderr, "failed to start the generator\n");
+        free(levels);
+        return 1;
+    }
+    fprintf(
+        stderr,
+        "candidates %" PRIu64 ", rejected %" PRIu64 " cheaply and %" PRIu64
+        " by search, accepted %" PRIu64 "\n",
+        stats.candidates, stats.rejected_cheap, stats.rejected_search,
+        stats.accepted);
+    fprintf(
+        stderr, "%.3f s of CPU time, %.0f candidates/s\n", seconds,
+        seconds > 0 ? stats.candidates / seconds : 0);
+
+    FILE *file = path != NULL ? fopen(path, "w") : stdout;
+    if (file == NULL) {
+        fprintf(stderr, "failed to open %s\n", path);
+        free(levels);
+        return 1;
+    }
+    int res = count < opts.count ? 2 : 0;
+    for (int i = 0; i < count; ++i) {
+        char name[LEVEL_NAME_SIZE];
+        snprintf(
+            name, sizeof(name), "gen-%" PRIu64 "-%" PRIu64, opts.seed,
+            levels[i].index);
+        fprintf(
+            file, "; moves %d, branching %.2f, score %.2f\n", levels[i].moves,
+            levels[i].branching, levels[i].score);
+        if (!write_level(file, name, levels[i].board)) {
+            fprintf(stderr, "failed to write %s\n", name);
+            res = 1;
+            break;
+        }
+        fprintf(file, "\n");
+    }
+    if (file != stdout)
+        fclose(file);
+    free(levels);
+    return res;
+}
+
+// the levels of every pack, in order; -1 if one of them can't be loaded
+static int
+    load_packs(const char **paths, int path_count, struct PackLevel **dest) {
+    *dest = NULL;
+    int level_count = 0;
+    for (int i = 0; i < path_count; ++i) {
+        struct PackLevel *pack;
+        int count = load_level_pack(paths[i], &pack);
+        struct PackLevel *grown =
+            count < 0 ? NULL
+                      : realloc(
+                            *dest,
+                            (level_count + count + 1) *
+                                sizeof(struct PackLevel));
+        if (grown == NULL) {
+            fprintf(stderr, "failed to load %s\n", paths[i]);
+            free(pack);
+            free(*dest);
+            *dest = NULL;
+            return -1;
+        }
+        *dest = grown;
+        memcpy(*dest + level_count, pack, count * sizeof(struct PackLevel));
+        level_count += count;
+        free(pack);
+    }
+    return level_count;
+}
+
+// prints a `<line> <result> <moves>` line for every submission, in order;
+// returns 0 if all of them solve their level, 2 if not, 1 on errors
+static int run_verifier(
+    const char *submissions_path,
+    const char **paths,
+    int path_count,
+    int threads) {
+    struct PackLevel *levels;
+    int level_count = load_packs(paths, path_count, &levels);
+    if (level_count < 0)
+        return 1;
+
+    int res = 1;
+    char *text = NULL;
+    struct VerifySubmission *submissions = NULL;
+    struct VerifyReport *reports = NULL;
+    struct LevelIndex index = {0};
+    struct GameState **roots = calloc(level_count + 1, sizeof(void *));
+    if (roots == NULL)
+        goto done;
+    for (int i = 0; i < level_count; ++i) {
+        struct GameState tmp = {0};
+        memcpy(tmp.board, levels[i].board, sizeof(tmp.board));
+        if (!game_preprocess_alloc(&tmp, &roots[i])) {
+            fprintf(stderr, "failed to preprocess %s\n", levels[i].name);
+            goto done;
+        }
+    }
+
+    text = read_file(submissions_path);
+    if (text == NULL) {
+        fprintf(stderr, "failed to read %s\n", submissions_path);
+        goto done;
+    }
+    if (!level_index_init(&index, levels, level_count))
+        goto done;
+    int count = verify_parse_submissions(text, &index, &submissions);
+    if (count < 0 ||
+        (reports = malloc((count + 1) * sizeof(struct VerifyReport))) ==
+            NULL)
+        goto done;
+
+    double start = wall_seconds();
+    if (!verify_submissions(roots, submissions, count, reports, threads)) {
+        fprintf(stderr, "failed to start the verifier\n");
+        goto done;
+    }
+    double seconds = wall_seconds() - start;
+
+    int solved = 0;
+    for (int i = 0; i < count; ++i) {
+        printf(
+            "%d %s %d\n", submissions[i].line,
+            verify_result_string(reports[i].result), reports[i].moves);
+        solved += reports[i].result == VERIFY_SOLVED;
+    }
+    fprintf(
+        stderr, "%d of %d submissions solved, %.3f s, %.0f submissions/s\n",
+        solved, count, seconds, seconds > 0 ? count / seconds : 0);
+    res = solved == count ? 0 : 2;
+
+done:
+    for (int i = 0; roots != NULL && i < level_count; ++i)
+        game_free(&roots[i]);
+    free(roots);
+    free(reports);
+    free(submissions);
+    level_index_free(&index);
+    free(text);
+    free(levels);
+    return res;
+}
+
+// rounds of one command per session the host benchmark plays
+#define HOST_BENCH_ROUNDS 50
+
+// chance of an undo rather than a move in the host benchmark
+#define HOST_BENCH_UNDO_PERCENT 10
+
+// splitmix64, like the generator's
+static uint64_t bench_rng_next(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+// the next command of every session, picked by its worker from the result of
+// the last one, like a player looking at the board would
+struct HostBench {
+    struct HostCommand *next;
+    uint64_t *rng;
+    // commands that failed, per session so that workers don't share them
+    int *failed;
+};
+
+static void bench_on_result(const struct HostResult *result, void *data) {
+    struct HostBench *bench = data;
+    if (result->op != HOST_OPEN && !result->ok)
+        ++bench->failed[result->session];
+    if (result->state == NULL)
+        return;
+    struct HostCommand *next = &bench->next[result->session];
+    uint64_t *rng = &bench->rng[result->session];
+    next->session = result->session;
+    next->tag = result->tag + 1;
+    if (result->undo_avail > 0 &&
+        (result->solved ||
+         (int)(bench_rng_next(rng) % 100) < HOST_BENCH_UNDO_PERCENT)) {
+        next->op = HOST_UNDO;
+        return;
+    }
+
+    // a random piece, moved either way, which may well be illegal
+    next->op = HOST_MOVE;
+    next->dir = bench_rng_next(rng) % 2 ? MOVE_BLOCK_RIGHT : MOVE_BLOCK_LEFT;
+    int seen = 0;
+    for (board_coord_t y = 0; y < BOARD_HEIGHT; ++y) {
+        for (board_coord_t x = 0; x < BOARD_WIDTH; ++x) {
+            if (result->state->board[y][x].type == CELL_PIECE &&
+                bench_rng_next(rng) % ++seen == 0)
+                next->pos = MAKE_BOARD_POS(x, y);
+        }
+    }
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// opens a number of sessions spread over the levels and plays rounds of random
+// moves and undos on all of them, reporting the latency of a round and the
+// commands handled per second
+static int run_host_bench(
+    int sessions,
+    uint64_t seed,
+    const char **paths,
+    int path_count,
+    int threads) {
+    struct PackLevel *levels;
+    int level_count = load_packs(paths, path_count, &levels);
+    if (level_count < 0)
+        return 1;
+    if (level_count == 0 || sessions <= 0) {
+        fprintf(stderr, "nothing to play\n");
+        free(levels);
+        return 1;
+    }
+
+    int res = 1;
+    struct Host *host = NULL;
+    struct HostBench bench = {
+        .next = calloc(sessions, sizeof(struct HostCommand)),
+        .rng = malloc(sessions * sizeof(uint64_t)),
+        .failed = calloc(sessions, sizeof(int)),
+    };
+    double rounds[HOST_BENCH_ROUNDS];
+    if (bench.next == NULL || bench.rng == NULL || bench.failed == NULL)
+        goto done;
+    for (int i = 0; i < sessions; ++i) {
+        bench.rng[i] = seed ^ (uint64_t)i;
+        bench.rng[i] = bench_rng_next(&bench.rng[i]);
+    }
+
+    struct HostOptions host_options = {
+        .threads = threads,
+        .max_sessions = sessions,
+        .on_result = bench_on_result,
+        .result_data = &bench,
+        .encode_states = true,
+    };
+    host = host_new(levels, level_count, &host_options);
+    if (host == NULL) {
+        fprintf(stderr, "failed to start the host\n");
+        goto done;
+    }
+    double start = wall_seconds();
+    for (int i = 0; i < sessions; ++i) {
+        if (host_open(host, i % level_count) != i) {
+            fprintf(stderr, "failed to open session %d\n", i);
+            goto done;
+        }
+    }
+    host_wait(host);
+    double open_seconds = wall_seconds() - start;
 
+    start = wall_seconds();
+    for (int round = 0; round < HOST_BENCH_ROUNDS; ++round) {
+        double round_start = wall_seconds();
+        for (int i = 0; i < sessions; ++i)
+            host_submit(host, &bench.next[i]);
+        host_wait(host);
+        rounds[round] = wall_seconds() - round_start;
+    }
+    double seconds = wall_seconds() - start;
+
+    struct HostStats stats;
+    host_get_stats(host, &stats);
+    qsort(rounds, HOST_BENCH_ROUNDS, sizeof(double), compare_doubles);
+    int64_t commands = (int64_t)sessions * HOST_BENCH_ROUNDS;
+    int64_t failed = 0;
+    for (int i = 0; i < sessions; ++i)
+        failed += bench.failed[i];
+    fprintf(
+        stderr,
+        "%d sessions opened in %.3f s\n"
+        "%" PRId64 " commands in %.3f s, %.0f commands/s, %" PRId64
+        " failed\n"
+        "round latency: min %.3f ms, median %.3f ms, max %.3f ms\n"
+        "states: %" PRIu64 " allocated, %" PRIu64 " in use, %.0f bytes each\n"
+        "%" PRIu64 " batches of %.1f commands\n",
+        stats.sessions, open_seconds, commands, seconds,
+        seconds > 0 ? commands / seconds : 0, failed, rounds[0] * 1e3,
+        rounds[HOST_BENCH_ROUNDS / 2] * 1e3,
+        rounds[HOST_BENCH_ROUNDS - 1] * 1e3, stats.states_allocated,
+        stats.states_in_use, (double)GAME_STATE_MAX_SIZE, stats.batches,
+        stats.batches > 0 ? (double)stats.commands / stats.batches : 0);
+
+    for (int i = 0; i < sessions; ++i)
+        host_close(host, i);
+    host_wait(host);
+    host_get_stats(host, &stats);
+    res = stats.states_in_use == 0 ? 0 : 1;
+    if (res != 0)
+        fprintf(stderr, "states left in use after closing every session\n");
+
+done:
+    host_free(&host);
+    free(bench.next);
+    free(bench.rng);
+    free(bench.failed);
+    free(levels);
+    return res;
+}
+
+int main(int argc, char **argv) {
     // TODO: add logging (simple)
 
     // TODO: advanced state builder (not very important right now)
@@ -74,21 +712,186 @@ int main(void) {
     // where they can only connect to the piece they are connected to (dictated
     // by block mask)
 
-    struct GameState *game = make_simple_game();
-    print_game(game);
-    print_blocks(game);
-    // printf(
-    //     "trying to move block 0: %d\n",
-    //     game_do_move(game, 0, MOVE_BLOCK_LEFT, NULL));
-
-    // TODO: better simple interface for this
-    // won't be useful for the solver though
-    struct GameState *game2 = calloc(1, game_get_size(game));
-    game_do_move(game, 3, MOVE_BLOCK_LEFT, game2);
-
-    print_game(game2);
-    print_blocks(game2);
-    game_free(&game);
-    game_free(&game2);
-    return 0;
+    struct SolverOptions options = {
+        .mode = SOLVER_MODE_ASTAR,
+        .max_nodes = 1 << 24,
+    };
+    const char *cache_path = NULL;
+    struct GeneratorOptions generator = {0};
+    const char *out_path = NULL;
+    const char *verify_path = NULL;
+    bool serving = false;
+    int bench_sessions = 0;
+    bool census = false;
+    struct CensusOptions census_options = {0};
+    const char *socket_path = NULL;
+    int threads = 1;
+    const char **paths = malloc(argc * sizeof(const char *));
+    int path_count = 0;
+    if (paths == NULL)
+        return 1;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--bfs") == 0) {
+            options.mode = SOLVER_MODE_BFS;
+        } else if (strcmp(argv[i], "--astar") == 0) {
+            options.mode = SOLVER_MODE_ASTAR;
+        } else if (strcmp(argv[i], "--ida") == 0) {
+            options.mode = SOLVER_MODE_IDA;
+        } else if (strcmp(argv[i], "--external") == 0 && i + 1 < argc) {
+            options.mode = SOLVER_MODE_EXTERNAL;
+            options.ext_dir = argv[++i];
+        } else if (strcmp(argv[i], "--memory") == 0 && i + 1 < argc) {
+            options.ext_memory = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--no-pruning") == 0) {
+            options.no_pruning = true;
+        } else if (strcmp(argv[i], "--symmetry") == 0) {
+            options.symmetry = true;
+        } else if (strcmp(argv[i], "--macro-moves") == 0) {
+            options.macro_moves = true;
+        } else if (strcmp(argv[i], "--huge-pages") == 0) {
+            options.memory.huge_pages = true;
+        } else if (strcmp(argv[i], "--numa") == 0) {
+            options.memory.numa_local = true;
+        } else if (strcmp(argv[i], "--max-nodes") == 0 && i + 1 < argc) {
+            options.max_nodes = strtoull(argv[++i], NULL, 10);
+            generator.max_nodes = options.max_nodes;
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cache_path = argv[++i];
+        } else if (
+            strcmp(argv[i], "--stats-interval") == 0 && i + 1 < argc) {
+            options.snapshot_interval = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--generate") == 0 && i + 1 < argc) {
+            generator.count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            generator.seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--min-moves") == 0 && i + 1 < argc) {
+            generator.min_moves = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-moves") == 0 && i + 1 < argc) {
+            generator.max_moves = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--serve") == 0) {
+            serving = true;
+        } else if (strcmp(argv[i], "--census") == 0) {
+            census = true;
+        } else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            census_options.samples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--walk-length") == 0 && i + 1 < argc) {
+            census_options.walk_length = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--host-bench") == 0 && i + 1 < argc) {
+            bench_sessions = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--verify") == 0 && i + 1 < argc) {
+            verify_path = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            free(paths);
+            return 1;
+        } else {
+            paths[path_count++] = argv[i];
+        }
+    }
+
+    generator.threads = threads;
+    census_options.threads = threads;
+    census_options.max_states = options.max_nodes;
+    census_options.seed = generator.seed;
+    census_options.memory = options.memory;
+    if (serving) {
+        struct PackLevel *levels;
+        int level_count = load_packs(paths, path_count, &levels);
+        free(paths);
+        if (level_count < 0)
+            return 1;
+        struct ServerOptions server_options = {
+            .threads = threads,
+            .max_nodes = options.max_nodes,
+            .mode = options.mode,
+            .socket_path = socket_path,
+            .memory = options.memory,
+        };
+        bool res = serve(levels, level_count, &server_options);
+        free(levels);
+        return res ? 0 : 1;
+    }
+    if (bench_sessions > 0) {
+        int res = run_host_bench(
+            bench_sessions, generator.seed, paths, path_count, threads);
+        free(paths);
+        return res;
+    }
+    if (verify_path != NULL) {
+        int res =
+            run_verifier(verify_path, paths, path_count, threads);
+        free(paths);
+        return res;
+    }
+    if (generator.count > 0) {
+        free(paths);
+        return run_generator(&generator, out_path);
+    }
+
+    // progress is printed every --stats-interval seconds, and on SIGUSR1
+    options.on_snapshot = print_snapshot;
+#ifdef SIGUSR1
+    signal(SIGUSR1, request_snapshot);
+#endif
+
+    struct SolutionCache *cache = NULL;
+    if (cache_path != NULL) {
+        cache = solution_cache_open(cache_path);
+        if (cache == NULL) {
+            fprintf(stderr, "failed to open the cache %s\n", cache_path);
+            return 1;
+        }
+    }
+
+    int res = 0;
+    if (path_count == 0) {
+        struct GameState *game = make_simple_game();
+        if (game == NULL) {
+            fprintf(stderr, "failed to preprocess the level\n");
+            res = 1;
+        } else {
+            res = census ? run_census(game, &census_options)
+                         : run_level(game, &options, cache);
+            game_free(&game);
+        }
+    }
+    for (int i = 0; i < path_count && res != 1; ++i) {
+        struct PackLevel *levels;
+        int count = load_level_pack(paths[i], &levels);
+        if (count < 0) {
+            fprintf(stderr, "failed to load %s\n", paths[i]);
+            res = 1;
+            break;
+        }
+
+        for (int j = 0; j < count && res != 1; ++j) {
+            struct GameState tmp = {0};
+            memcpy(tmp.board, levels[j].board, sizeof(tmp.board));
+            struct GameState *game = NULL;
+            if (!game_preprocess_alloc(&tmp, &game)) {
+                fprintf(stderr, "failed to preprocess the level\n");
+                res = 1;
+                break;
+            }
+            if (count > 1 || path_count > 1)
+                printf("level %s\n", levels[j].name);
+            int level_res = census ? run_census(game, &census_options)
+                                   : run_level(game, &options, cache);
+            if (level_res > res)
+                res = level_res;
+            game_free(&game);
+        }
+        free(levels);
+    }
+
+    free(paths);
+    solution_cache_close(&cache);
+    return res;
 }
@@ -0,0 +1,247 @@
+#include "pack.h"
+
+#include <string.h>
+
+static bool add_kind(
+    struct StatePacker *packer, color_t color, PieceConnect no_connect) {
+    uint8_t *value = &packer->kind_values[color][no_connect];
+    if (*value != 0)
+        return true;
+    if (packer->kind_count == STATE_PACKER_MAX_KINDS)
+        return false;
+    packer->kinds[packer->kind_count++] = (struct PieceCell){
+        .color = color,
+        .no_connect = no_connect,
+    };
+    *value = packer->kind_count;
+    return true;
+}
+
+static void set_packed_size(struct StatePacker *packer) {
+    packer->nibbles = packer->kind_count < 16;
+    packer->emerge_offset = packer->nibbles
+                                ? (size_t)(packer->open_count + 1) / 2
+                                : (size_t)packer->open_count;
+    packer->packed_size =
+        packer->emerge_offset + (packer->emerge_count + 7) / 8;
+    // never empty, so that packed states can be stored as records
+    if (packer->packed_size == 0)
+        packer->packed_size = 1;
+}
+
+static PieceConnect mirror_connect(PieceConnect connect) {
+    return (connect & ~(PIECE_CON_LEFT | PIECE_CON_RIGHT)) |
+           ((connect & PIECE_CON_LEFT) ? PIECE_CON_RIGHT : 0) |
+           ((connect & PIECE_CON_RIGHT) ? PIECE_CON_LEFT : 0);
+}
+
+bool state_packer_init(
+    struct StatePacker *packer, const struct GameState *root) {
+    memset(packer, 0, sizeof(*packer));
+    packer->level = root->level;
+    packer->bounds = *game_get_bounds(root);
+    packer->mirror_sum = packer->bounds.left + packer->bounds.right;
+
+    for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
+        for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
+            const struct Cell *cell = &root->board[i][j];
+            struct Cell *dest = &packer->static_board[i][j];
+
+            if (cell->type == CELL_WALL) {
+                *dest = *cell;
+                continue;
+            }
+
+            if (cell->type == CELL_EMERGE) {
+                // the hidden piece can't connect to anything when it comes
+                // out either
+                *dest = *cell;
+                packer->emerge_cells[packer->emerge_count++] =
+                    MAKE_BOARD_POS(j, i);
+                if (!add_kind(packer, cell->data.emerge.color, 0))
+                    return false;
+                continue;
+            }
+
+            if (cell->type == CELL_PIECE &&
+                root->blocks[cell->data.piece.block].fixed) {
+                // marked the way game_rebuild_blocks expects it
+                *dest = *cell;
+                dest->data.piece.color =
+                    piece_make_color(cell->data.piece.color, true);
+                dest->data.piece.block = 0;
+                continue;
+            }
+
+            packer->open_cells[packer->open_count++] = MAKE_BOARD_POS(j, i);
+            if (cell->type != CELL_PIECE)
+                continue;
+
+            if (!add_kind(
+                    packer, cell->data.piece.color,
+                    cell->data.piece.no_connect))
+                return false;
+        }
+    }
+
+    set_packed_size(packer);
+    return true;
+}
+
+// whether a cell that never changes looks the same in the mirror image
+static bool static_cell_mirrors(const struct Cell *cell, const struct Cell *m) {
+    if (cell->type != m->type)
+        return false;
+    if (cell->type == CELL_PIECE)
+        return cell->data.piece.color == m->data.piece.color &&
+               cell->data.piece.no_connect ==
+                   mirror_connect(m->data.piece.no_connect);
+    if (cell->type == CELL_EMERGE) {
+        MoveBlockDir dir = m->data.emerge.dir;
+        if (DIR_IS_HORIZONTAL(dir))
+            dir = DIR_OPPOSITE(dir);
+        return cell->data.emerge.color == m->data.emerge.color &&
+               cell->data.emerge.fixed == m->data.emerge.fixed &&
+               cell->data.emerge.dir == dir;
+    }
+    return true;
+}
+
+bool state_packer_init_mirror(struct StatePacker *packer) {
+    // only walls are outside of the bounds, and they mirror to walls
+    const struct BoardBounds *bounds = &packer->bounds;
+    for (board_coord_t i = bounds->top; i <= bounds->bottom; ++i) {
+        // a middle column has to be its own mirror image
+        for (board_coord_t j = bounds->left; 2 * j <= packer->mirror_sum;
+             ++j) {
+            if (!static_cell_mirrors(
+                    &packer->static_board[i][j],
+                    &packer->static_board[i][packer->mirror_sum - j]))
+                return false;
+        }
+    }
+
+    // the mirror image of a piece has to have a packed value as well
+    struct StatePacker mirrored = *packer;
+    for (int i = 0; i < mirrored.emerge_count; ++i) {
+        struct BoardPos pos = mirrored.emerge_cells[i];
+        pos.x = mirrored.mirror_sum - pos.x;
+        // the static board is symmetric, so there is one
+        int k = 0;
+        while (mirrored.emerge_cells[k].x != pos.x ||
+               mirrored.emerge_cells[k].y != pos.y)
+            ++k;
+        mirrored.emerge_mirror[i] = k;
+    }
+    int kind_count = mirrored.kind_count;
+    for (int i = 0; i < kind_count; ++i) {
+        const struct PieceCell *kind = &mirrored.kinds[i];
+        if (!add_kind(
+                &mirrored, kind->color, mirror_connect(kind->no_connect)))
+            return false;
+    }
+    set_packed_size(&mirrored);
+    mirrored.symmetric = true;
+    *packer = mirrored;
+    return true;
+}
+
+void state_pack(
+    const struct StatePacker *packer,
+    const struct GameState *game,
+    uint8_t *dest) {
+    memset(dest, 0, packer->packed_size);
+    for (int i = 0; i < packer->open_count; ++i) {
+        struct BoardPos pos = packer->open_cells[i];
+        const struct Cell *cell = &game->board[pos.y][pos.x];
+        if (cell->type != CELL_PIECE)
+            continue;
+
+        uint8_t value = packer->kind_values[cell->data.piece.color]
+                                           [cell->data.piece.no_connect];
+        if (packer->nibbles)
+            dest[i / 2] |= value << (i % 2 * 4);
+        else
+            dest[i] = value;
+    }
+
+    for (int k = 0; k < packer->emerge_count; ++k) {
+        struct BoardPos pos = packer->emerge_cells[k];
+        if (game->board[pos.y][pos.x].type != CELL_EMERGE)
+            dest[packer->emerge_offset + k / 8] |= 1 << (k % 8);
+    }
+}
+
+bool state_pack_canonical(
+    const struct StatePacker *packer,
+    const struct GameState *game,
+    uint8_t *dest) {
+    state_pack(packer, game, dest);
+    if (!packer->symmetric)
+        return false;
+
+    uint8_t mirrored[BOARD_WIDTH * BOARD_HEIGHT] = {0};
+    for (int i = 0; i < packer->open_count; ++i) {
+        // the mirror image has at this cell what the game has at the mirrored
+        // one, with its connections mirrored
+        struct BoardPos pos = packer->open_cells[i];
+        const struct Cell *cell =
+            &game->board[pos.y][packer->mirror_sum - pos.x];
+        if (cell->type != CELL_PIECE)
+            continue;
+
+        PieceConnect no_connect = mirror_connect(cell->data.piece.no_connect);
+        uint8_t value = packer->kind_values[cell->data.piece.color][no_connect];
+        if (packer->nibbles)
+            mirrored[i / 2] |= value << (i % 2 * 4);
+        else
+            mirrored[i] = value;
+    }
+
+    for (int k = 0; k < packer->emerge_count; ++k) {
+        struct BoardPos pos = packer->emerge_cells[k];
+        int m = packer->emerge_mirror[k];
+        if (game->board[pos.y][pos.x].type != CELL_EMERGE)
+            mirrored[packer->emerge_offset + m / 8] |= 1 << (m % 8);
+    }
+
+    if (memcmp(mirrored, dest, packer->packed_size) >= 0)
+        return false;
+    memcpy(dest, mirrored, packer->packed_size);
+    return true;
+}
+
+void state_unpack(
+    const struct StatePacker *packer,
+    const uint8_t *src,
+    struct GameState *dest) {
+    memcpy(dest->board, packer->static_board, sizeof(dest->board));
+    dest->level = packer->level;
+    for (int i = 0; i < packer->open_count; ++i) {
+        uint8_t value =
+            packer->nibbles ? (src[i / 2] >> (i % 2 * 4)) & 0xf : src[i];
+        if (value == 0)
+            continue;
+
+        struct BoardPos pos = packer->open_cells[i];
+        struct Cell *cell = &dest->board[pos.y][pos.x];
+        cell->type = CELL_PIECE;
+        cell->data.piece = packer->kinds[value - 1];
+    }
+
+    for (int k = 0; k < packer->emerge_count; ++k) {
+        if (!(src[packer->emerge_offset + k / 8] >> (k % 8) & 1))
+            continue;
+        struct BoardPos pos = packer->emerge_cells[k];
+        struct Cell *cell = &dest->board[pos.y][pos.x];
+        // a fixed piece never leaves the mouth once it's out
+        if (cell->data.emerge.fixed) {
+            struct BoardPos mouth =
+                emerge_get_mouth(&cell->data.emerge, pos);
+            struct PieceCell *piece = &dest->board[mouth.y][mouth.x].data.piece;
+            piece->color = piece_make_color(piece->color, true);
+        }
+        *cell = (struct Cell){.type = CELL_WALL};
+    }
+    game_rebuild_blocks(dest);
+}
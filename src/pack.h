@@ -0,0 +1,94 @@
+#pragma once
+
+#include "game.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// at most this many different pieces fit in a packed cell
+#define STATE_PACKER_MAX_KINDS 255
+
+/// @brief Compact encoding of the states reachable from a given root. Walls,
+/// emerge cells and fixed pieces never change, so only the remaining cells are
+/// stored, each as an index into the distinct pieces of the root and its emerge
+/// cells (0 for an empty cell), followed by a bit per emerge cell that has
+/// released its piece; block data is recomputed when unpacking. Packed states
+/// are canonical: two states are equal exactly when their packed bytes are.
+struct StatePacker {
+    /// @brief The parts of the board that never change, everything else empty.
+    struct Cell static_board[BOARD_HEIGHT][BOARD_WIDTH];
+    const struct LevelTemplate *level;
+    /// @brief Copied from the root, see `game_get_bounds`.
+    struct BoardBounds bounds;
+    /// @brief Cells that can hold a movable piece, in row-major order.
+    struct BoardPos open_cells[BOARD_WIDTH * BOARD_HEIGHT];
+    int open_count;
+    /// @brief Emerge cells, in row-major order.
+    struct BoardPos emerge_cells[BOARD_WIDTH * BOARD_HEIGHT];
+    int emerge_count;
+    /// @brief Where the emerge cell bits start.
+    size_t emerge_offset;
+    /// @brief The emerge cell each one is the mirror image of, set by
+    /// `state_packer_init_mirror`.
+    int16_t emerge_mirror[BOARD_WIDTH * BOARD_HEIGHT];
+    /// @brief Distinct movable pieces (color and connections); a cell's packed
+    /// value is its index here plus 1.
+    struct PieceCell kinds[STATE_PACKER_MAX_KINDS];
+    int kind_count;
+    // packed value of each color and connection mask combination
+    uint8_t kind_values[INT8_MAX + 1][1 << MOVE_BLOCK_NONE];
+    /// @brief Cells take 4 bits instead of 8 when there are few kinds.
+    bool nibbles;
+    size_t packed_size;
+    /// @brief Set by `state_packer_init_mirror`.
+    bool symmetric;
+    /// @brief The mirror image of column `x` is `mirror_sum - x`; the level
+    /// is mirrored inside of its bounds, not the whole board.
+    board_coord_t mirror_sum;
+};
+
+/// @brief Set up the encoding for the states reachable from `root`.
+/// @param packer
+/// @param root Preprocessed game state
+/// @return Whether or not the root has few enough distinct pieces
+bool state_packer_init(
+    struct StatePacker *packer, const struct GameState *root);
+
+/// @brief Let `state_pack_canonical` identify every state with its left-right
+/// mirror image, which is only sound if the parts of the board that never
+/// change are symmetric: a mirrored state then needs just as many moves, the
+/// mirrored ones. Has to be called before packing anything, as it can add
+/// kinds and change `packed_size`.
+/// @param packer
+/// @return Whether or not the level is symmetric and the mirror image of each
+/// piece fits in as well; the packer is left unchanged otherwise
+bool state_packer_init_mirror(struct StatePacker *packer);
+
+/// @brief Pack a state reachable from the packer's root.
+/// @param packer
+/// @param game
+/// @param dest Receives `packed_size` bytes
+void state_pack(
+    const struct StatePacker *packer,
+    const struct GameState *game,
+    uint8_t *dest);
+
+/// @brief Pack a state or its mirror image, whichever packs to the smaller key,
+/// if the packer is symmetric; like `state_pack` otherwise.
+/// @param packer
+/// @param game
+/// @param dest Receives `packed_size` bytes
+/// @return Whether or not the mirror image was packed
+bool state_pack_canonical(
+    const struct StatePacker *packer,
+    const struct GameState *game,
+    uint8_t *dest);
+
+/// @brief Restore a packed state.
+/// @param packer
+/// @param src
+/// @param dest Has to have room for `GAME_STATE_MAX_SIZE` bytes
+void state_unpack(
+    const struct StatePacker *packer,
+    const uint8_t *src,
+    struct GameState *dest);
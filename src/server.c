@@ -0,0 +1,783 @@
+#if defined(__unix__) || defined(__APPLE__)
+    // for fdopen
+    #define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "server.h"
+
+#include "verifier.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef JNB_THREADING
+    #include <threads.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define SERVE_USE_SOCKET
+    #include <errno.h>
+    #include <signal.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+
+// ids longer than this are rejected
+#define SERVE_ID_SIZE 64
+
+#define SERVE_MAX_THREADS 64
+
+// requests queued per worker before the readers wait; this bounds the number
+// of requests in memory, which is what lets them be recycled
+#define SERVE_QUEUE_PER_THREAD 16
+
+enum _ServeOp { SERVE_SOLVE = 0, SERVE_HINT, SERVE_VERIFY };
+typedef int8_t ServeOp;
+
+struct Server;
+
+// a connection, or stdin and stdout; freed once its reader and every request
+// it sent are done
+struct ServeClient {
+    struct Server *server;
+    FILE *in;
+    FILE *out;
+    // stdin and stdout aren't closed
+    bool owns_files;
+#ifdef JNB_THREADING
+    // responses of different workers mustn't interleave
+    mtx_t write_lock;
+#endif
+    // guarded by the server lock
+    int refs;
+};
+
+struct ServeJob {
+    struct ServeJob *next;
+    struct ServeClient *client;
+    ServeOp op;
+    int level;
+    SolverMode mode;
+    size_t max_nodes;
+    // the id as it was in the request, written back as is
+    char id[SERVE_ID_SIZE];
+    // the moves already played (solve, hint) or the solution (verify); the
+    // buffer is kept when the job is recycled
+    char *moves;
+    size_t moves_size;
+    size_t moves_cap;
+};
+
+// scratch memory of a thread that handles requests, kept across them
+struct ServeWorker {
+    struct Server *server;
+    struct Solver *solver;
+    struct VerifyBuffers buffers;
+    char *text;
+    size_t text_cap;
+};
+
+struct Server {
+    struct LevelIndex index;
+    struct GameState **roots;
+    int level_count;
+    struct ServerOptions options;
+#ifdef JNB_THREADING
+    // guards everything below, and the references of the clients
+    mtx_t lock;
+    cnd_t ready;
+    cnd_t space;
+#endif
+    // requests waiting for a worker, oldest first
+    struct ServeJob *head;
+    struct ServeJob *tail;
+    int queued;
+    // recycled requests
+    struct ServeJob *free_jobs;
+    bool stopping;
+    struct ServeWorker *workers;
+};
+
+static void server_lock(struct Server *server) {
+#ifdef JNB_THREADING
+    mtx_lock(&server->lock);
+#else
+    (void)server;
+#endif
+}
+
+static void server_unlock(struct Server *server) {
+#ifdef JNB_THREADING
+    mtx_unlock(&server->lock);
+#else
+    (void)server;
+#endif
+}
+
+static struct ServeClient *
+    client_new(struct Server *server, FILE *in, FILE *out, bool owns_files) {
+    struct ServeClient *client = calloc(1, sizeof(struct ServeClient));
+    if (client == NULL)
+        return NULL;
+    client->server = server;
+    client->in = in;
+    client->out = out;
+    client->owns_files = owns_files;
+    client->refs = 1;
+#ifdef JNB_THREADING
+    if (mtx_init(&client->write_lock, mtx_plain) != thrd_success) {
+        free(client);
+        return NULL;
+    }
+#endif
+    return client;
+}
+
+// with the server lock held
+static void client_release(struct ServeClient *client) {
+    if (--client->refs > 0)
+        return;
+    if (client->owns_files) {
+        fclose(client->in);
+        fclose(client->out);
+    }
+#ifdef JNB_THREADING
+    mtx_destroy(&client->write_lock);
+#endif
+    free(client);
+}
+
+// writes a whole response line, which goes out right away
+static void
+    client_respond(struct ServeClient *client, const char *format, ...) {
+#ifdef JNB_THREADING
+    mtx_lock(&client->write_lock);
+#endif
+    va_list args;
+    va_start(args, format);
+    vfprintf(client->out, format, args);
+    va_end(args);
+    fputc('\n', client->out);
+    fflush(client->out);
+#ifdef JNB_THREADING
+    mtx_unlock(&client->write_lock);
+#endif
+}
+
+// a search still running ran out of its budget
+static const char *status_name(SolverStatus status) {
+    switch (status) {
+    case SOLVER_SOLVED:
+        return "solved";
+    case SOLVER_UNSOLVABLE:
+        return "unsolvable";
+    }
+    return "limit";
+}
+
+// reads a line without its terminator into a buffer that only ever grows;
+// false at the end of the input
+static bool read_line(FILE *file, char **line, size_t *cap) {
+    size_t size = 0;
+    for (;;) {
+        if (size + 2 > *cap) {
+            size_t grown_cap = *cap ? *cap * 2 : 256;
+            char *grown = realloc(*line, grown_cap);
+            if (grown == NULL)
+                return false;
+            *line = grown;
+            *cap = grown_cap;
+        }
+        if (fgets(*line + size, *cap - size, file) == NULL)
+            return size > 0;
+        size += strlen(*line + size);
+        if (size > 0 && (*line)[size - 1] == '\n') {
+            (*line)[--size] = '\0';
+            return true;
+        }
+    }
+}
+
+static const char *json_skip_space(const char *str) {
+    while (*str == ' ' || *str == '\t' || *str == '\r' || *str == '\n')
+        ++str;
+    return str;
+}
+
+// bytes between the quotes of a string, an upper bound for its decoded size
+static size_t json_string_span(const char *str) {
+    size_t size = 0;
+    for (++str; str[size] != '"' && str[size] != '\0'; ++size) {
+        if (str[size] == '\\' && str[size + 1] != '\0')
+            ++size;
+    }
+    return size;
+}
+
+// decodes the string starting at the quote into `dest`, which has room for
+// `cap` bytes with the terminator, or just checks it if `dest` is NULL;
+// returns what follows the string, or NULL if it's malformed or too long
+static const char *
+    json_string(const char *str, char *dest, size_t cap, size_t *size) {
+    if (*str != '"')
+        return NULL;
+    size_t length = 0;
+    for (++str; *str != '"'; ++str) {
+        char c = *str;
+        if (c == '\0' || (unsigned char)c < 0x20)
+            return NULL;
+        if (c == '\\') {
+            switch (*++str) {
+            case '"':
+            case '\\':
+            case '/':
+                c = *str;
+                break;
+            case 'n':
+                c = '\n';
+                break;
+            case 't':
+                c = '\t';
+                break;
+            case 'r':
+                c = '\r';
+                break;
+            case 'b':
+                c = '\b';
+                break;
+            case 'f':
+                c = '\f';
+                break;
+            case 'u': {
+                // names and moves are ASCII
+                unsigned code;
+                if (sscanf(str + 1, "%4x", &code) != 1 || code == 0 ||
+                    code >= 0x80)
+                    return NULL;
+                c = code;
+                str += 4;
+                break;
+            }
+            default:
+                return NULL;
+            }
+        }
+        if (dest != NULL) {
+            if (length + 1 >= cap)
+                return NULL;
+            dest[length] = c;
+        }
+        ++length;
+    }
+    if (dest != NULL)
+        dest[length] = '\0';
+    if (size != NULL)
+        *size = length;
+    return str + 1;
+}
+
+// numbers, true, false and null
+static const char *json_scalar(const char *str) {
+    const char *start = str;
+    while ((*str >= '0' && *str <= '9') || (*str >= 'a' && *str <= 'z') ||
+           *str == '-' || *str == '+' || *str == '.' || *str == 'E')
+        ++str;
+    return str == start ? NULL : str;
+}
+
+static bool reserve_moves(struct ServeJob *job, size_t size) {
+    if (size <= job->moves_cap)
+        return true;
+    char *moves = realloc(job->moves, size);
+    if (moves == NULL)
+        return false;
+    job->moves = moves;
+    job->moves_cap = size;
+    return true;
+}
+
+// fills in a job from a flat JSON object; the id is filled in first thing, so
+// that errors can be reported with it
+static const char *parse_request(
+    const struct Server *server, const char *str, struct ServeJob *job) {
+    strcpy(job->id, "null");
+    job->op = -1;
+    job->level = -1;
+    job->mode = server->options.mode;
+    job->max_nodes = server->options.max_nodes;
+    job->moves_size = 0;
+    bool has_level = false;
+    char level[LEVEL_NAME_SIZE] = "";
+    size_t level_size = 0;
+
+    // the id first, even if the rest is broken
+    const char *id = strstr(str, "\"id\"");
+    if (id != NULL) {
+        const char *value = json_skip_space(id + 4);
+        if (*value == ':') {
+            value = json_skip_space(value + 1);
+            const char *end = *value == '"'
+                                  ? json_string(value, NULL, 0, NULL)
+                                  : json_scalar(value);
+            if (end != NULL && (size_t)(end - value) < SERVE_ID_SIZE) {
+                memcpy(job->id, value, end - value);
+                job->id[end - value] = '\0';
+            }
+        }
+    }
+
+    str = json_skip_space(str);
+    if (*str++ != '{')
+        return "expected an object";
+    str = json_skip_space(str);
+    while (*str != '}') {
+        char key[16];
+        const char *value = json_string(str, key, sizeof(key), NULL);
+        if (value == NULL) {
+            // a key that doesn't fit isn't one we know
+            key[0] = '\0';
+            value = json_string(str, NULL, 0, NULL);
+        }
+        if (value == NULL)
+            return "malformed key";
+        str = value;
+        str = json_skip_space(str);
+        if (*str++ != ':')
+            return "expected ':'";
+        str = json_skip_space(str);
+
+        const char *end;
+        if (strcmp(key, "op") == 0) {
+            char op[16];
+            end = json_string(str, op, sizeof(op), NULL);
+            if (end == NULL)
+                return "unknown op";
+            if (strcmp(op, "solve") == 0)
+                job->op = SERVE_SOLVE;
+            else if (strcmp(op, "hint") == 0)
+                job->op = SERVE_HINT;
+            else if (strcmp(op, "verify") == 0)
+                job->op = SERVE_VERIFY;
+            else
+                return "unknown op";
+        } else if (strcmp(key, "level") == 0) {
+            // names that don't fit don't exist
+            end = json_string(str, level, sizeof(level), &level_size);
+            if (end == NULL)
+                end = json_string(str, NULL, 0, NULL);
+            else
+                has_level = true;
+        } else if (strcmp(key, "mode") == 0) {
+            char mode[16];
+            end = json_string(str, mode, sizeof(mode), NULL);
+            if (end == NULL)
+                return "unknown mode";
+            if (strcmp(mode, "bfs") == 0)
+                job->mode = SOLVER_MODE_BFS;
+            else if (strcmp(mode, "astar") == 0)
+                job->mode = SOLVER_MODE_ASTAR;
+            else if (strcmp(mode, "ida") == 0)
+                job->mode = SOLVER_MODE_IDA;
+            else
+                return "unknown mode";
+        } else if (strcmp(key, "max_nodes") == 0) {
+            end = json_scalar(str);
+            unsigned long long max_nodes = strtoull(str, NULL, 10);
+            // a budget, never more than the server allows
+            if (max_nodes < job->max_nodes)
+                job->max_nodes = max_nodes;
+        } else if (strcmp(key, "moves") == 0 ||
+                   strcmp(key, "solution") == 0) {
+            if (*str != '"')
+                return "moves have to be a string";
+            if (!reserve_moves(job, json_string_span(str) + 1))
+                return "out of memory";
+            end = json_string(
+                str, job->moves, job->moves_cap, &job->moves_size);
+        } else {
+            end = *str == '"' ? json_string(str, NULL, 0, NULL)
+                              : json_scalar(str);
+        }
+        if (end == NULL)
+            return "malformed value";
+
+        str = json_skip_space(end);
+        if (*str == ',')
+            str = json_skip_space(str + 1);
+        else if (*str != '}')
+            return "expected ',' or '}'";
+    }
+
+    if (job->op < 0)
+        return "missing op";
+    if (has_level)
+        job->level = level_index_find(&server->index, level, level_size);
+    if (job->level < 0)
+        return "unknown level";
+    return NULL;
+}
+
+static bool reserve_text(struct ServeWorker *worker, size_t size) {
+    if (size <= worker->text_cap)
+        return true;
+    char *text = realloc(worker->text, size);
+    if (text == NULL)
+        return false;
+    worker->text = text;
+    worker->text_cap = size;
+    return true;
+}
+
+static void respond_error(
+    const struct ServeJob *job, const char *op, const char *error) {
+    client_respond(
+        job->client, "{\"id\":%s,\"op\":\"%s\",\"error\":\"%s\"}", job->id,
+        op, error);
+}
+
+static void handle_verify(struct ServeWorker *worker, struct ServeJob *job) {
+    int moves;
+    VerifyResult result = verify_solution(
+        worker->server->roots[job->level], job->moves, job->moves_size,
+        &worker->buffers, &moves);
+    client_respond(
+        job->client,
+        "{\"id\":%s,\"op\":\"verify\",\"result\":\"%s\",\"moves\":%d}",
+        job->id, verify_result_string(result), moves);
+}
+
+static void handle_solve(struct ServeWorker *worker, struct ServeJob *job) {
+    const char *op = job->op == SERVE_HINT ? "hint" : "solve";
+    const struct GameState *state = worker->server->roots[job->level];
+    if (job->moves_size > 0) {
+        int played;
+        VerifyResult result = verify_solution(
+            state, job->moves, job->moves_size, &worker->buffers, &played);
+        if (result == VERIFY_MALFORMED || result == VERIFY_ILLEGAL_MOVE) {
+            respond_error(
+                job, op,
+                result == VERIFY_MALFORMED ? "malformed moves"
+                                           : "illegal moves");
+            return;
+        }
+        state = (const struct GameState *)worker->buffers.states[played % 2];
+    }
+
+    struct SolverOptions options = {
+        .mode = job->mode,
+        .max_nodes = job->max_nodes,
+        .memory = worker->server->options.memory,
+    };
+    if (worker->solver == NULL)
+        worker->solver = solver_new(state, &options);
+    else if (!solver_reset(worker->solver, state, &options))
+        solver_free(&worker->solver);
+    if (worker->solver == NULL) {
+        respond_error(job, op, "out of memory");
+        return;
+    }
+
+    // the budget counts expansions, which bounds IDA* as well
+    SolverStatus status = solver_step(worker->solver, job->max_nodes);
+    const struct SolverStats *stats = solver_get_stats(worker->solver);
+    int length = 0;
+    const struct SolverMove *moves =
+        solver_get_solution(worker->solver, &length);
+    // a hint is the first move of the solution
+    int shown = job->op == SERVE_HINT && length > 1 ? 1 : length;
+    if (!reserve_text(worker, (size_t)shown * 3 + 1)) {
+        respond_error(job, op, "out of memory");
+        return;
+    }
+    solver_solution_to_string(moves, shown, worker->text, worker->text_cap);
+    client_respond(
+        job->client,
+        "{\"id\":%s,\"op\":\"%s\",\"status\":\"%s\",\"length\":%d,"
+        "\"%s\":\"%s\",\"expanded\":%llu,\"generated\":%llu}",
+        job->id, op, status_name(status), length,
+        job->op == SERVE_HINT ? "hint" : "solution", worker->text,
+        (unsigned long long)stats->expanded,
+        (unsigned long long)stats->generated);
+}
+
+static void handle_job(struct ServeWorker *worker, struct ServeJob *job) {
+    if (job->op == SERVE_VERIFY)
+        handle_verify(worker, job);
+    else
+        handle_solve(worker, job);
+
+    struct Server *server = worker->server;
+    server_lock(server);
+    client_release(job->client);
+    job->client = NULL;
+    job->next = server->free_jobs;
+    server->free_jobs = job;
+    server_unlock(server);
+}
+
+#ifdef JNB_THREADING
+static int worker_main(void *arg) {
+    struct ServeWorker *worker = arg;
+    struct Server *server = worker->server;
+    for (;;) {
+        mtx_lock(&server->lock);
+        while (server->head == NULL && !server->stopping)
+            cnd_wait(&server->ready, &server->lock);
+        struct ServeJob *job = server->head;
+        if (job == NULL) {
+            mtx_unlock(&server->lock);
+            return 0;
+        }
+        server->head = job->next;
+        if (server->head == NULL)
+            server->tail = NULL;
+        --server->queued;
+        cnd_signal(&server->space);
+        mtx_unlock(&server->lock);
+
+        handle_job(worker, job);
+    }
+}
+#endif
+
+static struct ServeJob *take_job(struct Server *server) {
+    server_lock(server);
+    struct ServeJob *job = server->free_jobs;
+    if (job != NULL)
+        server->free_jobs = job->next;
+    server_unlock(server);
+    return job != NULL ? job : calloc(1, sizeof(struct ServeJob));
+}
+
+static void submit_job(struct Server *server, struct ServeJob *job) {
+    server_lock(server);
+    ++job->client->refs;
+#ifdef JNB_THREADING
+    while (server->queued >= server->options.threads * SERVE_QUEUE_PER_THREAD)
+        cnd_wait(&server->space, &server->lock);
+    ++server->queued;
+    job->next = NULL;
+    if (server->tail != NULL)
+        server->tail->next = job;
+    else
+        server->head = job;
+    server->tail = job;
+    cnd_signal(&server->ready);
+    mtx_unlock(&server->lock);
+#else
+    server_unlock(server);
+    handle_job(&server->workers[0], job);
+#endif
+}
+
+// reads the requests of a client until its input ends
+static int client_main(void *arg) {
+    struct ServeClient *client = arg;
+    struct Server *server = client->server;
+    char *line = NULL;
+    size_t cap = 0;
+    while (read_line(client->in, &line, &cap)) {
+        if (*json_skip_space(line) == '\0')
+            continue;
+        struct ServeJob *job = take_job(server);
+        if (job == NULL) {
+            client_respond(client, "{\"id\":null,\"error\":\"out of memory\"}");
+            continue;
+        }
+        job->client = client;
+        const char *error = parse_request(server, line, job);
+        if (error == NULL) {
+            submit_job(server, job);
+            continue;
+        }
+
+        client_respond(
+            client, "{\"id\":%s,\"error\":\"%s\"}", job->id, error);
+        server_lock(server);
+        job->next = server->free_jobs;
+        server->free_jobs = job;
+        server_unlock(server);
+    }
+    free(line);
+
+    server_lock(server);
+    client_release(client);
+    server_unlock(server);
+    return 0;
+}
+
+#ifdef SERVE_USE_SOCKET
+static bool serve_socket(struct Server *server, const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path too long\n");
+        return false;
+    }
+    strcpy(addr.sun_path, path);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+        return false;
+    unlink(path);
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(listener, 16) != 0) {
+        perror(path);
+        close(listener);
+        return false;
+    }
+    // a client that goes away mid-response must not take the server with it
+    signal(SIGPIPE, SIG_IGN);
+
+    for (;;) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        int out_fd = dup(fd);
+        FILE *in = fdopen(fd, "r");
+        FILE *out = out_fd >= 0 ? fdopen(out_fd, "w") : NULL;
+        struct ServeClient *client =
+            in != NULL && out != NULL ? client_new(server, in, out, true)
+                                      : NULL;
+        if (client == NULL) {
+            if (in != NULL)
+                fclose(in);
+            else
+                close(fd);
+            if (out != NULL)
+                fclose(out);
+            else if (out_fd >= 0)
+                close(out_fd);
+            continue;
+        }
+    #ifdef JNB_THREADING
+        thrd_t reader;
+        if (thrd_create(&reader, client_main, client) == thrd_success) {
+            thrd_detach(reader);
+        } else {
+            server_lock(server);
+            client_release(client);
+            server_unlock(server);
+        }
+    #else
+        client_main(client);
+    #endif
+    }
+    close(listener);
+    return true;
+}
+#endif
+
+bool serve(
+    const struct PackLevel *levels,
+    int level_count,
+    const struct ServerOptions *options) {
+    struct Server server = {
+        .level_count = level_count,
+        .options = *options,
+    };
+#ifdef JNB_THREADING
+    if (server.options.threads < 1)
+        server.options.threads = 1;
+    if (server.options.threads > SERVE_MAX_THREADS)
+        server.options.threads = SERVE_MAX_THREADS;
+#else
+    server.options.threads = 1;
+#endif
+#ifndef SERVE_USE_SOCKET
+    if (options->socket_path != NULL) {
+        fprintf(stderr, "sockets aren't supported on this platform\n");
+        return false;
+    }
+#endif
+
+    bool res = false;
+    int started = 0;
+    server.roots = calloc(level_count + 1, sizeof(struct GameState *));
+    server.workers =
+        calloc(server.options.threads, sizeof(struct ServeWorker));
+    if (server.roots == NULL || server.workers == NULL ||
+        !level_index_init(&server.index, levels, level_count))
+        goto done;
+    for (int i = 0; i < level_count; ++i) {
+        struct GameState tmp = {0};
+        memcpy(tmp.board, levels[i].board, sizeof(tmp.board));
+        if (!game_preprocess_alloc(&tmp, &server.roots[i]))
+            goto done;
+    }
+    for (int i = 0; i < server.options.threads; ++i)
+        server.workers[i].server = &server;
+
+#ifdef JNB_THREADING
+    if (mtx_init(&server.lock, mtx_plain) != thrd_success)
+        goto done;
+    if (cnd_init(&server.ready) != thrd_success) {
+        mtx_destroy(&server.lock);
+        goto done;
+    }
+    if (cnd_init(&server.space) != thrd_success) {
+        cnd_destroy(&server.ready);
+        mtx_destroy(&server.lock);
+        goto done;
+    }
+    thrd_t threads[SERVE_MAX_THREADS];
+    for (; started < server.options.threads; ++started) {
+        if (thrd_create(
+                &threads[started], worker_main, &server.workers[started]) !=
+            thrd_success)
+            break;
+    }
+    if (started > 0) {
+#endif
+        if (options->socket_path != NULL) {
+#ifdef SERVE_USE_SOCKET
+            res = serve_socket(&server, options->socket_path);
+#endif
+        } else {
+            struct ServeClient *client =
+                client_new(&server, stdin, stdout, false);
+            if (client != NULL) {
+                client_main(client);
+                res = true;
+            }
+        }
+#ifdef JNB_THREADING
+    }
+
+    // the queue is drained before the workers stop
+    mtx_lock(&server.lock);
+    server.stopping = true;
+    cnd_broadcast(&server.ready);
+    mtx_unlock(&server.lock);
+    for (int i = 0; i < started; ++i)
+        thrd_join(threads[i], NULL);
+    cnd_destroy(&server.space);
+    cnd_destroy(&server.ready);
+    mtx_destroy(&server.lock);
+#else
+    (void)started;
+#endif
+
+done:
+    while (server.free_jobs != NULL) {
+        struct ServeJob *job = server.free_jobs;
+        server.free_jobs = job->next;
+        free(job->moves);
+        free(job);
+    }
+    for (int i = 0; server.workers != NULL && i < server.options.threads;
+         ++i) {
+        solver_free(&server.workers[i].solver);
+        free(server.workers[i].text);
+    }
+    free(server.workers);
+    for (int i = 0; server.roots != NULL && i < level_count; ++i)
+        game_free(&server.roots[i]);
+    free(server.roots);
+    level_index_free(&server.index);
+    return res;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "solver.h"
+#include "util.h"
+
+#include <stddef.h>
+
+/// @brief Settings of `serve`.
+struct ServerOptions {
+    /// @brief Worker threads; requests are handled by the reading thread
+    /// without `JNB_THREADING`.
+    int threads;
+    /// @brief Node budget of a search, and the most a request can ask for.
+    size_t max_nodes;
+    /// @brief Search used when a request doesn't pick one; BFS, A* or IDA*.
+    SolverMode mode;
+    /// @brief Listen on this Unix socket instead of serving stdin; POSIX only.
+    const char *socket_path;
+    /// @brief How the searches allocate; a worker's solver is first allocated
+    /// by its thread, so NUMA binding keeps it on the worker's node.
+    struct BigMemOptions memory;
+};
+
+/// @brief Serve requests for the levels of a pack until the input ends, or
+/// forever on a socket. Requests and responses are JSON objects, one per line.
+/// Requests have an `op`, the `level` name and an optional `id` that is
+/// copied to the response:
+/// - `solve`: search from the level's start, or from the state after the
+///   `moves` already played (a solution string); `mode` (`bfs`, `astar`,
+///   `ida`) and `max_nodes` are optional
+/// - `hint`: like `solve`, but only responds with the first move
+/// - `verify`: replay a `solution` string, see `verify_solution`
+///
+/// Requests are queued for a pool of workers and the responses are written as
+/// soon as they are ready, so they can arrive out of order. Every worker keeps
+/// its solver and buffers, and request memory is recycled, so a server that
+/// has warmed up doesn't allocate anymore.
+/// @param levels
+/// @param level_count
+/// @param options
+/// @return `false` if the server couldn't be started
+bool serve(
+    const struct PackLevel *levels,
+    int level_count,
+    const struct ServerOptions *options);
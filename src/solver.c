@@ -0,0 +1,1466 @@
+#include "solver.h"
+#include "pack.h"
+#include "solver_ext.h"
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef JNB_THREADING
+    #include <stdatomic.h>
+#endif
+
+#define NODE_NONE UINT32_MAX
+
+#define IDA_DEFAULT_CACHE_SIZE (1 << 16)
+
+// longest slide stored as a single node, so the count fits in SolverNode;
+// longer ones go on from the node where they were cut
+#define MACRO_MAX_STEPS 15
+
+#ifdef JNB_THREADING
+    #define TELEMETRY_STORE(counter, value) \
+        atomic_store_explicit(&(counter), (value), memory_order_relaxed)
+    #define TELEMETRY_LOAD(counter) \
+        atomic_load_explicit(&(counter), memory_order_relaxed)
+#else
+    #define TELEMETRY_STORE(counter, value) ((counter) = (value))
+    #define TELEMETRY_LOAD(counter) (counter)
+#endif
+
+// bumped by solver_request_snapshot; a search takes a snapshot when the count
+// differs from the one it saw last
+#ifdef JNB_THREADING
+static atomic_uint g_snapshot_requests;
+#else
+static volatile sig_atomic_t g_snapshot_requests;
+#endif
+
+// every node of the search tree, in the order they were generated; for BFS
+// this is also the expansion order, so the queue is implicit; the state itself
+// is only stored packed, as the dedup key, and the states of the solution path
+// are recovered by replaying the moves from the root
+struct SolverNode {
+    uint32_t parent;
+    // number of moves from the root
+    uint16_t g;
+    // the move, made on the state the parent's key unpacks to
+    blockidx_t block;
+    uint8_t dir : 3;
+    // moves the block is moved by, see MACRO_MAX_STEPS; 0 for the root
+    uint8_t steps : 4;
+    // whether the key is the mirror image of the state the move led to, see
+    // state_pack_canonical
+    uint8_t mirrored : 1;
+};
+
+// open nodes of A* with the same f value; popped LIFO, which prefers the
+// deeper nodes among the ones with equal f
+struct SolverBucket {
+    uint32_t *items;
+    uint32_t count;
+    uint32_t cap;
+};
+
+// one level of the IDA* recursion, kept on an explicit stack so that the
+// search can be suspended between slices
+struct IdaFrame {
+    struct BlockSet movable[2];
+    uint64_t hash;
+    // next move to try, encoded as block * 2 + dir
+    int next_move;
+    // move that led to this frame
+    blockidx_t block;
+    MoveBlockDir dir;
+};
+
+// direct mapped, entries are simply overwritten on collision
+struct IdaCacheEntry {
+    uint64_t hash;
+    uint16_t g;
+    // entries of previous iterations are stale, their subtrees were only
+    // searched up to a lower threshold
+    uint16_t iteration;
+};
+
+struct Solver {
+    SolverMode mode;
+    SolverStatus status;
+    struct SolverStats stats;
+
+    // bound on the size of every reachable state, see max_state_size
+    size_t state_size;
+    size_t max_nodes;
+
+    // the root, zero padded to state_size; GAME_STATE_MAX_SIZE bytes, so that
+    // it fits the root of any later search, see solver_reset
+    struct GameState *root;
+    uint64_t root_hash;
+
+    struct StatePacker packer;
+    size_t key_size;
+
+    // the node table, the hash table, the buckets and the IDA* cache come from
+    // bigmem; the modes it used are in stats and outlive a reset, like the
+    // memory does
+    struct BigMemOptions memory;
+    struct SolverNode *nodes;
+    // packed state of node i is at keys + i * key_size; keys_cap is in bytes,
+    // since the key size changes between the searches of a reused solver
+    uint8_t *keys;
+    size_t keys_cap;
+    // bit set of expanded nodes; A* can have the same node queued in more than
+    // one bucket after finding a shorter path to it
+    uint64_t *closed;
+    uint32_t node_count;
+    uint32_t node_cap;
+
+    // next node to expand (BFS)
+    uint32_t head;
+
+    // integer bucket priority queue indexed by f (A*); f values never drop
+    // below the one being expanded, so the smallest non-empty bucket can be
+    // found with a cursor that only moves forward
+    struct SolverBucket *buckets;
+    int bucket_count;
+    int min_bucket;
+
+    // IDA*; frame i holds the state at depth i of the current path, at
+    // ida_states + i * state_size; both are only reallocated when the
+    // threshold grows past them, between iterations
+    struct IdaFrame *ida_frames;
+    uint8_t *ida_states;
+    int ida_frame_cap;
+    // -1 before the first iteration
+    int ida_top;
+    int ida_bound;
+    int ida_next_bound;
+    uint16_t ida_iteration;
+    struct IdaCacheEntry *ida_cache;
+    uint64_t ida_cache_mask;
+    // the packed state of entry i is at ida_cache_keys + i * key_size, so that
+    // a hash collision can't cut off a subtree; ida_cache_keys_cap is in bytes
+    uint8_t *ida_cache_keys;
+    size_t ida_cache_keys_cap;
+
+    // everything but the solution path is on disk (external search)
+    struct ExtSearch *ext;
+
+    // open addressing set of node indices, keyed by the node's packed state
+    uint32_t *table;
+    uint32_t table_mask;
+
+    // scratch for the move generator
+    struct LegalMoves legal;
+    // the states after the first moves of a batch of successors, see
+    // expand_lanes
+    _Alignas(struct GameState) uint8_t lanes[GAME_LANES][GAME_STATE_MAX_SIZE];
+
+    // NULL if nobody watches the search; points to own_telemetry if only the
+    // snapshots are wanted
+    struct SolverTelemetry *telemetry;
+    struct SolverTelemetry own_telemetry;
+    SolverSnapshotFn on_snapshot;
+    void *snapshot_data;
+    double snapshot_interval;
+    double started;
+    double next_snapshot;
+    unsigned snapshot_requests;
+    // nodes by depth, see SolverSnapshot
+    uint64_t layers[SOLVER_TELEMETRY_LAYERS];
+    // IDA* cache entries written by the current iteration
+    uint64_t ida_cache_used;
+
+    // drop the states game_is_dead rejects
+    bool prune;
+    bool macro_moves;
+    // nodes are taken from the buckets in order of f; BFS with macro moves
+    // uses them with h = 0, since its successors differ in cost
+    bool by_cost;
+
+    // filled in once the search is solved, includes the root and the goal;
+    // path_keys holds the states actually played, which differ from the
+    // node keys where those are mirrored
+    uint32_t *path;
+    uint8_t *path_keys;
+    struct SolverMove *solution;
+    int solution_length;
+    // entries the three path arrays have room for; path_keys has room for
+    // keys of the largest size, BOARD_WIDTH * BOARD_HEIGHT bytes
+    int path_cap;
+};
+
+static double wall_seconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline void count_layer(struct Solver *solver, int g, int64_t delta) {
+    if (g >= SOLVER_TELEMETRY_LAYERS)
+        g = SOLVER_TELEMETRY_LAYERS - 1;
+    solver->layers[g] += delta;
+}
+
+static uint64_t hash_bytes(const void *data, size_t size) {
+    // multiply-xorshift over 8 byte words; states are a few hundred bytes, so
+    // byte-at-a-time hashes would dominate the expansion cost
+    const uint8_t *bytes = data;
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        h = (h ^ word) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, bytes + i, size - i);
+    h = (h ^ tail) * 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 29;
+    return h;
+}
+
+int solver_heuristic(const struct GameState *game) {
+    // every move shifts any block by at most one column, in a single
+    // direction; for a color, take the columns covered by its pieces: an
+    // uncovered run of columns between two covered ones can only shrink by one
+    // column per move (from one side), and a solved color covers a contiguous
+    // range of columns, so the widest such run of any color is a lower bound
+    // it is also consistent, since no move can lower it by more than one
+    // on top of that, an unsolved state needs at least one move
+    // a hidden piece counts as being in the mouth of its emerge cell already:
+    // that's where it comes out, so it doesn't change the bound when it does
+    static_assert(BOARD_WIDTH <= 64, "column masks are 64 bits wide");
+
+    uint64_t columns[INT8_MAX + 1];
+    bool used[INT8_MAX + 1] = {false};
+
+    const struct BoardBounds *bounds = game_get_bounds(game);
+    for (board_coord_t i = bounds->top; i <= bounds->bottom; ++i) {
+        for (board_coord_t j = bounds->left; j <= bounds->right; ++j) {
+            const struct Cell *cell = &game->board[i][j];
+            color_t color;
+            int column = j;
+            if (cell->type == CELL_PIECE) {
+                color = cell->data.piece.color;
+            } else if (cell->type == CELL_EMERGE) {
+                color = cell->data.emerge.color;
+                struct BoardPos pos = MAKE_BOARD_POS(j, i);
+                column = emerge_get_mouth(&cell->data.emerge, pos).x;
+                // one that points off the board never lets its piece out
+                if (column < 0 || column >= BOARD_WIDTH)
+                    continue;
+            } else {
+                continue;
+            }
+            if (!used[color]) {
+                used[color] = true;
+                columns[color] = 0;
+            }
+            columns[color] |= (uint64_t)1 << column;
+        }
+    }
+
+    int widest_gap = 0;
+    for (int color = 0; color <= INT8_MAX; ++color) {
+        if (!used[color])
+            continue;
+        // walk the zero runs between the lowest and the highest set bit
+        uint64_t mask = columns[color] >> __builtin_ctzll(columns[color]);
+        while (mask != 0) {
+            mask >>= __builtin_ctzll(~mask);
+            if (mask == 0)
+                break;
+            int gap = __builtin_ctzll(mask);
+            if (gap > widest_gap)
+                widest_gap = gap;
+            mask >>= gap;
+        }
+    }
+
+    if (widest_gap == 0 && !game_is_solved(game))
+        return 1;
+    return widest_gap;
+}
+
+static inline uint8_t *node_key(const struct Solver *solver, uint32_t node) {
+    return solver->keys + (size_t)node * solver->key_size;
+}
+
+static inline bool node_closed(const struct Solver *solver, uint32_t node) {
+    return (solver->closed[node / 64] >> (node % 64)) & 1;
+}
+
+static inline void node_close(struct Solver *solver, uint32_t node) {
+    solver->closed[node / 64] |= (uint64_t)1 << (node % 64);
+}
+
+static bool reserve_nodes(struct Solver *solver, size_t count) {
+    if (count > solver->max_nodes)
+        return false;
+    if (count <= solver->node_cap)
+        return true;
+
+    size_t cap = solver->node_cap ? solver->node_cap : 256;
+    while (cap < count)
+        cap *= 2;
+    if (cap > solver->max_nodes)
+        cap = solver->max_nodes;
+    if (cap < count)
+        return false;
+
+    struct SolverNode *nodes = bigmem_realloc(
+        solver->nodes, cap * sizeof(struct SolverNode), &solver->memory,
+        &solver->stats.memory_modes);
+    if (nodes == NULL)
+        return false;
+    solver->nodes = nodes;
+
+    size_t old_words = (solver->node_cap + 63) / 64;
+    size_t words = (cap + 63) / 64;
+    uint64_t *closed = bigmem_realloc(
+        solver->closed, words * sizeof(uint64_t), &solver->memory,
+        &solver->stats.memory_modes);
+    if (closed == NULL)
+        return false;
+    memset(closed + old_words, 0, (words - old_words) * sizeof(uint64_t));
+    solver->closed = closed;
+
+    if (cap * solver->key_size > solver->keys_cap) {
+        uint8_t *keys = bigmem_realloc(
+            solver->keys, cap * solver->key_size, &solver->memory,
+            &solver->stats.memory_modes);
+        if (keys == NULL)
+            return false;
+        solver->keys = keys;
+        solver->keys_cap = cap * solver->key_size;
+    }
+
+    solver->node_cap = cap;
+    return true;
+}
+
+static void
+    table_insert(struct Solver *solver, uint32_t node, uint64_t hash) {
+    uint32_t slot = hash & solver->table_mask;
+    while (solver->table[slot] != NODE_NONE)
+        slot = (slot + 1) & solver->table_mask;
+    solver->table[slot] = node;
+}
+
+// keeps the load factor under 1/2
+static bool table_reserve(struct Solver *solver, size_t count) {
+    size_t size = (size_t)solver->table_mask + 1;
+    if (solver->table != NULL && count * 2 <= size)
+        return true;
+
+    while (count * 2 > size)
+        size *= 2;
+
+    uint32_t *table = bigmem_alloc(
+        size * sizeof(uint32_t), &solver->memory, &solver->stats.memory_modes);
+    if (table == NULL)
+        return false;
+    memset(table, 0xff, size * sizeof(uint32_t));
+
+    bigmem_free(solver->table);
+    solver->table = table;
+    solver->table_mask = size - 1;
+    // the hashes aren't stored, keys are short enough to hash them again
+    for (uint32_t i = 0; i < solver->node_count; ++i)
+        table_insert(
+            solver, i, hash_bytes(node_key(solver, i), solver->key_size));
+    return true;
+}
+
+static uint32_t
+    table_find(const struct Solver *solver, const uint8_t *key, uint64_t hash) {
+    uint32_t slot = hash & solver->table_mask;
+    for (;;) {
+        uint32_t node = solver->table[slot];
+        if (node == NODE_NONE)
+            return NODE_NONE;
+        if (memcmp(node_key(solver, node), key, solver->key_size) == 0)
+            return node;
+        slot = (slot + 1) & solver->table_mask;
+    }
+}
+
+// bucket of a node at g moves from the root with the given state
+static inline int
+    node_f(const struct Solver *solver, int g, const struct GameState *state) {
+    return solver->mode == SOLVER_MODE_ASTAR ? g + solver_heuristic(state) : g;
+}
+
+static bool bucket_push(struct Solver *solver, uint32_t node, int f) {
+    if (f >= solver->bucket_count) {
+        int count = solver->bucket_count ? solver->bucket_count : 16;
+        while (count <= f)
+            count *= 2;
+        struct SolverBucket *buckets =
+            realloc(solver->buckets, count * sizeof(struct SolverBucket));
+        if (buckets == NULL)
+            return false;
+        memset(
+            buckets + solver->bucket_count, 0,
+            (count - solver->bucket_count) * sizeof(struct SolverBucket));
+        solver->buckets = buckets;
+        solver->bucket_count = count;
+    }
+
+    struct SolverBucket *bucket = &solver->buckets[f];
+    if (bucket->count == bucket->cap) {
+        uint32_t cap = bucket->cap ? bucket->cap * 2 : 64;
+        uint32_t *items = bigmem_realloc(
+            bucket->items, cap * sizeof(uint32_t), &solver->memory,
+            &solver->stats.memory_modes);
+        if (items == NULL)
+            return false;
+        bucket->items = items;
+        bucket->cap = cap;
+    }
+    bucket->items[bucket->count++] = node;
+    return true;
+}
+
+// returns NODE_NONE once every bucket is empty
+static uint32_t bucket_pop(struct Solver *solver) {
+    while (solver->min_bucket < solver->bucket_count) {
+        struct SolverBucket *bucket = &solver->buckets[solver->min_bucket];
+        if (bucket->count > 0)
+            return bucket->items[--bucket->count];
+        ++solver->min_bucket;
+    }
+    return NODE_NONE;
+}
+
+// the caller has to reserve room for the node first
+static uint32_t add_node(
+    struct Solver *solver,
+    const uint8_t *key,
+    uint64_t hash,
+    uint32_t parent,
+    blockidx_t block,
+    MoveBlockDir dir,
+    int steps,
+    bool mirrored) {
+    uint32_t node = solver->node_count++;
+    solver->nodes[node] = (struct SolverNode){
+        .parent = parent,
+        .g = parent == NODE_NONE ? 0 : solver->nodes[parent].g + steps,
+        .block = block,
+        .dir = dir,
+        .steps = steps,
+        .mirrored = mirrored,
+    };
+    memcpy(node_key(solver, node), key, solver->key_size);
+    table_insert(solver, node, hash);
+    count_layer(solver, solver->nodes[node].g, 1);
+    return node;
+}
+
+// for the modes that only store the solution path as nodes
+static uint32_t add_path_node(
+    struct Solver *solver,
+    const struct GameState *state,
+    uint32_t parent,
+    blockidx_t block,
+    MoveBlockDir dir) {
+    uint8_t key[BOARD_WIDTH * BOARD_HEIGHT];
+    bool mirrored = state_pack_canonical(&solver->packer, state, key);
+    uint64_t hash = hash_bytes(key, solver->key_size);
+    return add_node(
+        solver, key, hash, parent, block, dir, parent != NODE_NONE, mirrored);
+}
+
+// the block to move next to slide on after moving `block` from `state` to
+// `next`, or -1 where the slide ends: a slide goes on as long as the block
+// just shifted by a cell, without falling or merging with another one
+static int slide_block(
+    const struct GameState *state,
+    struct GameState *next,
+    blockidx_t block,
+    MoveBlockDir dir) {
+    if (next->block_count != state->block_count)
+        return -1;
+    struct BoardPos pos = state->blocks[block].pos;
+    pos.x += dir == MOVE_BLOCK_RIGHT ? 1 : -1;
+    const struct Cell *cell = game_get_pos(next, pos);
+    if (cell->type != CELL_PIECE)
+        return -1;
+    blockidx_t moved = cell->data.piece.block;
+    struct BoardPos moved_pos = next->blocks[moved].pos;
+    if (moved_pos.x != pos.x || moved_pos.y != pos.y)
+        return -1;
+    return moved;
+}
+
+static bool build_solution(struct Solver *solver, uint32_t goal) {
+    int length = solver->nodes[goal].g;
+
+    if (length + 1 > solver->path_cap) {
+        uint32_t *path =
+            realloc(solver->path, (length + 1) * sizeof(uint32_t));
+        if (path == NULL)
+            return false;
+        solver->path = path;
+        uint8_t *path_keys = realloc(
+            solver->path_keys,
+            (length + 1) * (size_t)(BOARD_WIDTH * BOARD_HEIGHT));
+        if (path_keys == NULL)
+            return false;
+        solver->path_keys = path_keys;
+        struct SolverMove *solution =
+            realloc(solver->solution, (length + 1) * sizeof(struct SolverMove));
+        if (solution == NULL)
+            return false;
+        solver->solution = solution;
+        solver->path_cap = length + 1;
+    }
+
+    // a node can be more than a move away from its parent, see macro_moves
+    int edges = 0;
+    for (uint32_t node = goal; solver->nodes[node].parent != NODE_NONE;
+         node = solver->nodes[node].parent)
+        ++edges;
+    uint32_t node = goal;
+    for (int i = edges; i >= 0; --i) {
+        solver->path[i] = node;
+        node = solver->nodes[node].parent;
+    }
+
+    // block indices are canonical, so replaying the moves reproduces the
+    // states they were recorded in, or their mirror images; mirrored tracks
+    // whether the state played is the mirror image of the node's key; slides
+    // are followed on the unmirrored states, like they were generated
+    _Alignas(struct GameState) uint8_t bufs[4][GAME_STATE_MAX_SIZE];
+    struct GameState *state = (struct GameState *)bufs[0];
+    struct GameState *next_state = (struct GameState *)bufs[1];
+    struct GameState *key_state = (struct GameState *)bufs[2];
+    struct GameState *key_next = (struct GameState *)bufs[3];
+    memcpy(state, solver->root, game_get_size(solver->root));
+    bool mirrored = solver->nodes[0].mirrored;
+
+    double h_quality = 0;
+    int move = 0;
+    for (int i = 0; i < edges; ++i) {
+        const struct SolverNode *next = &solver->nodes[solver->path[i + 1]];
+        int block = next->block;
+        if (mirrored)
+            state_unpack(
+                &solver->packer, node_key(solver, solver->path[i]), key_state);
+        for (int step = 0; step < next->steps; ++step) {
+            int played = block;
+            MoveBlockDir dir = next->dir;
+            if (mirrored) {
+                struct BoardPos pos = key_state->blocks[block].pos;
+                pos.x = solver->packer.mirror_sum - pos.x;
+                played = game_get_pos(state, pos)->data.piece.block;
+                dir = DIR_OPPOSITE(dir);
+            }
+
+            solver->solution[move] = (struct SolverMove){
+                .pos = state->blocks[played].pos,
+                .block = played,
+                .dir = dir,
+            };
+            state_pack(
+                &solver->packer, state,
+                solver->path_keys + move * solver->key_size);
+            h_quality += (double)solver_heuristic(state) / (length - move);
+            ++move;
+            if (!game_do_move(state, played, dir, next_state))
+                return false;
+            struct GameState *tmp = state;
+            state = next_state;
+            next_state = tmp;
+            if (step + 1 == next->steps)
+                break;
+
+            if (mirrored) {
+                if (!game_do_move(key_state, block, next->dir, key_next))
+                    return false;
+                block = slide_block(key_state, key_next, block, next->dir);
+                tmp = key_state;
+                key_state = key_next;
+                key_next = tmp;
+            } else {
+                block = slide_block(next_state, state, block, next->dir);
+            }
+            if (block < 0)
+                return false;
+        }
+        mirrored ^= next->mirrored;
+    }
+    state_pack(
+        &solver->packer, state, solver->path_keys + length * solver->key_size);
+    solver->solution_length = length;
+
+    solver->stats.depth = length;
+    if (solver->mode != SOLVER_MODE_BFS &&
+        solver->mode != SOLVER_MODE_EXTERNAL)
+        solver->stats.h_quality = length > 0 ? h_quality / length : 1;
+    return true;
+}
+
+static void finish_solved(struct Solver *solver, uint32_t goal) {
+    solver->status =
+        build_solution(solver, goal) ? SOLVER_SOLVED : SOLVER_LIMIT;
+}
+
+static uint64_t memory_held(const struct Solver *solver) {
+    uint64_t bytes = solver->node_cap * sizeof(struct SolverNode) +
+                     solver->keys_cap +
+                     (solver->node_cap + 63) / 64 * sizeof(uint64_t);
+    if (solver->table != NULL)
+        bytes += ((uint64_t)solver->table_mask + 1) * sizeof(uint32_t);
+    bytes += solver->bucket_count * sizeof(struct SolverBucket);
+    for (int i = 0; i < solver->bucket_count; ++i)
+        bytes += solver->buckets[i].cap * sizeof(uint32_t);
+    bytes += solver->ida_frame_cap *
+             (sizeof(struct IdaFrame) + (uint64_t)solver->state_size);
+    if (solver->ida_cache != NULL)
+        bytes += (solver->ida_cache_mask + 1) * sizeof(struct IdaCacheEntry);
+    bytes += solver->ida_cache_keys_cap;
+    if (solver->ext != NULL)
+        bytes += ext_search_memory(solver->ext);
+    return bytes;
+}
+
+// copies the progress of the search to the telemetry, then calls on_snapshot
+// if a snapshot is due
+static void publish_telemetry(struct Solver *solver) {
+    struct SolverTelemetry *telemetry = solver->telemetry;
+    double now = wall_seconds();
+
+    uint64_t open = 0;
+    uint64_t entries = 0;
+    uint64_t capacity = 0;
+    switch (solver->mode) {
+    case SOLVER_MODE_BFS:
+    case SOLVER_MODE_ASTAR:
+        entries = solver->node_count;
+        capacity = (uint64_t)solver->table_mask + 1;
+        if (!solver->by_cost)
+            open = solver->node_count - solver->head;
+        for (int i = solver->min_bucket; i < solver->bucket_count; ++i)
+            open += solver->buckets[i].count;
+        break;
+    case SOLVER_MODE_IDA:
+        open = solver->ida_top + 1;
+        entries = solver->ida_cache_used;
+        capacity = solver->ida_cache_mask + 1;
+        break;
+    }
+
+    TELEMETRY_STORE(telemetry->status, (uint64_t)solver->status);
+    TELEMETRY_STORE(telemetry->expanded, solver->stats.expanded);
+    TELEMETRY_STORE(telemetry->generated, solver->stats.generated);
+    TELEMETRY_STORE(telemetry->duplicates, solver->stats.duplicates);
+    TELEMETRY_STORE(telemetry->pruned, solver->stats.pruned);
+    TELEMETRY_STORE(telemetry->depth, (uint64_t)solver->stats.depth);
+    TELEMETRY_STORE(telemetry->open, open);
+    // the external search only stores the solution path in the nodes
+    bool layers = solver->mode != SOLVER_MODE_EXTERNAL;
+    for (int i = 0; i < SOLVER_TELEMETRY_LAYERS; ++i)
+        TELEMETRY_STORE(telemetry->layers[i], layers ? solver->layers[i] : 0);
+    TELEMETRY_STORE(telemetry->memory, memory_held(solver));
+    TELEMETRY_STORE(telemetry->table_entries, entries);
+    TELEMETRY_STORE(telemetry->table_capacity, capacity);
+    TELEMETRY_STORE(
+        telemetry->elapsed_ns, (uint64_t)((now - solver->started) * 1e9));
+
+    if (solver->on_snapshot == NULL)
+        return;
+    unsigned requests = TELEMETRY_LOAD(g_snapshot_requests);
+    bool due = requests != solver->snapshot_requests ||
+               (solver->snapshot_interval > 0 && now >= solver->next_snapshot);
+    if (!due)
+        return;
+    solver->snapshot_requests = requests;
+    solver->next_snapshot = now + solver->snapshot_interval;
+    struct SolverSnapshot snapshot;
+    solver_telemetry_snapshot(telemetry, &snapshot);
+    solver->on_snapshot(&snapshot, solver->snapshot_data);
+}
+
+// merges only ever reduce the block count, but every emerge cell releases a
+// piece as a new block once, so the root with a block for each of its emerge
+// cells is as big as any reachable state gets
+static size_t max_state_size(const struct GameState *root) {
+    size_t blocks = root->block_count;
+    for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
+        for (board_coord_t j = 0; j < BOARD_WIDTH; ++j)
+            blocks += root->board[i][j].type == CELL_EMERGE;
+    }
+    return offsetof(struct GameState, blocks) + blocks * sizeof(struct Block);
+}
+
+// sets up a search in a new or a reused solver; buffers keep their capacity
+static bool solver_start(
+    struct Solver *solver,
+    const struct GameState *root,
+    const struct SolverOptions *options) {
+    solver->mode = options->mode;
+    solver->status = SOLVER_RUNNING;
+    solver->stats = (struct SolverStats){
+        .memory_modes = solver->stats.memory_modes,
+    };
+    solver->memory = options->memory;
+    memset(solver->layers, 0, sizeof(solver->layers));
+    solver->telemetry = options->telemetry;
+    if (solver->telemetry == NULL && options->on_snapshot != NULL)
+        solver->telemetry = &solver->own_telemetry;
+    solver->on_snapshot = options->on_snapshot;
+    solver->snapshot_data = options->snapshot_data;
+    solver->snapshot_interval = options->snapshot_interval;
+    solver->started = wall_seconds();
+    solver->next_snapshot = solver->started + options->snapshot_interval;
+    solver->snapshot_requests = TELEMETRY_LOAD(g_snapshot_requests);
+    // node indices have to fit next to NODE_NONE
+    solver->max_nodes = options->max_nodes;
+    // only the solution path is stored in memory by the external search
+    if (solver->mode == SOLVER_MODE_EXTERNAL ||
+        solver->max_nodes >= NODE_NONE)
+        solver->max_nodes = NODE_NONE - 1;
+    // rounded up so that every stored state is properly aligned
+    size_t align = _Alignof(struct GameState);
+    size_t state_size = (max_state_size(root) + align - 1) / align * align;
+    if (state_size != solver->state_size) {
+        // frames are state_size apart
+        solver->ida_frame_cap = 0;
+        solver->state_size = state_size;
+    }
+
+    if (!state_packer_init(&solver->packer, root))
+        return false;
+    // the other modes don't go through the node table for every state
+    if (options->symmetry && (solver->mode == SOLVER_MODE_BFS ||
+                              solver->mode == SOLVER_MODE_ASTAR))
+        state_packer_init_mirror(&solver->packer);
+    solver->key_size = solver->packer.packed_size;
+
+    // forget the nodes of the previous search; the node capacity is cut down
+    // to what the keys have room for at the new key size
+    solver->node_count = 0;
+    solver->head = 0;
+    solver->solution_length = 0;
+    if (solver->node_cap > solver->keys_cap / solver->key_size)
+        solver->node_cap = solver->keys_cap / solver->key_size;
+    if (solver->closed != NULL)
+        memset(
+            solver->closed, 0, (solver->node_cap + 63) / 64 * sizeof(uint64_t));
+    if (solver->table != NULL)
+        memset(
+            solver->table, 0xff,
+            ((size_t)solver->table_mask + 1) * sizeof(uint32_t));
+    for (int i = 0; i < solver->bucket_count; ++i)
+        solver->buckets[i].count = 0;
+    solver->min_bucket = 0;
+    ext_search_free(&solver->ext);
+
+    // IDA* hashes full states, which covers the zeroed padding as well
+    if (solver->root == NULL)
+        solver->root = malloc(GAME_STATE_MAX_SIZE);
+    if (solver->root == NULL || !reserve_nodes(solver, 1) ||
+        !table_reserve(solver, 1))
+        return false;
+    memset(solver->root, 0, solver->state_size);
+    memcpy(solver->root, root, game_get_size(root));
+    solver->root_hash = hash_bytes(solver->root, solver->state_size);
+    add_path_node(solver, root, NODE_NONE, 0, MOVE_BLOCK_NONE);
+
+    solver->prune = !options->no_pruning;
+    solver->macro_moves =
+        options->macro_moves && (solver->mode == SOLVER_MODE_BFS ||
+                                 solver->mode == SOLVER_MODE_ASTAR);
+    solver->by_cost = solver->mode == SOLVER_MODE_ASTAR || solver->macro_moves;
+    solver->stats.h_root = solver_heuristic(root);
+    if (solver->by_cost) {
+        solver->stats.depth = node_f(solver, 0, root);
+        if (!bucket_push(solver, 0, solver->stats.depth))
+            return false;
+    } else if (solver->mode == SOLVER_MODE_IDA) {
+        size_t cache_size = 1;
+        size_t requested = options->ida_cache_size ? options->ida_cache_size
+                                                   : IDA_DEFAULT_CACHE_SIZE;
+        while (cache_size < requested)
+            cache_size *= 2;
+        // entries of a previous search would be taken for this one's
+        if (solver->ida_cache != NULL &&
+            cache_size == solver->ida_cache_mask + 1) {
+            memset(
+                solver->ida_cache, 0,
+                cache_size * sizeof(struct IdaCacheEntry));
+        } else {
+            bigmem_free(solver->ida_cache);
+            solver->ida_cache = bigmem_alloc(
+                cache_size * sizeof(struct IdaCacheEntry), &solver->memory,
+                &solver->stats.memory_modes);
+            if (solver->ida_cache == NULL)
+                return false;
+            memset(
+                solver->ida_cache, 0,
+                cache_size * sizeof(struct IdaCacheEntry));
+            solver->ida_cache_mask = cache_size - 1;
+        }
+        // the entries are all stale, so the keys needn't be cleared
+        if (cache_size * solver->key_size > solver->ida_cache_keys_cap) {
+            bigmem_free(solver->ida_cache_keys);
+            solver->ida_cache_keys_cap = 0;
+            solver->ida_cache_keys = bigmem_alloc(
+                cache_size * solver->key_size, &solver->memory,
+                &solver->stats.memory_modes);
+            if (solver->ida_cache_keys == NULL)
+                return false;
+            solver->ida_cache_keys_cap = cache_size * solver->key_size;
+        }
+        solver->ida_iteration = 0;
+        solver->ida_top = -1;
+        solver->ida_bound = solver->stats.h_root;
+        solver->stats.depth = solver->stats.h_root;
+    } else if (solver->mode == SOLVER_MODE_EXTERNAL) {
+        solver->ext = ext_search_new(
+            root, options->ext_dir, options->ext_memory, solver->prune,
+            &solver->stats);
+        if (solver->ext == NULL)
+            return false;
+    }
+
+    if (game_is_solved(root)) {
+        finish_solved(solver, 0);
+        if (solver->status != SOLVER_SOLVED)
+            return false;
+    } else if (solver->prune && game_is_dead(root)) {
+        solver->status = SOLVER_UNSOLVABLE;
+    }
+    if (solver->telemetry != NULL)
+        publish_telemetry(solver);
+    return true;
+}
+
+struct Solver *solver_new(
+    const struct GameState *root, const struct SolverOptions *options) {
+    struct Solver *solver = calloc(1, sizeof(struct Solver));
+    if (solver == NULL)
+        return NULL;
+    if (!solver_start(solver, root, options))
+        solver_free(&solver);
+    return solver;
+}
+
+bool solver_reset(
+    struct Solver *solver,
+    const struct GameState *root,
+    const struct SolverOptions *options) {
+    if (solver_start(solver, root, options))
+        return true;
+    solver->status = SOLVER_LIMIT;
+    return false;
+}
+
+void solver_free(struct Solver **solver) {
+    if (*solver == NULL)
+        return;
+    for (int i = 0; i < (*solver)->bucket_count; ++i)
+        bigmem_free((*solver)->buckets[i].items);
+    free((*solver)->buckets);
+    free((*solver)->ida_frames);
+    free((*solver)->ida_states);
+    bigmem_free((*solver)->ida_cache);
+    bigmem_free((*solver)->ida_cache_keys);
+    ext_search_free(&(*solver)->ext);
+    free((*solver)->root);
+    bigmem_free((*solver)->nodes);
+    bigmem_free((*solver)->keys);
+    bigmem_free((*solver)->closed);
+    bigmem_free((*solver)->table);
+    free((*solver)->path);
+    free((*solver)->path_keys);
+    free((*solver)->solution);
+    free(*solver);
+    *solver = NULL;
+}
+
+// stores a successor of a node, `steps` moves of `block` in `dir` away;
+// returns it if it is solved and the search can stop there, NODE_NONE
+// otherwise (the status tells failures apart)
+static uint32_t add_successor(
+    struct Solver *solver,
+    uint32_t node,
+    const struct GameState *next,
+    blockidx_t block,
+    MoveBlockDir dir,
+    int steps) {
+    uint8_t key[BOARD_WIDTH * BOARD_HEIGHT];
+    ++solver->stats.generated;
+
+    bool mirrored = state_pack_canonical(&solver->packer, next, key);
+    uint64_t hash = hash_bytes(key, solver->key_size);
+    int g = solver->nodes[node].g + steps;
+
+    uint32_t found = table_find(solver, key, hash);
+    if (found != NODE_NONE) {
+        ++solver->stats.duplicates;
+        // with a consistent heuristic a shorter path can only be found to
+        // nodes that are still open
+        struct SolverNode *dup = &solver->nodes[found];
+        if (solver->by_cost && g < dup->g) {
+            count_layer(solver, dup->g, -1);
+            count_layer(solver, g, 1);
+            dup->parent = node;
+            dup->g = g;
+            dup->block = block;
+            dup->dir = dir;
+            dup->steps = steps;
+            dup->mirrored = mirrored;
+            if (!bucket_push(solver, found, node_f(solver, g, next)))
+                solver->status = SOLVER_LIMIT;
+        }
+        return NODE_NONE;
+    }
+
+    // only new states are tested, stored ones passed already; dead states
+    // aren't stored, so they are tested again when reached again, which is
+    // still cheaper than testing every duplicate
+    if (solver->prune && game_is_dead(next)) {
+        ++solver->stats.pruned;
+        return NODE_NONE;
+    }
+
+    uint32_t child =
+        add_node(solver, key, hash, node, block, dir, steps, mirrored);
+    // testing on generation is fine for A* as well: the parent isn't solved,
+    // so its f is at least the child's g if the child is a move away, and it
+    // was the smallest f in the queue; a longer slide can overshoot that, so
+    // its goal is queued and taken once expanded
+    if (game_is_solved(next) && (!solver->by_cost || steps == 1))
+        return child;
+
+    if (solver->by_cost &&
+        !bucket_push(solver, child, node_f(solver, g, next)))
+        solver->status = SOLVER_LIMIT;
+    return NODE_NONE;
+}
+
+// stores the successors of a node that start with the moves of a batch of
+// lanes, made on its state at once; returns like expand_node
+static uint32_t expand_lanes(
+    struct Solver *solver,
+    uint32_t node,
+    struct GameState *state,
+    const blockidx_t *blocks,
+    const MoveBlockDir *dirs,
+    int count) {
+    _Alignas(struct GameState) uint8_t bufs[2][GAME_STATE_MAX_SIZE];
+    struct GameState *dests[GAME_LANES];
+    for (int lane = 0; lane < GAME_LANES; ++lane)
+        dests[lane] = (struct GameState *)solver->lanes[lane];
+    uint32_t legal_lanes = game_do_moves(
+        state, &solver->legal, blocks, dirs, count, dests);
+
+    for (int lane = 0; lane < count; ++lane) {
+        if (!(legal_lanes >> lane & 1))
+            continue;
+
+        // every step of a slide is a plain move, the states in between
+        // being successors too, so the slide plays out as it would one move
+        // at a time
+        struct GameState *from = state;
+        struct GameState *next = dests[lane];
+        int moved = blocks[lane];
+        for (int steps = 1;; ++steps) {
+            uint32_t goal = add_successor(
+                solver, node, next, blocks[lane], dirs[lane], steps);
+            if (goal != NODE_NONE || solver->status != SOLVER_RUNNING)
+                return goal;
+            if (!solver->macro_moves || steps == MACRO_MAX_STEPS)
+                break;
+            moved = slide_block(from, next, moved, dirs[lane]);
+            if (moved < 0)
+                break;
+            from = next;
+            next = (struct GameState *)bufs[steps % 2];
+            if (!game_do_move(from, moved, dirs[lane], next))
+                break;
+        }
+    }
+    return NODE_NONE;
+}
+
+// generates the successors of a node, returns the goal node if one of them is
+// solved, NODE_NONE otherwise (the status tells failures apart)
+static uint32_t expand_node(struct Solver *solver, uint32_t node) {
+    _Alignas(struct GameState) uint8_t state_buf[GAME_STATE_MAX_SIZE];
+    struct GameState *state = (struct GameState *)state_buf;
+
+    node_close(solver, node);
+    ++solver->stats.expanded;
+
+    state_unpack(&solver->packer, node_key(solver, node), state);
+    // only goals that were reached by sliding are ever queued
+    if (solver->macro_moves && game_is_solved(state))
+        return node;
+    // reserve space for every possible successor up front, so that a failed
+    // allocation can't leave the expansion half done
+    int block_count = state->block_count;
+    size_t needed = solver->node_count + 2 * (size_t)block_count *
+                                             (solver->macro_moves
+                                                  ? MACRO_MAX_STEPS
+                                                  : 1);
+    if (!reserve_nodes(solver, needed) || !table_reserve(solver, needed)) {
+        solver->status = SOLVER_LIMIT;
+        return NODE_NONE;
+    }
+    // finding the blocked moves up front is cheaper than letting game_do_move
+    // fail on them one by one, and it finds the blocks every move pushes for
+    // game_do_moves as well
+    game_get_legal_moves(state, &solver->legal);
+
+    blockidx_t blocks[GAME_LANES];
+    MoveBlockDir dirs[GAME_LANES];
+    int lanes = 0;
+    for (blockidx_t block = 0; block < block_count; ++block) {
+        for (MoveBlockDir dir = MOVE_BLOCK_LEFT; dir <= MOVE_BLOCK_RIGHT;
+             ++dir) {
+            if (!block_set_has(&solver->legal.movable[dir], block))
+                continue;
+            blocks[lanes] = block;
+            dirs[lanes] = dir;
+            if (++lanes < GAME_LANES)
+                continue;
+
+            uint32_t goal =
+                expand_lanes(solver, node, state, blocks, dirs, lanes);
+            if (goal != NODE_NONE || solver->status != SOLVER_RUNNING)
+                return goal;
+            lanes = 0;
+        }
+    }
+    if (lanes > 0)
+        return expand_lanes(solver, node, state, blocks, dirs, lanes);
+    return NODE_NONE;
+}
+
+static void bfs_step(struct Solver *solver, size_t budget) {
+    for (; budget > 0 && solver->status == SOLVER_RUNNING; --budget) {
+        if (solver->head == solver->node_count) {
+            solver->status = SOLVER_UNSOLVABLE;
+            return;
+        }
+
+        uint32_t node = solver->head++;
+        solver->stats.depth = solver->nodes[node].g;
+        uint32_t goal = expand_node(solver, node);
+        if (goal != NODE_NONE)
+            finish_solved(solver, goal);
+    }
+}
+
+static void astar_step(struct Solver *solver, size_t budget) {
+    while (budget > 0 && solver->status == SOLVER_RUNNING) {
+        uint32_t node = bucket_pop(solver);
+        if (node == NODE_NONE) {
+            solver->status = SOLVER_UNSOLVABLE;
+            return;
+        }
+        // stale entry left behind by a shorter path to the same node
+        if (node_closed(solver, node))
+            continue;
+
+        --budget;
+        solver->stats.depth = solver->min_bucket;
+        uint32_t goal = expand_node(solver, node);
+        if (goal != NODE_NONE)
+            finish_solved(solver, goal);
+    }
+}
+
+static inline struct GameState *
+    ida_state(const struct Solver *solver, int depth) {
+    return (struct GameState *)(solver->ida_states +
+                                (size_t)depth * solver->state_size);
+}
+
+static void ida_init_frame(
+    struct Solver *solver,
+    int depth,
+    uint64_t hash,
+    blockidx_t block,
+    MoveBlockDir dir) {
+    struct IdaFrame *frame = &solver->ida_frames[depth];
+    game_get_legal_moves(ida_state(solver, depth), &solver->legal);
+    memcpy(frame->movable, solver->legal.movable, sizeof(frame->movable));
+    frame->hash = hash;
+    frame->next_move = 0;
+    frame->block = block;
+    frame->dir = dir;
+}
+
+// sets up the stack for an iteration with the current threshold; this is the
+// only place the IDA* buffers get (re)allocated
+static bool ida_begin_iteration(struct Solver *solver) {
+    // pushed states are not solved, so their g is below the threshold; the
+    // deepest child written is at depth ida_bound
+    int frames = solver->ida_bound + 1;
+    if (frames > solver->ida_frame_cap) {
+        struct IdaFrame *ida_frames =
+            realloc(solver->ida_frames, frames * sizeof(struct IdaFrame));
+        if (ida_frames == NULL)
+            return false;
+        solver->ida_frames = ida_frames;
+
+        uint8_t *ida_states =
+            realloc(solver->ida_states, frames * solver->state_size);
+        if (ida_states == NULL)
+            return false;
+        solver->ida_states = ida_states;
+
+        solver->ida_frame_cap = frames;
+    }
+
+    ++solver->ida_iteration;
+    solver->ida_cache_used = 0;
+    memset(solver->layers, 0, sizeof(solver->layers));
+    count_layer(solver, 0, 1);
+    solver->ida_next_bound = INT32_MAX;
+    memcpy(ida_state(solver, 0), solver->root, solver->state_size);
+    ida_init_frame(solver, 0, solver->root_hash, 0, MOVE_BLOCK_NONE);
+    solver->ida_top = 0;
+    ++solver->stats.expanded;
+    return true;
+}
+
+// whether the state at depth was already seen along the current path
+static bool ida_on_path(const struct Solver *solver, int depth, uint64_t hash) {
+    const struct GameState *state = ida_state(solver, depth);
+    for (int i = 0; i < depth; ++i) {
+        if (solver->ida_frames[i].hash == hash &&
+            memcmp(ida_state(solver, i), state, solver->state_size) == 0)
+            return true;
+    }
+    return false;
+}
+
+// whether the state was already searched in this iteration with at least as
+// much of the threshold left; records it otherwise
+static bool ida_cache_hit(
+    struct Solver *solver,
+    const struct GameState *state,
+    uint64_t hash,
+    int g) {
+    uint64_t slot = hash & solver->ida_cache_mask;
+    struct IdaCacheEntry *entry = &solver->ida_cache[slot];
+    uint8_t *entry_key = solver->ida_cache_keys + slot * solver->key_size;
+    uint8_t key[BOARD_WIDTH * BOARD_HEIGHT];
+    state_pack(&solver->packer, state, key);
+    if (entry->hash == hash && entry->iteration == solver->ida_iteration &&
+        entry->g <= g && memcmp(entry_key, key, solver->key_size) == 0)
+        return true;
+    solver->ida_cache_used += entry->iteration != solver->ida_iteration;
+    *entry = (struct IdaCacheEntry){
+        .hash = hash,
+        .g = g,
+        .iteration = solver->ida_iteration,
+    };
+    memcpy(entry_key, key, solver->key_size);
+    return false;
+}
+
+// copies the current path to the node storage, so that the solution can be
+// built the same way as for the other modes
+static void ida_finish_solved(struct Solver *solver, int goal_depth) {
+    if (!reserve_nodes(solver, goal_depth + 1) ||
+        !table_reserve(solver, goal_depth + 1)) {
+        solver->status = SOLVER_LIMIT;
+        return;
+    }
+
+    uint32_t node = 0;
+    for (int i = 1; i <= goal_depth; ++i) {
+        const struct IdaFrame *frame = &solver->ida_frames[i];
+        node = add_path_node(
+            solver, ida_state(solver, i), node, frame->block, frame->dir);
+    }
+    finish_solved(solver, node);
+}
+
+static void ida_step(struct Solver *solver, size_t budget) {
+    while (budget > 0 && solver->status == SOLVER_RUNNING) {
+        if (solver->ida_top < 0) {
+            // the first iteration, or the previous one came up empty
+            if (solver->stats.expanded > 0) {
+                if (solver->ida_next_bound == INT32_MAX) {
+                    solver->status = SOLVER_UNSOLVABLE;
+                    return;
+                }
+                solver->ida_bound = solver->ida_next_bound;
+                solver->stats.depth = solver->ida_bound;
+            }
+            if (!ida_begin_iteration(solver)) {
+                solver->status = SOLVER_LIMIT;
+                return;
+            }
+            --budget;
+            continue;
+        }
+
+        int depth = solver->ida_top;
+        struct IdaFrame *frame = &solver->ida_frames[depth];
+        struct GameState *state = ida_state(solver, depth);
+
+        int move = frame->next_move;
+        int move_count = 2 * state->block_count;
+        while (move < move_count &&
+               !block_set_has(&frame->movable[move % 2], move / 2))
+            ++move;
+        if (move == move_count) {
+            --solver->ida_top;
+            continue;
+        }
+        frame->next_move = move + 1;
+
+        blockidx_t block = move / 2;
+        MoveBlockDir dir = move % 2;
+        struct GameState *child = ida_state(solver, depth + 1);
+        game_do_move(state, block, dir, child);
+        ++solver->stats.generated;
+
+        size_t size = game_get_size(child);
+        memset((uint8_t *)child + size, 0, solver->state_size - size);
+        uint64_t hash = hash_bytes(child, solver->state_size);
+        int g = depth + 1;
+
+        if (game_is_solved(child)) {
+            solver->ida_frames[g] = (struct IdaFrame){
+                .hash = hash,
+                .block = block,
+                .dir = dir,
+            };
+            ida_finish_solved(solver, g);
+            return;
+        }
+
+        int f = g + solver_heuristic(child);
+        if (f > solver->ida_bound) {
+            if (f < solver->ida_next_bound)
+                solver->ida_next_bound = f;
+            continue;
+        }
+
+        if (ida_on_path(solver, g, hash) ||
+            ida_cache_hit(solver, child, hash, g)) {
+            ++solver->stats.duplicates;
+            continue;
+        }
+
+        if (solver->prune && game_is_dead(child)) {
+            ++solver->stats.pruned;
+            continue;
+        }
+
+        ida_init_frame(solver, g, hash, block, dir);
+        solver->ida_top = g;
+        count_layer(solver, g, 1);
+        ++solver->stats.expanded;
+        --budget;
+    }
+}
+
+// the solution path is the only part of the search that gets to the node
+// storage, so that the solution can be built the same way as for the other
+// modes
+static void ext_finish_solved(struct Solver *solver) {
+    int length = ext_search_path_length(solver->ext);
+    if (!reserve_nodes(solver, length + 1) ||
+        !table_reserve(solver, length + 1)) {
+        solver->status = SOLVER_LIMIT;
+        return;
+    }
+
+    _Alignas(struct GameState) uint8_t buf[GAME_STATE_MAX_SIZE];
+    struct GameState *state = (struct GameState *)buf;
+    uint32_t node = 0;
+    for (int i = 1; i <= length; ++i) {
+        blockidx_t block;
+        MoveBlockDir dir;
+        ext_search_path_state(solver->ext, i, state, &block, &dir);
+        node = add_path_node(solver, state, node, block, dir);
+    }
+    finish_solved(solver, node);
+}
+
+static void ext_step(struct Solver *solver, size_t budget) {
+    if (solver->status != SOLVER_RUNNING)
+        return;
+    solver->status = ext_search_step(solver->ext, budget, &solver->stats);
+    if (solver->status == SOLVER_SOLVED)
+        ext_finish_solved(solver);
+}
+
+static void step_slice(struct Solver *solver, size_t budget) {
+    switch (solver->mode) {
+    case SOLVER_MODE_BFS:
+        if (solver->by_cost)
+            astar_step(solver, budget);
+        else
+            bfs_step(solver, budget);
+        break;
+    case SOLVER_MODE_ASTAR:
+        astar_step(solver, budget);
+        break;
+    case SOLVER_MODE_IDA:
+        ida_step(solver, budget);
+        break;
+    case SOLVER_MODE_EXTERNAL:
+        ext_step(solver, budget);
+        break;
+    }
+}
+
+SolverStatus solver_step(struct Solver *solver, size_t budget) {
+    if (solver->telemetry == NULL) {
+        step_slice(solver, budget);
+        return solver->status;
+    }
+
+    // the search runs in slices, so that it publishes regularly even when it
+    // is given everything at once
+    while (budget > 0 && solver->status == SOLVER_RUNNING) {
+        size_t slice = budget < SOLVER_TELEMETRY_PERIOD
+                           ? budget
+                           : SOLVER_TELEMETRY_PERIOD;
+        step_slice(solver, slice);
+        budget -= slice;
+        publish_telemetry(solver);
+    }
+    return solver->status;
+}
+
+void solver_telemetry_snapshot(
+    const struct SolverTelemetry *telemetry, struct SolverSnapshot *dest) {
+    dest->status = (SolverStatus)TELEMETRY_LOAD(telemetry->status);
+    dest->expanded = TELEMETRY_LOAD(telemetry->expanded);
+    dest->generated = TELEMETRY_LOAD(telemetry->generated);
+    dest->duplicates = TELEMETRY_LOAD(telemetry->duplicates);
+    dest->pruned = TELEMETRY_LOAD(telemetry->pruned);
+    dest->depth = (int)TELEMETRY_LOAD(telemetry->depth);
+    dest->open = TELEMETRY_LOAD(telemetry->open);
+    for (int i = 0; i < SOLVER_TELEMETRY_LAYERS; ++i)
+        dest->layers[i] = TELEMETRY_LOAD(telemetry->layers[i]);
+    dest->memory = TELEMETRY_LOAD(telemetry->memory);
+    dest->table_entries = TELEMETRY_LOAD(telemetry->table_entries);
+    dest->table_capacity = TELEMETRY_LOAD(telemetry->table_capacity);
+    dest->seconds = TELEMETRY_LOAD(telemetry->elapsed_ns) / 1e9;
+    dest->nodes_per_second =
+        dest->seconds > 0 ? dest->expanded / dest->seconds : 0;
+    dest->duplicate_rate =
+        dest->generated > 0 ? (double)dest->duplicates / dest->generated : 0;
+}
+
+void solver_request_snapshot(void) {
+#ifdef JNB_THREADING
+    atomic_fetch_add_explicit(&g_snapshot_requests, 1, memory_order_relaxed);
+#else
+    g_snapshot_requests = g_snapshot_requests + 1;
+#endif
+}
+
+SolverStatus solver_get_status(const struct Solver *solver) {
+    return solver->status;
+}
+
+const struct SolverStats *solver_get_stats(const struct Solver *solver) {
+    return &solver->stats;
+}
+
+const struct SolverMove *
+    solver_get_solution(const struct Solver *solver, int *length) {
+    if (solver->status != SOLVER_SOLVED)
+        return NULL;
+    *length = solver->solution_length;
+    return solver->solution;
+}
+
+int solver_find_on_path(
+    const struct Solver *solver, const struct GameState *state) {
+    if (solver->status != SOLVER_SOLVED)
+        return -1;
+
+    // packing is only meaningful for states of the same level
+    if (state->level != solver->packer.level)
+        return -1;
+
+    uint8_t key[BOARD_WIDTH * BOARD_HEIGHT];
+    state_pack(&solver->packer, state, key);
+    for (int i = 0; i <= solver->solution_length; ++i) {
+        const uint8_t *on_path = solver->path_keys + i * solver->key_size;
+        if (memcmp(on_path, key, solver->key_size) == 0)
+            return i;
+    }
+    return -1;
+}
+
+size_t solver_solution_to_string(
+    const struct SolverMove *moves, int length, char *dest, size_t size) {
+    size_t total = (size_t)length * 3;
+    for (int i = 0; i < length; ++i) {
+        char text[3] = {
+            'a' + moves[i].pos.x,
+            'a' + moves[i].pos.y,
+            moves[i].dir == MOVE_BLOCK_LEFT ? 'L' : 'R',
+        };
+        for (int j = 0; j < 3; ++j) {
+            size_t at = (size_t)i * 3 + j;
+            if (at + 1 < size)
+                dest[at] = text[j];
+        }
+    }
+    if (size > 0)
+        dest[total < size ? total : size - 1] = '\0';
+    return total;
+}
+
+int solver_solution_from_string(
+    const struct GameState *root,
+    const char *str,
+    struct SolverMove *dest,
+    int max_length) {
+    _Alignas(struct GameState) uint8_t bufs[2][GAME_STATE_MAX_SIZE];
+    struct GameState *state = (struct GameState *)bufs[0];
+    struct GameState *next = (struct GameState *)bufs[1];
+    memcpy(state, root, game_get_size(root));
+
+    size_t size = strlen(str);
+    if (size % 3 != 0 || size / 3 > (size_t)max_length)
+        return -1;
+
+    int length = size / 3;
+    for (int i = 0; i < length; ++i) {
+        const char *text = str + (size_t)i * 3;
+        if (text[0] < 'a' || text[0] >= 'a' + BOARD_WIDTH || text[1] < 'a' ||
+            text[1] >= 'a' + BOARD_HEIGHT || (text[2] != 'L' && text[2] != 'R'))
+            return -1;
+        struct BoardPos pos = MAKE_BOARD_POS(text[0] - 'a', text[1] - 'a');
+        MoveBlockDir dir = text[2] == 'L' ? MOVE_BLOCK_LEFT : MOVE_BLOCK_RIGHT;
+
+        const struct Cell *cell = game_get_pos(state, pos);
+        if (cell->type != CELL_PIECE)
+            return -1;
+        blockidx_t block = cell->data.piece.block;
+        if (!game_do_move(state, block, dir, next))
+            return -1;
+
+        dest[i] = (struct SolverMove){
+            .pos = pos,
+            .block = block,
+            .dir = dir,
+        };
+        struct GameState *tmp = state;
+        state = next;
+        next = tmp;
+    }
+    return length;
+}
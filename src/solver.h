@@ -0,0 +1,281 @@
+#pragma once
+
+#include "bigmem.h"
+#include "game.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum _SolverStatus {
+    SOLVER_RUNNING = 0,
+    SOLVER_SOLVED,
+    // the whole reachable state space was explored without finding a solution
+    SOLVER_UNSOLVABLE,
+    // the node limit was reached, or an allocation or a file operation failed
+    SOLVER_LIMIT
+};
+typedef int8_t SolverStatus;
+
+enum _SolverMode {
+    SOLVER_MODE_BFS = 0,
+    // best-first search ordered by moves made plus a lower bound on the moves
+    // left, see `solver_heuristic`
+    SOLVER_MODE_ASTAR,
+    // iterative deepening A*, memory linear in the solution length
+    SOLVER_MODE_IDA,
+    // breadth-first search with the layers kept on disk, see `ext_dir`
+    SOLVER_MODE_EXTERNAL
+};
+typedef int8_t SolverMode;
+
+// expansions between two publishes to the telemetry
+#define SOLVER_TELEMETRY_PERIOD 4096
+// depths the telemetry counts nodes for; deeper nodes count for the last one
+#define SOLVER_TELEMETRY_LAYERS 64
+
+#ifdef JNB_THREADING
+typedef _Atomic uint64_t telemetry_counter_t;
+#else
+typedef uint64_t telemetry_counter_t;
+#endif
+
+/// @brief Live counters of a search, for watching a long one from another
+/// thread. The search publishes into it every `SOLVER_TELEMETRY_PERIOD`
+/// expansions with relaxed atomic stores, so it never waits on a reader, and a
+/// reader gets each counter on its own rather than all of them from one
+/// moment. Read it with `solver_telemetry_snapshot`.
+struct SolverTelemetry {
+    telemetry_counter_t status;
+    telemetry_counter_t expanded;
+    telemetry_counter_t generated;
+    telemetry_counter_t duplicates;
+    telemetry_counter_t pruned;
+    telemetry_counter_t depth;
+    telemetry_counter_t open;
+    telemetry_counter_t layers[SOLVER_TELEMETRY_LAYERS];
+    telemetry_counter_t memory;
+    telemetry_counter_t table_entries;
+    telemetry_counter_t table_capacity;
+    telemetry_counter_t elapsed_ns;
+};
+
+/// @brief A reading of the telemetry, along with the rates derived from it.
+struct SolverSnapshot {
+    SolverStatus status;
+    uint64_t expanded;
+    uint64_t generated;
+    uint64_t duplicates;
+    uint64_t pruned;
+    /// @brief See `struct SolverStats`.
+    int depth;
+    /// @brief Nodes waiting to be expanded: the BFS queue, the A* buckets or
+    /// the IDA* path; 0 for the external search.
+    uint64_t open;
+    /// @brief Nodes by their distance from the root: the stored ones for BFS
+    /// and A*, the ones the current iteration reached for IDA*. Not kept by
+    /// the external search.
+    uint64_t layers[SOLVER_TELEMETRY_LAYERS];
+    /// @brief Bytes held by the node storage, the hash table, the open list,
+    /// the IDA* stack and cache and the buffer of the external search.
+    uint64_t memory;
+    /// @brief Entries in use and slots of the transposition table: the node
+    /// table for BFS and A*, the cache for IDA*, where only the entries of the
+    /// current iteration count.
+    uint64_t table_entries;
+    uint64_t table_capacity;
+    /// @brief Since the search started, as of the last publish.
+    double seconds;
+    /// @brief Expansions per second since the search started.
+    double nodes_per_second;
+    /// @brief Share of the generated states that were already known.
+    double duplicate_rate;
+};
+
+typedef void (*SolverSnapshotFn)(
+    const struct SolverSnapshot *snapshot, void *data);
+
+struct SolverOptions {
+    SolverMode mode;
+    /// @brief Upper bound for the number of stored states.
+    size_t max_nodes;
+    /// @brief Number of entries of the IDA* transposition cache, rounded up to
+    /// a power of 2; 0 picks the default. Entries keep the packed state, so
+    /// it never takes one state for another.
+    size_t ida_cache_size;
+    /// @brief Existing directory for the files of the external search. A
+    /// checkpoint is written there after every layer, and the search resumes
+    /// from it when started again on the same level; its node count isn't
+    /// limited by `max_nodes`.
+    const char *ext_dir;
+    /// @brief Bytes of RAM the external search buffers successors in before
+    /// sorting them to disk; 0 picks the default.
+    size_t ext_memory;
+    /// @brief Keep the states `game_is_dead` rejects, mostly for measuring
+    /// what the pruning saves.
+    bool no_pruning;
+    /// @brief Store a state and its left-right mirror image as one node, on
+    /// levels whose walls, emerge cells and fixed pieces are symmetric. The
+    /// solution is mapped back through the mirror. This pays off when the
+    /// pieces start out (nearly) symmetric: the states reachable from the
+    /// mirror image of the root are covered as well, which only costs nothing
+    /// when they are mostly reachable from the root too. BFS and A* only.
+    bool symmetry;
+    /// @brief Also generate the states a block reaches by sliding on in the
+    /// same direction, a move at a time, as successors of the state it starts
+    /// from, each at the cost of its moves. A slide stops where the block
+    /// falls, merges or is blocked. Since successors then differ in cost, BFS
+    /// expands nodes in order of their moves from the root, like A* with a
+    /// heuristic of 0, so both still find an optimal solution. The solution
+    /// is made of single moves either way. BFS and A* only.
+    bool macro_moves;
+    /// @brief Published to while searching if not `NULL`, see
+    /// `struct SolverTelemetry`; it is reset when the search starts.
+    struct SolverTelemetry *telemetry;
+    /// @brief Called from the searching thread with a snapshot of the
+    /// telemetry every `snapshot_interval` seconds, and at the next publish
+    /// after `solver_request_snapshot`; works without `telemetry` as well.
+    SolverSnapshotFn on_snapshot;
+    void *snapshot_data;
+    /// @brief 0 for snapshots on request only.
+    double snapshot_interval;
+    /// @brief How the node table, the hash table, the A* buckets and the IDA*
+    /// cache are allocated; huge pages and NUMA binding pay off for searches
+    /// of millions of nodes.
+    struct BigMemOptions memory;
+};
+
+/// @brief A single move of a solution. `block` is the index of the moved block
+/// in the state the move is applied to, `pos` is its top left corner there,
+/// which is also a valid argument for moving it through the web API.
+struct SolverMove {
+    struct BoardPos pos;
+    blockidx_t block;
+    MoveBlockDir dir;
+};
+
+struct SolverStats {
+    uint64_t expanded;
+    uint64_t generated;
+    uint64_t duplicates;
+    /// @brief Generated states dropped by `game_is_dead`.
+    uint64_t pruned;
+    /// @brief Lower bound for the solution length established so far: the
+    /// current layer for BFS and the external search, the smallest open f
+    /// value for A*, the current threshold for IDA*. BFS with `macro_moves`
+    /// counts the moves to the node it expands, which is no bound. The
+    /// solution length once solved.
+    int depth;
+    /// @brief Heuristic value of the root.
+    int h_root;
+    /// @brief Mean of h / (exact distance to the goal) over the states of the
+    /// solution path, 1 for a perfect heuristic. Only set once solved, 0 for
+    /// BFS and the external search.
+    double h_quality;
+    /// @brief How the structures of the search were allocated, see
+    /// `struct BigMemOptions`; a reused solver adds the ones of the memory it
+    /// kept.
+    BigMemMode memory_modes;
+};
+
+/// @brief Resumable search. The search state lives between calls, so it can be
+/// advanced in small slices.
+struct Solver;
+
+/// @brief Start a search from `root`. Nothing is expanded until `solver_step`
+/// is called.
+/// @param root Preprocessed game state; it is copied, so it can be discarded
+/// @param options
+/// @return `NULL` if memory allocation failed
+struct Solver *solver_new(
+    const struct GameState *root, const struct SolverOptions *options);
+
+/// @brief Start a new search with a solver that is done with its previous
+/// one. Its memory is reused, so a solver that is reset over and over stops
+/// allocating once it has grown to the largest search it served (external
+/// searches aside).
+/// @param solver
+/// @param root Preprocessed game state, of any level
+/// @param options
+/// @return `false` if memory allocation failed, which leaves the solver with
+/// `SOLVER_LIMIT`, to be reset again or freed
+bool solver_reset(
+    struct Solver *solver,
+    const struct GameState *root,
+    const struct SolverOptions *options);
+
+/// @brief Free and invalidate a solver.
+/// @param solver
+void solver_free(struct Solver **solver);
+
+/// @brief Expand at most `budget` nodes.
+/// @param solver
+/// @param budget Number of node expansions allowed for this call
+/// @return The status after the call; anything other than `SOLVER_RUNNING` is
+/// final
+SolverStatus solver_step(struct Solver *solver, size_t budget);
+
+SolverStatus solver_get_status(const struct Solver *solver);
+
+const struct SolverStats *solver_get_stats(const struct Solver *solver);
+
+/// @brief Read the telemetry of a search, from any thread.
+/// @param telemetry
+/// @param dest
+void solver_telemetry_snapshot(
+    const struct SolverTelemetry *telemetry, struct SolverSnapshot *dest);
+
+/// @brief Make every running search with an `on_snapshot` callback take a
+/// snapshot at its next publish. Async-signal-safe, so it can be called from a
+/// signal handler, like one for `SIGUSR1`.
+void solver_request_snapshot(void);
+
+/// @brief Get the solution found by the search.
+/// @param solver
+/// @param length Written with the number of moves
+/// @return The moves, in order, or `NULL` if the status isn't
+/// `SOLVER_SOLVED`; owned by the solver
+const struct SolverMove *
+    solver_get_solution(const struct Solver *solver, int *length);
+
+/// @brief Find `state` along the solution path, which lets callers keep using
+/// a solution after some of its moves were played (or undone).
+/// @param solver
+/// @param state
+/// @return The number of solution moves that lead from the root to `state`,
+/// or -1 if it isn't on the path
+int solver_find_on_path(
+    const struct Solver *solver, const struct GameState *state);
+
+/// @brief Write a solution as text, for storing and sharing it: three
+/// characters per move, the column and the row of `pos` as letters counted
+/// from 'a' and 'L' or 'R' for the direction. Block indices aren't part of it,
+/// see `solver_solution_from_string`.
+/// @param moves
+/// @param length
+/// @param dest Receives at most `size` bytes, including the terminator
+/// @param size
+/// @return The length of the whole string, which was truncated if it isn't
+/// below `size`
+size_t solver_solution_to_string(
+    const struct SolverMove *moves, int length, char *dest, size_t size);
+
+/// @brief Parse a solution string and check it by replaying it from `root`,
+/// which also recovers the block indices of the moves.
+/// @param root Preprocessed game state the solution starts from
+/// @param str
+/// @param dest Receives the moves
+/// @param max_length Number of moves `dest` has room for
+/// @return The number of moves, or -1 if the string is malformed, too long or
+/// one of its moves isn't legal; a solution that doesn't end in a solved state
+/// is still accepted
+int solver_solution_from_string(
+    const struct GameState *root,
+    const char *str,
+    struct SolverMove *dest,
+    int max_length);
+
+/// @brief Admissible and consistent lower bound for the number of moves needed
+/// to solve a state.
+/// @param game
+/// @return The bound, 0 only for solved states
+int solver_heuristic(const struct GameState *game);
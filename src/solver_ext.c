@@ -0,0 +1,583 @@
+#include "solver_ext.h"
+#include "pack.h"
+#include "util.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EXT_CHECKPOINT_MAGIC "jnb-ext 1"
+#define EXT_DEFAULT_MEMORY ((size_t)256 << 20)
+// runs are merged into one before there are too many files open at once
+#define EXT_MAX_RUNS 256
+#define EXT_IO_BUFFER_SIZE (1 << 16)
+#define EXT_PATH_SIZE 4096
+
+struct ExtSearch {
+    struct StatePacker packer;
+    size_t record_size;
+    // leaves room for the file names
+    char dir[EXT_PATH_SIZE - 64];
+
+    // successors of the current layer that weren't written to a run yet
+    uint8_t *buffer;
+    size_t buffer_count;
+    size_t buffer_cap;
+    int run_count;
+
+    // layer being expanded
+    int depth;
+    FILE *layer;
+
+    // packed root, and room for two more records
+    uint8_t *root;
+    uint8_t *current;
+    uint8_t *scratch;
+
+    // filled in once solved: packed states from the root to the goal, and the
+    // moves between them
+    int path_length;
+    uint8_t *path;
+    blockidx_t *path_blocks;
+    MoveBlockDir *path_dirs;
+
+    struct LegalMoves legal;
+    bool prune;
+};
+
+// qsort has no context argument; searches on different threads can have
+// different record sizes
+static JNB_THREADLOCAL size_t g_record_size;
+
+static int compare_records(const void *a, const void *b) {
+    return memcmp(a, b, g_record_size);
+}
+
+static void file_path(
+    const struct ExtSearch *search,
+    char *dest,
+    const char *name,
+    int index) {
+    if (index < 0)
+        snprintf(dest, EXT_PATH_SIZE, "%s/%s", search->dir, name);
+    else
+        snprintf(dest, EXT_PATH_SIZE, "%s/%s_%d.bin", search->dir, name, index);
+}
+
+static FILE *open_file(
+    const struct ExtSearch *search,
+    const char *name,
+    int index,
+    const char *mode) {
+    char path[EXT_PATH_SIZE];
+    file_path(search, path, name, index);
+    FILE *file = fopen(path, mode);
+    if (file != NULL)
+        setvbuf(file, NULL, _IOFBF, EXT_IO_BUFFER_SIZE);
+    return file;
+}
+
+static void remove_file(
+    const struct ExtSearch *search, const char *name, int index) {
+    char path[EXT_PATH_SIZE];
+    file_path(search, path, name, index);
+    remove(path);
+}
+
+static bool read_record(
+    const struct ExtSearch *search, FILE *file, uint8_t *dest) {
+    return fread(dest, search->record_size, 1, file) == 1;
+}
+
+static bool write_record(
+    const struct ExtSearch *search, FILE *file, const uint8_t *src) {
+    return fwrite(src, search->record_size, 1, file) == 1;
+}
+
+// merges sorted, duplicate free files into `out`, dropping the records that
+// are in `seen` (if any); `seen_out` receives the union with `seen`
+static bool merge_files(
+    struct ExtSearch *search,
+    FILE **inputs,
+    int count,
+    FILE *seen,
+    FILE *out,
+    FILE *seen_out,
+    uint64_t *written,
+    struct SolverStats *stats) {
+    size_t size = search->record_size;
+    uint8_t *heads = malloc((count + 2) * size);
+    bool *live = malloc((count + 1) * sizeof(bool));
+    if (heads == NULL || live == NULL) {
+        free(heads);
+        free(live);
+        return false;
+    }
+    uint8_t *seen_head = heads + count * size;
+    uint8_t *last = heads + (count + 1) * size;
+
+    for (int i = 0; i < count; ++i)
+        live[i] = read_record(search, inputs[i], heads + i * size);
+    bool seen_live = seen != NULL && read_record(search, seen, seen_head);
+
+    bool ok = true;
+    *written = 0;
+    for (;;) {
+        int min = -1;
+        for (int i = 0; i < count; ++i) {
+            if (live[i] && (min < 0 || memcmp(heads + i * size,
+                                              heads + min * size, size) < 0))
+                min = i;
+        }
+        if (min < 0)
+            break;
+        memcpy(last, heads + min * size, size);
+
+        // every input has at most one copy of the record
+        for (int i = 0; i < count; ++i) {
+            if (!live[i] || memcmp(heads + i * size, last, size) != 0)
+                continue;
+            if (i != min)
+                ++stats->duplicates;
+            live[i] = read_record(search, inputs[i], heads + i * size);
+        }
+
+        int order = 1;
+        while (seen_live && (order = memcmp(seen_head, last, size)) < 0) {
+            ok &= write_record(search, seen_out, seen_head);
+            seen_live = read_record(search, seen, seen_head);
+        }
+        if (seen_live && order == 0) {
+            ++stats->duplicates;
+            continue;
+        }
+
+        ok &= write_record(search, out, last);
+        if (seen_out != NULL)
+            ok &= write_record(search, seen_out, last);
+        ++*written;
+    }
+
+    while (seen_live) {
+        ok &= write_record(search, seen_out, seen_head);
+        seen_live = read_record(search, seen, seen_head);
+    }
+
+    free(heads);
+    free(live);
+    return ok;
+}
+
+static bool merge_runs(
+    struct ExtSearch *search,
+    FILE *seen,
+    FILE *out,
+    FILE *seen_out,
+    uint64_t *written,
+    struct SolverStats *stats) {
+    FILE *inputs[EXT_MAX_RUNS];
+    bool ok = true;
+    for (int i = 0; i < search->run_count; ++i) {
+        inputs[i] = open_file(search, "run", i, "rb");
+        ok &= inputs[i] != NULL;
+    }
+    if (ok) {
+        ok = merge_files(
+            search, inputs, search->run_count, seen, out, seen_out, written,
+            stats);
+    }
+    for (int i = 0; i < search->run_count; ++i) {
+        if (inputs[i] != NULL)
+            fclose(inputs[i]);
+        remove_file(search, "run", i);
+    }
+    search->run_count = 0;
+    return ok;
+}
+
+// sorts the buffered successors into a new run
+static bool flush_buffer(struct ExtSearch *search, struct SolverStats *stats) {
+    if (search->buffer_count == 0)
+        return true;
+
+    if (search->run_count == EXT_MAX_RUNS) {
+        // the merged run can't be named like one of its inputs
+        FILE *out = open_file(search, "merged", -1, "wb");
+        uint64_t written;
+        bool ok = out != NULL &&
+                  merge_runs(search, NULL, out, NULL, &written, stats);
+        if (out != NULL)
+            ok &= fclose(out) == 0;
+        char from[EXT_PATH_SIZE], to[EXT_PATH_SIZE];
+        file_path(search, from, "merged", -1);
+        file_path(search, to, "run", 0);
+        if (!ok || rename(from, to) != 0)
+            return false;
+        search->run_count = 1;
+    }
+
+    size_t size = search->record_size;
+    g_record_size = size;
+    qsort(search->buffer, search->buffer_count, size, compare_records);
+
+    FILE *run = open_file(search, "run", search->run_count, "wb");
+    if (run == NULL)
+        return false;
+    bool ok = true;
+    for (size_t i = 0; i < search->buffer_count; ++i) {
+        const uint8_t *record = search->buffer + i * size;
+        if (i > 0 && memcmp(record - size, record, size) == 0) {
+            ++stats->duplicates;
+            continue;
+        }
+        ok &= write_record(search, run, record);
+    }
+    ok &= fclose(run) == 0;
+
+    ++search->run_count;
+    search->buffer_count = 0;
+    return ok;
+}
+
+static void format_hex(const uint8_t *data, size_t size, char *dest) {
+    for (size_t i = 0; i < size; ++i)
+        snprintf(dest + 2 * i, 3, "%02x", data[i]);
+}
+
+// the checkpoint names the last complete layer; it replaces the previous one
+// in a single rename, so an interrupted write leaves the old one intact
+static bool write_checkpoint(
+    const struct ExtSearch *search, const struct SolverStats *stats) {
+    FILE *file = open_file(search, "checkpoint.tmp", -1, "w");
+    if (file == NULL)
+        return false;
+
+    char root[2 * BOARD_WIDTH * BOARD_HEIGHT + 1];
+    format_hex(search->root, search->record_size, root);
+    fprintf(file, EXT_CHECKPOINT_MAGIC "\n");
+    fprintf(file, "record_size %zu\n", search->record_size);
+    fprintf(file, "root %s\n", root);
+    fprintf(file, "depth %d\n", search->depth);
+    fprintf(
+        file,
+        "expanded %" PRIu64 " generated %" PRIu64 " duplicates %" PRIu64
+        " pruned %" PRIu64 "\n",
+        stats->expanded, stats->generated, stats->duplicates, stats->pruned);
+    bool ok = fclose(file) == 0;
+
+    char from[EXT_PATH_SIZE], to[EXT_PATH_SIZE];
+    file_path(search, from, "checkpoint.tmp", -1);
+    file_path(search, to, "checkpoint", -1);
+    return ok && rename(from, to) == 0;
+}
+
+// only succeeds for a checkpoint of the same level
+static bool read_checkpoint(
+    struct ExtSearch *search, struct SolverStats *stats) {
+    FILE *file = open_file(search, "checkpoint", -1, "r");
+    if (file == NULL)
+        return false;
+
+    // every line fits, so each field does as well
+    char lines[5][EXT_PATH_SIZE];
+    bool ok = true;
+    for (int i = 0; i < 5; ++i)
+        ok &= fgets(lines[i], EXT_PATH_SIZE, file) != NULL;
+    fclose(file);
+
+    char root[EXT_PATH_SIZE];
+    char expected_root[2 * BOARD_WIDTH * BOARD_HEIGHT + 1];
+    size_t record_size;
+    int depth;
+    uint64_t expanded, generated, duplicates, pruned;
+    ok = ok && strcmp(lines[0], EXT_CHECKPOINT_MAGIC "\n") == 0 &&
+         sscanf(lines[1], "record_size %zu", &record_size) == 1 &&
+         sscanf(lines[2], "root %s", root) == 1 &&
+         sscanf(lines[3], "depth %d", &depth) == 1 &&
+         sscanf(
+             lines[4],
+             "expanded %" SCNu64 " generated %" SCNu64 " duplicates %" SCNu64
+             " pruned %" SCNu64,
+             &expanded, &generated, &duplicates, &pruned) == 4;
+
+    format_hex(search->root, search->record_size, expected_root);
+    if (!ok || record_size != search->record_size ||
+        strcmp(root, expected_root) != 0)
+        return false;
+
+    search->depth = depth;
+    stats->expanded = expanded;
+    stats->generated = generated;
+    stats->duplicates = duplicates;
+    stats->pruned = pruned;
+    stats->depth = depth;
+    return true;
+}
+
+// the root makes up the first layer and the first set of seen states
+static bool write_root_layer(
+    struct ExtSearch *search, const struct SolverStats *stats) {
+    bool ok = true;
+    const char *names[] = {"layer", "visited"};
+    for (int i = 0; i < 2; ++i) {
+        FILE *file = open_file(search, names[i], 0, "wb");
+        if (file == NULL)
+            return false;
+        ok &= write_record(search, file, search->root);
+        ok &= fclose(file) == 0;
+    }
+    search->depth = 0;
+    return ok && write_checkpoint(search, stats);
+}
+
+struct ExtSearch *ext_search_new(
+    const struct GameState *root,
+    const char *dir,
+    size_t memory,
+    bool prune,
+    struct SolverStats *stats) {
+    struct ExtSearch *search = calloc(1, sizeof(struct ExtSearch));
+    if (search == NULL)
+        return NULL;
+    search->prune = prune;
+
+    if (strlen(dir) >= sizeof(search->dir) ||
+        !state_packer_init(&search->packer, root)) {
+        ext_search_free(&search);
+        return NULL;
+    }
+    strcpy(search->dir, dir);
+    search->record_size = search->packer.packed_size;
+
+    search->buffer_cap = (memory ? memory : EXT_DEFAULT_MEMORY) /
+                         search->record_size;
+    // every expansion adds at most this many successors
+    if (search->buffer_cap < 2 * MAX_BLOCKS)
+        search->buffer_cap = 2 * MAX_BLOCKS;
+    search->buffer = malloc(search->buffer_cap * search->record_size);
+    search->root = malloc(3 * search->record_size);
+    if (search->buffer == NULL || search->root == NULL) {
+        ext_search_free(&search);
+        return NULL;
+    }
+    search->current = search->root + search->record_size;
+    search->scratch = search->current + search->record_size;
+    state_pack(&search->packer, root, search->root);
+
+    if (read_checkpoint(search, stats)) {
+        // runs left behind by an interrupted layer
+        for (int i = 0;; ++i) {
+            char path[EXT_PATH_SIZE];
+            file_path(search, path, "run", i);
+            if (remove(path) != 0)
+                break;
+        }
+    } else if (!write_root_layer(search, stats)) {
+        ext_search_free(&search);
+        return NULL;
+    }
+    return search;
+}
+
+void ext_search_free(struct ExtSearch **search) {
+    if (*search == NULL)
+        return;
+    if ((*search)->layer != NULL)
+        fclose((*search)->layer);
+    free((*search)->buffer);
+    free((*search)->root);
+    free((*search)->path);
+    free((*search)->path_blocks);
+    free((*search)->path_dirs);
+    free(*search);
+    *search = NULL;
+}
+
+// merges the successors of the current layer into the next one
+static bool finish_layer(
+    struct ExtSearch *search, uint64_t *count, struct SolverStats *stats) {
+    if (!flush_buffer(search, stats))
+        return false;
+
+    FILE *seen = open_file(search, "visited", search->depth, "rb");
+    FILE *out = open_file(search, "layer", search->depth + 1, "wb");
+    FILE *seen_out = open_file(search, "visited", search->depth + 1, "wb");
+    bool ok = seen != NULL && out != NULL && seen_out != NULL &&
+              merge_runs(search, seen, out, seen_out, count, stats);
+    if (seen != NULL)
+        fclose(seen);
+    if (out != NULL)
+        ok &= fclose(out) == 0;
+    if (seen_out != NULL)
+        ok &= fclose(seen_out) == 0;
+    if (!ok)
+        return false;
+
+    ++search->depth;
+    if (!write_checkpoint(search, stats))
+        return false;
+    // the layers themselves are kept for finding the solution path
+    remove_file(search, "visited", search->depth - 1);
+    return true;
+}
+
+// scans a layer for a state with a move that leads to `target`
+static bool find_predecessor(
+    struct ExtSearch *search,
+    int layer,
+    const uint8_t *target,
+    uint8_t *dest,
+    blockidx_t *block,
+    MoveBlockDir *dir) {
+    _Alignas(struct GameState) uint8_t buf[2][GAME_STATE_MAX_SIZE];
+    struct GameState *state = (struct GameState *)buf[0];
+    struct GameState *next = (struct GameState *)buf[1];
+
+    FILE *file = open_file(search, "layer", layer, "rb");
+    if (file == NULL)
+        return false;
+
+    bool found = false;
+    while (!found && read_record(search, file, dest)) {
+        state_unpack(&search->packer, dest, state);
+        game_get_legal_moves(state, &search->legal);
+        for (blockidx_t b = 0; !found && b < state->block_count; ++b) {
+            for (MoveBlockDir d = MOVE_BLOCK_LEFT; d <= MOVE_BLOCK_RIGHT;
+                 ++d) {
+                if (!block_set_has(&search->legal.movable[d], b))
+                    continue;
+                game_do_move(state, b, d, next);
+                state_pack(&search->packer, next, search->scratch);
+                if (memcmp(search->scratch, target, search->record_size) ==
+                    0) {
+                    *block = b;
+                    *dir = d;
+                    found = true;
+                    break;
+                }
+            }
+        }
+    }
+    fclose(file);
+    return found;
+}
+
+// the goal was generated by a move from the current state; the rest of the
+// path is found by going back through the layers on disk
+static bool build_path(
+    struct ExtSearch *search,
+    const struct GameState *goal,
+    blockidx_t block,
+    MoveBlockDir dir) {
+    fclose(search->layer);
+    search->layer = NULL;
+
+    size_t size = search->record_size;
+    int length = search->depth + 1;
+    search->path = malloc((length + 1) * size);
+    search->path_blocks = malloc(length * sizeof(blockidx_t));
+    search->path_dirs = malloc(length * sizeof(MoveBlockDir));
+    if (search->path == NULL || search->path_blocks == NULL ||
+        search->path_dirs == NULL)
+        return false;
+
+    state_pack(&search->packer, goal, search->path + length * size);
+    memcpy(search->path + (length - 1) * size, search->current, size);
+    search->path_blocks[length - 1] = block;
+    search->path_dirs[length - 1] = dir;
+    for (int i = length - 1; i > 0; --i) {
+        if (!find_predecessor(
+                search, i - 1, search->path + i * size,
+                search->path + (i - 1) * size, &search->path_blocks[i - 1],
+                &search->path_dirs[i - 1]))
+            return false;
+    }
+    search->path_length = length;
+    return true;
+}
+
+SolverStatus ext_search_step(
+    struct ExtSearch *search, size_t budget, struct SolverStats *stats) {
+    _Alignas(struct GameState) uint8_t buf[2][GAME_STATE_MAX_SIZE];
+    struct GameState *state = (struct GameState *)buf[0];
+    struct GameState *next = (struct GameState *)buf[1];
+
+    while (budget > 0) {
+        if (search->layer == NULL) {
+            search->layer = open_file(search, "layer", search->depth, "rb");
+            if (search->layer == NULL)
+                return SOLVER_LIMIT;
+            stats->depth = search->depth;
+        }
+
+        if (!read_record(search, search->layer, search->current)) {
+            fclose(search->layer);
+            search->layer = NULL;
+            uint64_t count;
+            if (!finish_layer(search, &count, stats))
+                return SOLVER_LIMIT;
+            if (count == 0) {
+                stats->depth = search->depth - 1;
+                return SOLVER_UNSOLVABLE;
+            }
+            continue;
+        }
+
+        --budget;
+        ++stats->expanded;
+        state_unpack(&search->packer, search->current, state);
+        game_get_legal_moves(state, &search->legal);
+
+        for (blockidx_t block = 0; block < state->block_count; ++block) {
+            for (MoveBlockDir dir = MOVE_BLOCK_LEFT; dir <= MOVE_BLOCK_RIGHT;
+                 ++dir) {
+                if (!block_set_has(&search->legal.movable[dir], block))
+                    continue;
+                game_do_move(state, block, dir, next);
+                ++stats->generated;
+                if (search->prune && game_is_dead(next)) {
+                    ++stats->pruned;
+                    continue;
+                }
+
+                if (game_is_solved(next))
+                    return build_path(search, next, block, dir)
+                               ? SOLVER_SOLVED
+                               : SOLVER_LIMIT;
+
+                if (search->buffer_count == search->buffer_cap &&
+                    !flush_buffer(search, stats))
+                    return SOLVER_LIMIT;
+                state_pack(
+                    &search->packer, next,
+                    search->buffer +
+                        search->buffer_count * search->record_size);
+                ++search->buffer_count;
+            }
+        }
+    }
+    return SOLVER_RUNNING;
+}
+
+size_t ext_search_memory(const struct ExtSearch *search) {
+    return search->buffer_cap * search->record_size;
+}
+
+int ext_search_path_length(const struct ExtSearch *search) {
+    return search->path_length;
+}
+
+void ext_search_path_state(
+    const struct ExtSearch *search,
+    int i,
+    struct GameState *dest,
+    blockidx_t *block,
+    MoveBlockDir *dir) {
+    state_unpack(
+        &search->packer, search->path + i * search->record_size, dest);
+    if (i > 0) {
+        *block = search->path_blocks[i - 1];
+        *dir = search->path_dirs[i - 1];
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "game.h"
+#include "solver.h"
+
+#include <stddef.h>
+
+/// @brief Breadth-first search that keeps its layers in files instead of RAM,
+/// used by `SOLVER_MODE_EXTERNAL`. Every layer is a sorted file of packed
+/// states; the successors of a layer are buffered up to a memory budget,
+/// sorted into runs and then merged against the sorted set of every state seen
+/// so far, which removes the duplicates with sequential I/O only. A checkpoint
+/// is written after each layer, and a search started on a directory holding a
+/// checkpoint for the same level continues from it.
+struct ExtSearch;
+
+/// @brief Start or resume a search.
+/// @param root Preprocessed game state
+/// @param dir Existing directory for the search files
+/// @param memory Bytes to use for buffering successors; 0 picks the default
+/// @param prune Whether to drop the states `game_is_dead` rejects
+/// @param stats Restored from the checkpoint when resuming
+/// @return `NULL` if memory allocation failed or the directory isn't usable
+struct ExtSearch *ext_search_new(
+    const struct GameState *root,
+    const char *dir,
+    size_t memory,
+    bool prune,
+    struct SolverStats *stats);
+
+/// @brief Free and invalidate a search. The files are kept, so it can be
+/// resumed later.
+/// @param search
+void ext_search_free(struct ExtSearch **search);
+
+/// @brief Expand at most `budget` states. Finishing a layer, which merges it
+/// to disk, or finding the solution path can take much longer than the
+/// expansions themselves.
+/// @param search
+/// @param budget
+/// @param stats
+/// @return `SOLVER_LIMIT` if a file operation or an allocation failed
+SolverStatus ext_search_step(
+    struct ExtSearch *search, size_t budget, struct SolverStats *stats);
+
+/// @brief Bytes of the successor buffer, which is most of the memory the
+/// search holds.
+size_t ext_search_memory(const struct ExtSearch *search);
+
+/// @brief Number of moves of the solution, once solved.
+int ext_search_path_length(const struct ExtSearch *search);
+
+/// @brief Get a state of the solution path, once solved; 0 is the root.
+/// @param search
+/// @param i
+/// @param dest Has to have room for `GAME_STATE_MAX_SIZE` bytes
+/// @param block Written with the block moved to reach the state, if `i > 0`
+/// @param dir Written with the direction of that move, if `i > 0`
+void ext_search_path_state(
+    const struct ExtSearch *search,
+    int i,
+    struct GameState *dest,
+    blockidx_t *block,
+    MoveBlockDir *dir);
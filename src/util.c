@@ -2,6 +2,8 @@
 
 #include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 void print_cell_data(const struct GameState *game, const struct Cell *cell) {
     switch (cell->type) {
@@ -20,6 +22,13 @@ void print_cell_data(const struct GameState *game, const struct Cell *cell) {
     case CELL_WALL:
         printf("Wall");
         break;
+    case CELL_EMERGE: {
+        const struct EmergeCell *emerge = &cell->data.emerge;
+        printf(
+            "Emerge: color=%" PRIi8 ", dir=%d, fixed=%d", emerge->color,
+            emerge->dir, emerge->fixed);
+        break;
+    }
     }
 }
 
@@ -32,6 +41,7 @@ static inline void render_cell(const struct Cell *cell) {
         printf("%1" PRIi8, cell->data.piece.color);
         break;
     case CELL_WALL:
+    case CELL_EMERGE:
         printf("#");
         break;
     }
@@ -63,3 +73,330 @@ void print_cells(const struct GameState *game) {
         }
     }
 }
+
+static bool parse_cell(char c, struct Cell *cell) {
+    if (c == ' ' || c == '.') {
+        cell->type = CELL_EMPTY;
+    } else if (c == '#') {
+        cell->type = CELL_WALL;
+    } else if (c >= '0' && c <= '9') {
+        cell->type = CELL_PIECE;
+        cell->data.piece.color = piece_make_color(c - '0', false);
+    } else if (c >= 'A' && c <= 'J') {
+        cell->type = CELL_PIECE;
+        cell->data.piece.color = piece_make_color(c - 'A', true);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// parses BOARD_HEIGHT lines and leaves `*str` after them
+static bool parse_board(
+    const char **str, struct Cell board[BOARD_HEIGHT][BOARD_WIDTH]) {
+    memset(board, 0, sizeof(struct Cell) * BOARD_HEIGHT * BOARD_WIDTH);
+
+    const char *at = *str;
+    for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
+        if (*at == '\0')
+            return false;
+
+        board_coord_t j = 0;
+        for (; *at != '\0' && *at != '\n'; ++at) {
+            if (*at == '\r')
+                continue;
+            if (j >= BOARD_WIDTH || !parse_cell(*at, &board[i][j]))
+                return false;
+            ++j;
+        }
+        if (*at == '\n')
+            ++at;
+    }
+
+    *str = at;
+    return true;
+}
+
+bool simple_game_from_string(const char *str, struct GameState *game) {
+    memset(game, 0, sizeof(struct GameState));
+    return parse_board(&str, game->board);
+}
+
+char *read_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *data = malloc(size + 1);
+    if (data == NULL || fread(data, 1, size, file) != (size_t)size) {
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+    data[size] = '\0';
+    fclose(file);
+    return data;
+}
+
+static const char *next_line(const char *str) {
+    const char *end = strchr(str, '\n');
+    return end == NULL ? str + strlen(str) : end + 1;
+}
+
+bool load_game_file(const char *path, struct GameState *game) {
+    char *data = read_file(path);
+    if (data == NULL)
+        return false;
+
+    // skip the comments and the header
+    char *board = data;
+    while (*board == ';' || strncmp(board, "level", 5) == 0) {
+        char *end = strchr(board, '\n');
+        if (end == NULL)
+            break;
+        board = end + 1;
+    }
+
+    bool res = simple_game_from_string(board, game);
+    free(data);
+    return res;
+}
+
+// parses a `no_connect <x> <y> <mask>` line for a piece of the board
+static bool parse_no_connect(
+    const char *str, struct Cell board[BOARD_HEIGHT][BOARD_WIDTH]) {
+    int x, y, mask;
+    if (sscanf(str + 10, "%d %d %d", &x, &y, &mask) != 3 || x < 0 ||
+        x >= BOARD_WIDTH || y < 0 || y >= BOARD_HEIGHT || mask < 0 ||
+        mask >= 1 << MOVE_BLOCK_NONE || board[y][x].type != CELL_PIECE)
+        return false;
+    board[y][x].data.piece.no_connect = mask;
+    return true;
+}
+
+static const char *const DIR_NAMES[MOVE_BLOCK_NONE] = {
+    "left", "right", "up", "down"};
+
+// parses an `emerge <x> <y> <color> <dir> [fixed]` line for a wall of the board
+static bool parse_emerge(
+    const char *str, struct Cell board[BOARD_HEIGHT][BOARD_WIDTH]) {
+    // the optional word mustn't be taken from the next line
+    char line[64];
+    size_t size = strcspn(str, "\r\n");
+    if (size >= sizeof(line))
+        return false;
+    memcpy(line, str, size);
+    line[size] = '\0';
+
+    int x, y, color;
+    char dir_name[8];
+    char fixed[8] = "";
+    if (sscanf(line + 6, "%d %d %d %7s %7s", &x, &y, &color, dir_name, fixed) <
+            4 ||
+        x < 0 || x >= BOARD_WIDTH || y < 0 || y >= BOARD_HEIGHT || color < 0 ||
+        color > INT8_MAX || board[y][x].type != CELL_WALL ||
+        (fixed[0] != '\0' && strcmp(fixed, "fixed") != 0))
+        return false;
+
+    MoveBlockDir dir = 0;
+    while (dir < MOVE_BLOCK_NONE && strcmp(dir_name, DIR_NAMES[dir]) != 0)
+        ++dir;
+    if (dir == MOVE_BLOCK_NONE)
+        return false;
+
+    board[y][x] = (struct Cell){
+        .type = CELL_EMERGE,
+        .data.emerge = {.color = color, .dir = dir, .fixed = fixed[0] != '\0'},
+    };
+    return true;
+}
+
+// copies the rest of a `level <name>` line
+static void parse_level_name(const char *str, char *dest) {
+    str += 5;
+    while (*str == ' ' || *str == '\t')
+        ++str;
+    size_t size = strcspn(str, "\r\n");
+    if (size >= LEVEL_NAME_SIZE)
+        size = LEVEL_NAME_SIZE - 1;
+    memcpy(dest, str, size);
+    dest[size] = '\0';
+}
+
+int load_level_pack(const char *path, struct PackLevel **levels) {
+    *levels = NULL;
+    char *data = read_file(path);
+    if (data == NULL)
+        return -1;
+
+    int count = 0;
+    int cap = 0;
+    const char *str = data;
+    for (;;) {
+        // comments and blank lines between the levels
+        while (*str == ';' || *str == '\n' || *str == '\r')
+            str = next_line(str);
+        if (*str == '\0')
+            break;
+
+        if (count == cap) {
+            cap = cap ? cap * 2 : 16;
+            struct PackLevel *grown =
+                realloc(*levels, cap * sizeof(struct PackLevel));
+            if (grown == NULL)
+                goto fail;
+            *levels = grown;
+        }
+        struct PackLevel *level = &(*levels)[count];
+
+        if (strncmp(str, "level", 5) == 0) {
+            parse_level_name(str, level->name);
+            str = next_line(str);
+            while (*str == ';')
+                str = next_line(str);
+        } else if (count == 0) {
+            // a lone board, as read by load_game_file
+            snprintf(level->name, LEVEL_NAME_SIZE, "%s", path);
+        } else {
+            goto fail;
+        }
+
+        if (!parse_board(&str, level->board))
+            goto fail;
+        for (;; str = next_line(str)) {
+            if (strncmp(str, "no_connect", 10) == 0) {
+                if (!parse_no_connect(str, level->board))
+                    goto fail;
+            } else if (strncmp(str, "emerge", 6) == 0) {
+                if (!parse_emerge(str, level->board))
+                    goto fail;
+            } else {
+                break;
+            }
+        }
+        ++count;
+    }
+
+    free(data);
+    return count;
+
+fail:
+    free(data);
+    free(*levels);
+    *levels = NULL;
+    return -1;
+}
+
+// equal names are ordered as in the pack
+static int compare_level_names(const void *a, const void *b) {
+    const struct PackLevel *const *x = a;
+    const struct PackLevel *const *y = b;
+    int cmp = strcmp((*x)->name, (*y)->name);
+    if (cmp != 0)
+        return cmp;
+    return *x < *y ? -1 : *x > *y;
+}
+
+bool level_index_init(
+    struct LevelIndex *index, const struct PackLevel *levels, int count) {
+    index->levels = levels;
+    index->count = count;
+    index->sorted = malloc((count + 1) * sizeof(struct PackLevel *));
+    if (index->sorted == NULL)
+        return false;
+    for (int i = 0; i < count; ++i)
+        index->sorted[i] = &levels[i];
+    qsort(
+        index->sorted, count, sizeof(struct PackLevel *),
+        compare_level_names);
+    return true;
+}
+
+void level_index_free(struct LevelIndex *index) {
+    free(index->sorted);
+    index->sorted = NULL;
+    index->count = 0;
+}
+
+// compares the first `size` characters of the name, and then its length
+static int compare_level_name(
+    const struct PackLevel *level, const char *name, size_t size) {
+    int cmp = strncmp(level->name, name, size);
+    if (cmp == 0 && level->name[size] != '\0')
+        cmp = 1;
+    return cmp;
+}
+
+int level_index_find(
+    const struct LevelIndex *index, const char *name, size_t size) {
+    if (size >= LEVEL_NAME_SIZE)
+        return -1;
+    int lo = 0;
+    int hi = index->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (compare_level_name(index->sorted[mid], name, size) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == index->count ||
+        compare_level_name(index->sorted[lo], name, size) != 0)
+        return -1;
+    return index->sorted[lo] - index->levels;
+}
+
+static char level_cell_char(const struct Cell *cell) {
+    switch (cell->type) {
+    case CELL_WALL:
+    case CELL_EMERGE:
+        return '#';
+    case CELL_PIECE: {
+        int color = cell->data.piece.color & 0x7f;
+        bool fixed = cell->data.piece.color & 0x80;
+        return (fixed ? 'A' : '0') + color;
+    }
+    default:
+        return ' ';
+    }
+}
+
+bool write_level(
+    FILE *file,
+    const char *name,
+    const struct Cell board[BOARD_HEIGHT][BOARD_WIDTH]) {
+    fprintf(file, "level %s\n", name);
+    for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
+        char line[BOARD_WIDTH + 1];
+        int length = 0;
+        for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
+            const struct Cell *cell = &board[i][j];
+            if (cell->type == CELL_PIECE && (cell->data.piece.color & 0x7f) > 9)
+                return false;
+            line[j] = level_cell_char(cell);
+            if (line[j] != ' ')
+                length = j + 1;
+        }
+        line[length] = '\0';
+        fprintf(file, "%s\n", line);
+    }
+    for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
+        for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
+            const struct Cell *cell = &board[i][j];
+            if (cell->type == CELL_PIECE && cell->data.piece.no_connect != 0)
+                fprintf(
+                    file, "no_connect %d %d %d\n", j, i,
+                    cell->data.piece.no_connect);
+            if (cell->type == CELL_EMERGE) {
+                const struct EmergeCell *emerge = &cell->data.emerge;
+                fprintf(
+                    file, "emerge %d %d %d %s%s\n", j, i, emerge->color,
+                    DIR_NAMES[emerge->dir], emerge->fixed ? " fixed" : "");
+            }
+        }
+    }
+    return !ferror(file);
+}
@@ -2,10 +2,95 @@
 
 #include "game.h"
 
-// bool simple_game_from_string(const char *str, struct GameState *game);
-// bool load_game_file(const char *path, struct GameState *game);
+#include <stdio.h>
+
+/// @brief Write a board from its text representation to `game`, which still
+/// has to go through `game_preprocess_alloc`. The text is `BOARD_HEIGHT` lines
+/// of at most `BOARD_WIDTH` characters: `#` for walls, ` ` or `.` for empty
+/// cells, `0`-`9` for pieces of that color and `A`-`J` for fixed pieces of
+/// colors 0-9. Missing characters at the end of a line are empty cells.
+/// @param str
+/// @param game
+/// @return Whether or not the text was well-formed
+bool simple_game_from_string(const char *str, struct GameState *game);
+
+/// @brief Load a board written with `simple_game_from_string`'s format from a
+/// file. Lines starting with `;` are comments and an optional `level <name>`
+/// line may precede the board.
+/// @param path
+/// @param game
+/// @return Whether or not the file could be read and parsed
+bool load_game_file(const char *path, struct GameState *game);
 // bool save_game_file(const char *path, struct GameState *game);
 
+#define LEVEL_NAME_SIZE 64
+
+/// @brief A level of a level pack.
+struct PackLevel {
+    char name[LEVEL_NAME_SIZE];
+    /// @brief Still has to be copied to a game state and go through
+    /// `game_preprocess_alloc`.
+    struct Cell board[BOARD_HEIGHT][BOARD_WIDTH];
+};
+
+/// @brief Load every level of a level pack: boards in
+/// `simple_game_from_string`'s format, each preceded by a `level <name>` line
+/// and followed by a `no_connect <x> <y> <mask>` line for every piece with
+/// connections disabled and an `emerge <x> <y> <color> <dir> [fixed]` line for
+/// every wall with a piece hidden in it (`dir` being `left`, `right`, `up` or
+/// `down`), with comments and blank lines between the levels. A
+/// file `load_game_file` reads is a pack of one level, named after the path if
+/// it has no `level` line.
+/// @param path
+/// @param levels Receives the levels, to be released with `free`
+/// @return The number of levels, or -1 if the file couldn't be read or parsed
+int load_level_pack(const char *path, struct PackLevel **levels);
+
+/// @brief Levels sorted by name, for looking them up.
+struct LevelIndex {
+    const struct PackLevel *levels;
+    const struct PackLevel **sorted;
+    int count;
+};
+
+/// @brief Index the levels of a pack by name. The levels aren't copied.
+/// @param index
+/// @param levels
+/// @param count
+/// @return Whether or not memory allocation succeeded
+bool level_index_init(
+    struct LevelIndex *index, const struct PackLevel *levels, int count);
+
+/// @brief Free the memory of an index.
+/// @param index
+void level_index_free(struct LevelIndex *index);
+
+/// @brief Look up a level by name; the first one wins if several have it.
+/// @param index
+/// @param name Not necessarily terminated
+/// @param size Length of `name`
+/// @return Index of the level in the pack, or -1 if there is none
+int level_index_find(
+    const struct LevelIndex *index, const char *name, size_t size);
+
+/// @brief Read a whole file into memory.
+/// @param path
+/// @return The contents followed by a terminator, to be released with `free`,
+/// or `NULL` if the file couldn't be read
+char *read_file(const char *path);
+
+/// @brief Append a level to a level pack, in the format `load_level_pack`
+/// reads.
+/// @param file
+/// @param name
+/// @param board Fixed pieces are marked with `piece_make_color`
+/// @return Whether or not the board could be written; only colors up to 9
+/// have a representation
+bool write_level(
+    FILE *file,
+    const char *name,
+    const struct Cell board[BOARD_HEIGHT][BOARD_WIDTH]);
+
 void print_game(const struct GameState *game);
 void print_blocks(const struct GameState *game);
 void print_cell_data(const struct GameState *game, const struct Cell *cell);
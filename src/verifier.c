@@ -0,0 +1,203 @@
+#include "verifier.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef JNB_THREADING
+    #include <stdatomic.h>
+    #include <threads.h>
+#endif
+
+// submissions a thread claims at once, few enough to balance the threads and
+// many enough that they rarely touch the shared counter
+#define VERIFY_CHUNK 256
+
+#define VERIFY_MAX_THREADS 64
+
+struct VerifyJob {
+    struct GameState *const *roots;
+    const struct VerifySubmission *submissions;
+    size_t count;
+    struct VerifyReport *dest;
+#ifdef JNB_THREADING
+    atomic_size_t next;
+#else
+    size_t next;
+#endif
+};
+
+VerifyResult verify_solution(
+    const struct GameState *root,
+    const char *solution,
+    size_t size,
+    struct VerifyBuffers *buffers,
+    int *moves) {
+    *moves = 0;
+    if (size % 3 != 0)
+        return VERIFY_MALFORMED;
+
+    struct GameState *state = (struct GameState *)buffers->states[0];
+    struct GameState *next = (struct GameState *)buffers->states[1];
+    memcpy(state, root, game_get_size(root));
+
+    for (const char *text = solution; text < solution + size; text += 3) {
+        if (text[0] < 'a' || text[0] >= 'a' + BOARD_WIDTH || text[1] < 'a' ||
+            text[1] >= 'a' + BOARD_HEIGHT || (text[2] != 'L' && text[2] != 'R'))
+            return VERIFY_MALFORMED;
+        struct BoardPos pos = MAKE_BOARD_POS(text[0] - 'a', text[1] - 'a');
+        MoveBlockDir dir = text[2] == 'L' ? MOVE_BLOCK_LEFT : MOVE_BLOCK_RIGHT;
+
+        const struct Cell *cell = game_get_pos(state, pos);
+        if (cell->type != CELL_PIECE ||
+            !game_do_move(state, cell->data.piece.block, dir, next))
+            return VERIFY_ILLEGAL_MOVE;
+        ++*moves;
+
+        struct GameState *tmp = state;
+        state = next;
+        next = tmp;
+    }
+    return game_is_solved(state) ? VERIFY_SOLVED : VERIFY_NOT_SOLVED;
+}
+
+int verify_parse_submissions(
+    const char *text,
+    const struct LevelIndex *index,
+    struct VerifySubmission **dest) {
+    *dest = NULL;
+
+    int count = 0;
+    int cap = 0;
+    int line = 0;
+    for (const char *str = text; *str != '\0';) {
+        ++line;
+        size_t size = strcspn(str, "\n");
+        const char *end = str + size;
+        while (end > str && (end[-1] == '\r' || end[-1] == ' '))
+            --end;
+        const char *start = str;
+        str += size + (str[size] == '\n');
+        if (end == start || *start == ';')
+            continue;
+
+        if (count == cap) {
+            cap = cap ? cap * 2 : 1024;
+            struct VerifySubmission *grown =
+                realloc(*dest, cap * sizeof(struct VerifySubmission));
+            if (grown == NULL) {
+                free(*dest);
+                *dest = NULL;
+                return -1;
+            }
+            *dest = grown;
+        }
+
+        // a line without a space is a level name with an empty solution
+        const char *solution = end;
+        while (solution > start && solution[-1] != ' ')
+            --solution;
+        const char *name_end = solution;
+        while (name_end > start && name_end[-1] == ' ')
+            --name_end;
+        if (name_end == start) {
+            name_end = end;
+            solution = end;
+        }
+
+        (*dest)[count++] = (struct VerifySubmission){
+            .line = line,
+            .level = level_index_find(index, start, name_end - start),
+            .solution = solution,
+            .solution_size = end - solution,
+        };
+    }
+    return count;
+}
+
+const char *verify_result_string(VerifyResult result) {
+    switch (result) {
+    case VERIFY_SOLVED:
+        return "solved";
+    case VERIFY_NOT_SOLVED:
+        return "not_solved";
+    case VERIFY_ILLEGAL_MOVE:
+        return "illegal_move";
+    case VERIFY_MALFORMED:
+        return "malformed";
+    case VERIFY_UNKNOWN_LEVEL:
+        return "unknown_level";
+    }
+    return "unknown";
+}
+
+static int verify_worker(void *arg) {
+    struct VerifyJob *job = arg;
+    struct VerifyBuffers *buffers = malloc(sizeof(struct VerifyBuffers));
+    if (buffers == NULL)
+        return 1;
+
+    for (;;) {
+#ifdef JNB_THREADING
+        size_t first = atomic_fetch_add_explicit(
+            &job->next, VERIFY_CHUNK, memory_order_relaxed);
+#else
+        size_t first = job->next;
+        job->next += VERIFY_CHUNK;
+#endif
+        if (first >= job->count)
+            break;
+        size_t last = first + VERIFY_CHUNK;
+        if (last > job->count)
+            last = job->count;
+
+        for (size_t i = first; i < last; ++i) {
+            const struct VerifySubmission *submission = &job->submissions[i];
+            struct VerifyReport *report = &job->dest[i];
+            if (submission->level < 0) {
+                *report = (struct VerifyReport){VERIFY_UNKNOWN_LEVEL, 0};
+                continue;
+            }
+            report->result = verify_solution(
+                job->roots[submission->level], submission->solution,
+                submission->solution_size, buffers, &report->moves);
+        }
+    }
+    free(buffers);
+    return 0;
+}
+
+bool verify_submissions(
+    struct GameState *const *roots,
+    const struct VerifySubmission *submissions,
+    size_t count,
+    struct VerifyReport *dest,
+    int threads) {
+    struct VerifyJob job = {
+        .roots = roots,
+        .submissions = submissions,
+        .count = count,
+        .dest = dest,
+    };
+#ifdef JNB_THREADING
+    atomic_init(&job.next, 0);
+    if (threads > VERIFY_MAX_THREADS)
+        threads = VERIFY_MAX_THREADS;
+    thrd_t workers[VERIFY_MAX_THREADS];
+    int started = 0;
+    for (; started < threads - 1; ++started) {
+        if (thrd_create(&workers[started], verify_worker, &job) !=
+            thrd_success)
+            break;
+    }
+    int res = verify_worker(&job);
+    for (int i = 0; i < started; ++i) {
+        int worker_res;
+        thrd_join(workers[i], &worker_res);
+        res |= worker_res;
+    }
+    return res == 0;
+#else
+    (void)threads;
+    return verify_worker(&job) == 0;
+#endif
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "game.h"
+#include "util.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum _VerifyResult {
+    VERIFY_SOLVED = 0,
+    // every move was legal, but the final state isn't solved
+    VERIFY_NOT_SOLVED,
+    VERIFY_ILLEGAL_MOVE,
+    // not in the format of `solver_solution_to_string`
+    VERIFY_MALFORMED,
+    // the level isn't part of the pack
+    VERIFY_UNKNOWN_LEVEL
+};
+typedef int8_t VerifyResult;
+
+/// @brief The two states a replay alternates between, reused for every
+/// submission so nothing is allocated per move.
+struct VerifyBuffers {
+    _Alignas(struct GameState) uint8_t states[2][GAME_STATE_MAX_SIZE];
+};
+
+/// @brief A solution submitted for a level of the pack. It points into the
+/// text it was parsed from.
+struct VerifySubmission {
+    /// @brief Line of the submissions file, counted from 1.
+    int line;
+    /// @brief Index in the level pack, -1 if no level has the name.
+    int level;
+    const char *solution;
+    int solution_size;
+};
+
+struct VerifyReport {
+    VerifyResult result;
+    /// @brief Moves that were replayed, the first illegal one excluded.
+    int moves;
+};
+
+/// @brief Replay a solution string from a level's initial state.
+/// @param root Preprocessed game state
+/// @param solution In the format of `solver_solution_to_string`, not
+/// necessarily terminated
+/// @param size Length of `solution`
+/// @param buffers
+/// @param moves Written with the number of legal moves replayed; the state
+/// they lead to is left in `buffers->states[*moves % 2]`
+/// @return The verdict, never `VERIFY_UNKNOWN_LEVEL`
+VerifyResult verify_solution(
+    const struct GameState *root,
+    const char *solution,
+    size_t size,
+    struct VerifyBuffers *buffers,
+    int *moves);
+
+/// @brief Parse a submissions file: a `<level name> <solution>` line per
+/// submission, the solution being the last word of the line, with comments
+/// (`;`) and blank lines in between.
+/// @param text Contents of the file; the submissions point into it
+/// @param index Levels the names are looked up in
+/// @param dest Receives the submissions, to be released with `free`
+/// @return The number of submissions, or -1 if memory allocation failed
+int verify_parse_submissions(
+    const char *text,
+    const struct LevelIndex *index,
+    struct VerifySubmission **dest);
+
+/// @brief Name of a verdict, as used in reports: `solved`, `not_solved`,
+/// `illegal_move`, `malformed` or `unknown_level`.
+/// @param result
+const char *verify_result_string(VerifyResult result);
+
+/// @brief Verify submissions in parallel. Every thread replays whole
+/// submissions with its own buffers, so the reports are the same for any
+/// number of threads.
+/// @param roots Preprocessed initial states of the levels, indexed like the
+/// level pack
+/// @param submissions
+/// @param count
+/// @param dest Receives a report for every submission, in the same order
+/// @param threads Ignored without `JNB_THREADING`
+/// @return Whether or not the threads could be started
+bool verify_submissions(
+    struct GameState *const *roots,
+    const struct VerifySubmission *submissions,
+    size_t count,
+    struct VerifyReport *dest,
+    int threads);
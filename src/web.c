@@ -1,9 +1,13 @@
 #include "game.h"
 
 #include "b64.h"
+#include "solver.h"
 #include "util.h"
+#include "web_levels.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #ifdef __EMSCRIPTEN__
     #include <emscripten.h>
@@ -15,69 +19,51 @@
 
 #define MAX_UNDO 10
 
+// the hint search stores a packed game state per node, this keeps it at a few
+// tens of MB
+#define HINT_MAX_NODES (1 << 18)
+
 struct Game {
     _Alignas(struct GameState) uint8_t states[MAX_UNDO][GAME_STATE_MAX_SIZE];
     int current_state;
     int move_count;
     int undo_avail;
     int action_count;
+    // bumped by every change of the current state, moves and undos alike
+    uint32_t generation;
+    // legal moves of the current state, valid while legal_generation matches
+    // generation
+    uint32_t legal_generation;
+    struct LegalMoves legal;
     char *b64_buf;
+    // the hint search is kept between calls, so that it can be advanced in
+    // slices and reused while the player follows its solution
+    struct Solver *hint;
+    // number of solution moves already played
+    int hint_progress;
+    char *solution_buf;
+    // moves loaded by GAME_replay_load, played one by one by GAME_replay_step
+    struct SolverMove *replay;
+    int replay_length;
+    int replay_progress;
 };
 
 void JNB_API GAME_test(struct Game *game);
 
-static void gamestate_placeholder(struct GameState *state) {
-    memset(state, 0, sizeof(struct GameState));
-
-    BOARD_DATA_STRUCTURE_PTR(struct Cell, board) = &state->board;
-
-    // fill the top and bottom rows with walls
-    for (board_coord_t i = 0; i < BOARD_HEIGHT; ++i) {
-        (*board)[i][0].type = CELL_WALL;
-        (*board)[i][BOARD_WIDTH - 1].type = CELL_WALL;
-    }
-
-    // fill the left and right columns with walls
-    for (board_coord_t j = 0; j < BOARD_WIDTH; ++j) {
-        (*board)[0][j].type = CELL_WALL;
-        (*board)[BOARD_HEIGHT - 1][j].type = CELL_WALL;
+// copies the start of an embedded level, which was preprocessed when building
+static bool load_level(struct GameState *state, int index) {
+    const struct EmbeddedLevel *level = &embedded_levels[index];
+    if (embedded_levels_layout != web_levels_layout() ||
+        level->state_size > GAME_STATE_MAX_SIZE) {
+        printf("load_level: %s was embedded by another build\n", level->name);
+        return false;
     }
-
-    (*board)[6][6].type = CELL_WALL;
-
-    (*board)[5][6].type = CELL_PIECE;
-    (*board)[5][6].data.piece.color = piece_make_color(1, false);
-
-    (*board)[5][5].type = CELL_PIECE;
-    (*board)[5][5].data.piece.color = piece_make_color(1, false);
-
-    (*board)[4][5].type = CELL_PIECE;
-    (*board)[4][5].data.piece.color = piece_make_color(1, false);
-
-    (*board)[8][5].type = CELL_PIECE;
-    (*board)[8][5].data.piece.color = piece_make_color(1, false);
-
-    (*board)[4][6].type = CELL_PIECE;
-    (*board)[4][6].data.piece.color = piece_make_color(2, false);
-
-    (*board)[3][6].type = CELL_PIECE;
-    (*board)[3][6].data.piece.color = piece_make_color(2, false);
-    (*board)[3][6].data.piece.no_connect = PIECE_CON_RIGHT | PIECE_CON_UP;
-
-    (*board)[3][5].type = CELL_PIECE;
-    (*board)[3][5].data.piece.color = piece_make_color(2, false);
-
-    (*board)[2][6].type = CELL_PIECE;
-    (*board)[2][6].data.piece.color = piece_make_color(3, false);
-
-    (*board)[2][5].type = CELL_PIECE;
-    (*board)[2][5].data.piece.color = piece_make_color(4, false);
-
-    bool res = game_preprocess_alloc(state, &state);
-    if (!res) {
-        printf("gamestate_placeholder: failed to preprocess game state\n");
-        return;
+    memcpy(state, level->state, level->state_size);
+    if (!game_attach_level_template(state, level->level, level->level_size)) {
+        printf("load_level: failed to load %s\n", level->name);
+        return false;
     }
+    return true;
 }
 
 static inline struct GameState *get_state(struct Game *game, int idx) {
@@ -88,17 +74,37 @@ static inline struct GameState *get_current_state(struct Game *game) {
     return get_state(game, game->current_state);
 }
 
-struct Game *JNB_API GAME_new(void) {
+int JNB_API GAME_get_level_count(void) {
+    return embedded_level_count;
+}
+
+struct Game *JNB_API GAME_new_level(int level) {
+    if (level < 0 || level >= embedded_level_count)
+        return NULL;
     struct Game *game = calloc(1, sizeof(struct Game));
     if (!game)
         return NULL;
-    game->undo_avail = MAX_UNDO;
+    game->undo_avail = 0;
+    // the zeroed legal_generation must not look valid
+    game->generation = 1;
     game->b64_buf = NULL;
-    gamestate_placeholder(get_current_state(game));
+    if (!load_level(get_current_state(game), level)) {
+        free(game);
+        return NULL;
+    }
     return game;
 }
 
+struct Game *JNB_API GAME_new(void) {
+    return GAME_new_level(0);
+}
+
 void JNB_API GAME_free(struct Game *game) {
+    solver_free(&game->hint);
+    free(game->replay);
+    free(game->solution_buf);
+    // every state of the ring shares the template of the first one
+    game_free_level(get_current_state(game));
     free(game->b64_buf);
     free(game);
 }
@@ -109,18 +115,29 @@ static inline struct GameState *get_next_state(struct Game *game) {
 
 static inline void advance_state(struct Game *game) {
     game->current_state = (game->current_state + 1) % MAX_UNDO;
-    --game->move_count;
-    game->undo_avail += game->undo_avail < MAX_UNDO;
+    ++game->move_count;
+    // the oldest slot gets overwritten by the next move
+    game->undo_avail += game->undo_avail < MAX_UNDO - 1;
+    ++game->generation;
+}
+
+static const struct LegalMoves *get_legal_moves(struct Game *game) {
+    if (game->legal_generation != game->generation) {
+        game_get_legal_moves(get_current_state(game), &game->legal);
+        game->legal_generation = game->generation;
+    }
+    return &game->legal;
 }
 
 bool JNB_API GAME_undo(struct Game *game) {
     bool res = false;
     if (game->undo_avail > 0) {
-        game->current_state = (game->current_state - 1) % MAX_UNDO;
+        game->current_state = (game->current_state + MAX_UNDO - 1) % MAX_UNDO;
         --game->undo_avail;
+        --game->move_count;
+        ++game->generation;
         res = true;
     }
-    --game->move_count;
     ++game->action_count;
     return res;
 }
@@ -137,7 +154,11 @@ bool JNB_API
     }
     struct GameState *current = get_current_state(game);
     struct GameState *next = get_next_state(game);
+    if (current->board[y][x].type != CELL_PIECE)
+        return false;
     blockidx_t block = current->board[y][x].data.piece.block;
+    if (!block_set_has(&get_legal_moves(game)->movable[dir], block))
+        return false;
     if (!game_do_move(current, block, dir, next))
         return false;
     advance_state(game);
@@ -172,6 +193,14 @@ int JNB_API GAME_get_undo_avail(struct Game *game) {
     return game->undo_avail;
 }
 
+bool JNB_API GAME_is_solved(struct Game *game) {
+    return game_is_solved(get_current_state(game));
+}
+
+int JNB_API GAME_colors_remaining(struct Game *game) {
+    return game_colors_remaining(get_current_state(game));
+}
+
 CellType JNB_API GAME_get_cell_type(struct Game *game, struct Cell *cell) {
     return cell->type;
 }
@@ -202,6 +231,33 @@ bool JNB_API GAME_block_is_fixed(struct Game *game, blockidx_t block) {
     return get_current_state(game)->blocks[block].fixed;
 }
 
+/// @brief Get the directions a block can be moved in.
+/// @return A mask of `1 << dir` bits, 0 if the block doesn't exist
+int8_t JNB_API GAME_block_movable_dirs(struct Game *game, blockidx_t block) {
+    const struct LegalMoves *legal = get_legal_moves(game);
+    if (block >= legal->block_count)
+        return 0;
+    int8_t res = 0;
+    for (MoveBlockDir dir = MOVE_BLOCK_LEFT; dir <= MOVE_BLOCK_RIGHT; ++dir) {
+        if (block_set_has(&legal->movable[dir], block))
+            res |= 1 << dir;
+    }
+    return res;
+}
+
+/// @brief Check whether `other` moves as well when moving `block` in `dir`.
+/// @return Always `false` if the move isn't legal
+bool JNB_API GAME_block_pushes(
+    struct Game *game, blockidx_t block, MoveBlockDir dir, blockidx_t other) {
+    if (!DIR_IS_HORIZONTAL(dir))
+        return false;
+    const struct LegalMoves *legal = get_legal_moves(game);
+    if (block >= legal->block_count || other >= legal->block_count)
+        return false;
+    return block_set_has(&legal->movable[dir], block) &&
+        block_set_has(&legal->pushed[block][dir], other);
+}
+
 static const struct BoardPos DIR_DELTAS[4] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
 
 int32_t JNB_API GAME_get_cell_coords(struct Game *game, struct Cell *cell) {
@@ -270,9 +326,15 @@ int8_t JNB_API GAME_cell_where_connected(struct Game *game, struct Cell *cell) {
 }
 
 const char *JNB_API GAME_get_current_state_b64(struct Game *game) {
-    free(game->b64_buf);
-    game->b64_buf = b64_encode_alloc(
-        get_current_state(game), game_get_size(get_current_state(game)));
+    // sized for the biggest state once, rather than reallocated every call
+    if (game->b64_buf == NULL) {
+        game->b64_buf = malloc(b64_encoded_size(GAME_STATE_MAX_SIZE) + 1);
+        if (game->b64_buf == NULL)
+            return NULL;
+    }
+    b64_encode(
+        game->b64_buf, get_current_state(game),
+        game_get_size(get_current_state(game)));
     return game->b64_buf;
 }
 
@@ -293,3 +355,111 @@ void GAME_test(struct Game *game) {
         free(str);
     }
 }
+
+// checks whether the current state is still on the path of the hint solution
+static bool hint_sync(struct Game *game) {
+    if (game->hint == NULL)
+        return false;
+    int progress = solver_find_on_path(game->hint, get_current_state(game));
+    if (progress < 0)
+        return false;
+    game->hint_progress = progress;
+    return true;
+}
+
+/// @brief Start a hint search from the current state. If a previous search
+/// already found a solution that passes through the current state, it is
+/// reused instead.
+/// @return Whether or not memory allocation succeeded
+bool JNB_API GAME_hint_begin(struct Game *game) {
+    if (hint_sync(game))
+        return true;
+
+    solver_free(&game->hint);
+    game->hint_progress = 0;
+    struct SolverOptions options = {
+        .mode = SOLVER_MODE_ASTAR,
+        .max_nodes = HINT_MAX_NODES,
+    };
+    game->hint = solver_new(get_current_state(game), &options);
+    return game->hint != NULL;
+}
+
+/// @brief Advance the hint search by at most `budget_nodes` expansions.
+/// @return A `SolverStatus`, or -1 if there is no search in progress
+int JNB_API GAME_hint_step(struct Game *game, int budget_nodes) {
+    if (game->hint == NULL)
+        return -1;
+    if (budget_nodes <= 0)
+        return solver_get_status(game->hint);
+    return solver_step(game->hint, budget_nodes);
+}
+
+/// @brief Get the suggested move from the current state, encoded as
+/// `(x << 16) | (y << 8) | dir`, where (x, y) is a cell of the block to move.
+/// @return -1 if there is no suggestion (not solved yet, the state left the
+/// solution path or it is already solved)
+int32_t JNB_API GAME_hint_result(struct Game *game) {
+    if (!hint_sync(game))
+        return -1;
+
+    int length;
+    const struct SolverMove *moves = solver_get_solution(game->hint, &length);
+    if (game->hint_progress >= length)
+        return -1;
+
+    const struct SolverMove *move = &moves[game->hint_progress];
+    return (move->pos.x << 16) | (move->pos.y << 8) | move->dir;
+}
+
+/// @brief Get the rest of the hint solution, from the current state on, as a
+/// string that `GAME_replay_load` accepts.
+/// @return `NULL` if there is no solution for the current state
+const char *JNB_API GAME_hint_solution(struct Game *game) {
+    if (!hint_sync(game))
+        return NULL;
+
+    int length;
+    const struct SolverMove *moves = solver_get_solution(game->hint, &length);
+    moves += game->hint_progress;
+    length -= game->hint_progress;
+    size_t size = solver_solution_to_string(moves, length, NULL, 0) + 1;
+    char *buf = realloc(game->solution_buf, size);
+    if (buf == NULL)
+        return NULL;
+    game->solution_buf = buf;
+    solver_solution_to_string(moves, length, buf, size);
+    return buf;
+}
+
+/// @brief Load a solution string to be replayed from the current state with
+/// `GAME_replay_step`. Every move is checked up front.
+/// @return Whether or not the string is a valid sequence of moves
+bool JNB_API GAME_replay_load(struct Game *game, const char *str) {
+    free(game->replay);
+    game->replay_length = 0;
+    game->replay_progress = 0;
+
+    int max_length = strlen(str) / 3;
+    game->replay = malloc((max_length + 1) * sizeof(struct SolverMove));
+    if (game->replay == NULL)
+        return false;
+    int length = solver_solution_from_string(
+        get_current_state(game), str, game->replay, max_length);
+    if (length < 0)
+        return false;
+    game->replay_length = length;
+    return true;
+}
+
+/// @brief Play the next move of the loaded replay, as if the player had.
+/// @return Whether or not a move was played; false once the replay is over
+bool JNB_API GAME_replay_step(struct Game *game) {
+    if (game->replay_progress >= game->replay_length)
+        return false;
+    const struct SolverMove *move = &game->replay[game->replay_progress];
+    if (!GAME_move_piece(game, move->pos.x, move->pos.y, move->dir))
+        return false;
+    ++game->replay_progress;
+    return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "game.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief A level of the web build, preprocessed when building it by
+/// `embed_levels`, so that starting a game only copies it.
+struct EmbeddedLevel {
+    const char *name;
+    /// @brief The preprocessed start state, `level` zeroed.
+    const uint8_t *state;
+    size_t state_size;
+    /// @brief Its level template, see `game_level_template`.
+    const uint8_t *level;
+    size_t level_size;
+};
+
+/// @brief The levels, generated by `embed_levels` into a source file of their
+/// own.
+extern const struct EmbeddedLevel embedded_levels[];
+extern const int embedded_level_count;
+/// @brief `web_levels_layout` of the build that preprocessed them.
+extern const uint64_t embedded_levels_layout;
+
+/// @brief Identify the layout of preprocessed states and level templates; a
+/// build with a different one can't use the bytes of embedded levels and
+/// fails to load them, which is why build_wasm.sh embeds them again every
+/// time.
+static inline uint64_t web_levels_layout(void) {
+    uint64_t sizes[] = {
+        BOARD_WIDTH,
+        BOARD_HEIGHT,
+        sizeof(struct Cell),
+        sizeof(struct Block),
+        sizeof(struct GameState),
+        offsetof(struct GameState, level),
+        offsetof(struct GameState, block_count),
+        offsetof(struct GameState, blocks),
+        game_level_template_size(),
+    };
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+        h = (h ^ sizes[i]) * 0x100000001b3ull;
+    return h;
+}
@@ -1,5 +1,7 @@
 const FUNCLIST = [
   ["GAME_test", null, ["number"]],
+  ["GAME_get_level_count", "number", []],
+  ["GAME_new_level", "number", ["number"]],
   ["GAME_new", "number", []],
   ["GAME_free", null, ["number"]],
   ["GAME_undo", "boolean", ["number"]],
@@ -8,16 +10,30 @@ const FUNCLIST = [
   ["GAME_get_move_count", "number", ["number"]],
   ["GAME_get_action_count", "number", ["number"]],
   ["GAME_get_undo_avail", "number", ["number"]],
+  ["GAME_is_solved", "boolean", ["number"]],
+  ["GAME_colors_remaining", "number", ["number"]],
   ["GAME_get_cell_type", "number", ["number", "number"]],
   ["GAME_get_color", "number", ["number", "number"]],
   ["GAME_piece_where_can_connect", "number", ["number", "number"]],
   ["GAME_get_block", "number", ["number", "number"]],
   ["GAME_block_is_fixed", "number", ["number", "number"]],
+  ["GAME_block_movable_dirs", "number", ["number", "number"]],
+  [
+    "GAME_block_pushes",
+    "boolean",
+    ["number", "number", "number", "number"],
+  ],
   ["GAME_get_cell_coords", "number", ["number", "number"]],
   ["GAME_print_current_state", null, ["number"]],
   ["GAME_get_current_state_block_count", "number", ["number"]],
   ["GAME_cell_where_connected", "number", ["number", "number"]],
   ["GAME_get_current_state_b64", "string", ["number"]],
+  ["GAME_hint_begin", "boolean", ["number"]],
+  ["GAME_hint_step", "number", ["number", "number"]],
+  ["GAME_hint_result", "number", ["number"]],
+  ["GAME_hint_solution", "string", ["number"]],
+  ["GAME_replay_load", "boolean", ["number", "string"]],
+  ["GAME_replay_step", "boolean", ["number"]],
 ];
 
 // TODO: decorations
@@ -48,6 +64,8 @@ const TILE_SIZE = 192;
 const ATLAS_WIDTH = 1920;
 const ATLAS_HEIGHT = 192;
 
+// the instance of the module, once it is ready
+let Module = null;
 let game = null;
 let canvas = null;
 let ctx = null;
@@ -55,6 +73,11 @@ const atlas = new Image();
 let atlas_loaded = false;
 let random_colors = sessionStorage.getItem("random_colors") == "true";
 let cell_selected_pos = null;
+// direction the mouse is pointing at relative to the selected cell
+let hover_dir = null;
+// [x, y, dir] of the suggested move, if any
+let hint_move = null;
+let hint_running = false;
 
 function shuffle(array) {
   let currentIndex = array.length,
@@ -90,6 +113,19 @@ const DIR = {
   DOWN: 3,
 };
 
+const SOLVER_STATUS = {
+  RUNNING: 0,
+  SOLVED: 1,
+  UNSOLVABLE: 2,
+  LIMIT: 3,
+};
+
+// number of node expansions per call, small enough to keep a call well under a
+// millisecond; calls are repeated until the frame budget is used up
+const HINT_SLICE_NODES = 32;
+const HINT_FRAME_BUDGET_MS = 4;
+const REPLAY_MOVE_MS = 400;
+
 const CON_DIR = {
   LEFT: 1 << DIR.LEFT,
   RIGHT: 1 << DIR.RIGHT,
@@ -196,7 +232,19 @@ function get_final_atlas_pos(macrotile_pos, minitile_idx, microtile_rel_pos) {
   ];
 }
 
+function update_status() {
+  const status = document.getElementById("status");
+  if (GAME_is_solved(game)) {
+    status.textContent = "Solved in " + GAME_get_move_count(game) + " moves!";
+    return;
+  }
+  const remaining = GAME_colors_remaining(game);
+  status.textContent =
+    remaining + (remaining == 1 ? " color" : " colors") + " left to join";
+}
+
 function draw_game() {
+  update_status();
   ctx.clearRect(0, 0, canvas.width, canvas.height);
   if (!atlas_loaded) {
     draw_game_primitive();
@@ -276,15 +324,121 @@ function draw_game() {
     }
   }
 
+  if (hint_move) {
+    draw_hint(hint_move[0], hint_move[1], hint_move[2]);
+  }
+
   if (cell_selected_pos) {
     const x = cell_selected_pos[0];
     const y = cell_selected_pos[1];
+    draw_push_preview(x, y);
     ctx.lineWidth = 3;
     ctx.strokeStyle = "#32CD32";
     ctx.strokeRect(x * CELL_SIZE, y * CELL_SIZE, CELL_SIZE, CELL_SIZE);
   }
 }
 
+// outlines every cell that would move if the selected block was moved towards
+// the mouse, or the selected cell in red if that move is blocked
+function draw_push_preview(sel_x, sel_y) {
+  if (hover_dir === null) {
+    return;
+  }
+  const block = GAME_get_block(game, GAME_get_cell(game, sel_x, sel_y));
+  ctx.lineWidth = 3;
+  if (!(GAME_block_movable_dirs(game, block) & (1 << hover_dir))) {
+    ctx.strokeStyle = "#e33b3b";
+    ctx.strokeRect(sel_x * CELL_SIZE, sel_y * CELL_SIZE, CELL_SIZE, CELL_SIZE);
+    return;
+  }
+  ctx.strokeStyle = "#e6e86a";
+  for (let y = 0; y < BOARD_HEIGHT; y++) {
+    for (let x = 0; x < BOARD_WIDTH; x++) {
+      const cell = GAME_get_cell(game, x, y);
+      if (GAME_get_cell_type(game, cell) != CELL_TYPE.PIECE) {
+        continue;
+      }
+      const other = GAME_get_block(game, cell);
+      if (GAME_block_pushes(game, block, hover_dir, other)) {
+        ctx.strokeRect(x * CELL_SIZE, y * CELL_SIZE, CELL_SIZE, CELL_SIZE);
+      }
+    }
+  }
+}
+
+function draw_hint(x, y, dir) {
+  ctx.lineWidth = 3;
+  ctx.strokeStyle = "#1e90ff";
+  ctx.strokeRect(x * CELL_SIZE, y * CELL_SIZE, CELL_SIZE, CELL_SIZE);
+
+  // small triangle pointing in the direction of the move
+  const cx = (x + 0.5) * CELL_SIZE;
+  const cy = (y + 0.5) * CELL_SIZE;
+  const size = CELL_SIZE / 4;
+  const sign = dir == DIR.LEFT ? -1 : 1;
+  ctx.fillStyle = "#1e90ff";
+  ctx.beginPath();
+  ctx.moveTo(cx + sign * size, cy);
+  ctx.lineTo(cx - sign * size, cy - size);
+  ctx.lineTo(cx - sign * size, cy + size);
+  ctx.closePath();
+  ctx.fill();
+}
+
+function update_hint_move() {
+  const res = GAME_hint_result(game);
+  hint_move = res < 0 ? null : [res >> 16, (res >> 8) & 0xff, res & 0xff];
+}
+
+// runs the hint search in slices, so that the page stays responsive
+function hint_frame() {
+  const start = performance.now();
+  let status = SOLVER_STATUS.RUNNING;
+  while (
+    status == SOLVER_STATUS.RUNNING &&
+    performance.now() - start < HINT_FRAME_BUDGET_MS
+  ) {
+    status = GAME_hint_step(game, HINT_SLICE_NODES);
+  }
+
+  if (status == SOLVER_STATUS.RUNNING) {
+    requestAnimationFrame(hint_frame);
+    return;
+  }
+
+  hint_running = false;
+  if (status != SOLVER_STATUS.SOLVED) {
+    console.log("No hint available, solver status: " + status);
+  } else {
+    // can be replayed with ?solution=... from the same state
+    console.log("Solution: " + GAME_hint_solution(game));
+  }
+  update_hint_move();
+  draw_game();
+}
+
+function hint_handler() {
+  if (hint_running) {
+    return;
+  }
+  if (!GAME_hint_begin(game)) {
+    console.log("Failed to start the hint search");
+    return;
+  }
+  hint_running = true;
+  requestAnimationFrame(hint_frame);
+}
+
+// plays the loaded replay one move at a time
+function replay_tick() {
+  if (!GAME_replay_step(game)) {
+    return;
+  }
+  update_hint_move();
+  draw_game();
+  setTimeout(replay_tick, REPLAY_MOVE_MS);
+}
+
 function get_tile_atlas_pos(cell) {
   const type = GAME_get_cell_type(game, cell);
   if (type == CELL_TYPE.WALL || type == CELL_TYPE.EMERGE) {
@@ -315,6 +469,21 @@ function get_hovered_cell(evt) {
   return [x, y];
 }
 
+function move_handler(evt) {
+  if (!cell_selected_pos) {
+    return;
+  }
+  const pos = get_hovered_cell(evt);
+  let dir = null;
+  if (pos[0] != cell_selected_pos[0]) {
+    dir = pos[0] < cell_selected_pos[0] ? DIR.LEFT : DIR.RIGHT;
+  }
+  if (dir !== hover_dir) {
+    hover_dir = dir;
+    draw_game();
+  }
+}
+
 function click_handler(evt) {
   const pos = get_hovered_cell(evt);
   const cell = GAME_get_cell(game, pos[0], pos[1]);
@@ -327,13 +496,20 @@ function click_handler(evt) {
     if (pos[0] == cell_selected_pos[0]) {
       if (pos[1] != cell_selected_pos[1]) {
         cell_selected_pos = null;
+        hover_dir = null;
       }
       return;
     }
 
     const dir = pos[0] < cell_selected_pos[0] ? DIR.LEFT : DIR.RIGHT;
-    GAME_move_piece(game, cell_selected_pos[0], cell_selected_pos[1], dir);
+    const x = cell_selected_pos[0];
+    const y = cell_selected_pos[1];
+    if (GAME_move_piece(game, x, y, dir)) {
+      // only shows something if the move followed the previous hint
+      update_hint_move();
+    }
     cell_selected_pos = null;
+    hover_dir = null;
   } else {
     if (GAME_get_cell_type(game, cell) != CELL_TYPE.PIECE) {
       return;
@@ -361,7 +537,15 @@ function main() {
   canvas.width = CELL_SIZE * BOARD_WIDTH;
   canvas.height = CELL_SIZE * BOARD_HEIGHT;
 
-  game = GAME_new();
+  const params = urlparams_to_obj(new URLSearchParams(window.location.search));
+  // the levels are embedded in the module, already preprocessed
+  const level = parseInt(params.level ?? "0");
+  if (level >= 0 && level < GAME_get_level_count()) {
+    game = GAME_new_level(level);
+  } else {
+    console.log("No level " + params.level + ", starting the first one");
+    game = GAME_new();
+  }
   console.log(game);
 
   if (window.location.hash) {
@@ -371,11 +555,20 @@ function main() {
     const data = atob(b64);
   }
 
+  if (params.solution) {
+    if (GAME_replay_load(game, params.solution)) {
+      setTimeout(replay_tick, REPLAY_MOVE_MS);
+    } else {
+      console.log("Invalid solution: " + params.solution);
+    }
+  }
+
   if (random_colors) {
     color_table = color_table.slice(0, 2).concat(shuffle(color_table.slice(2)));
   }
 
   draw_game();
+  console.log("First frame after " + performance.now().toFixed(1) + " ms");
 
   atlas.onload = function () {
     atlas_loaded = true;
@@ -386,9 +579,16 @@ function main() {
   atlas.src = "assets/atlas.png";
 
   canvas.addEventListener("click", click_handler);
+  canvas.addEventListener("mousemove", move_handler);
+  document.getElementById("hint").addEventListener("click", hint_handler);
 }
 
-Module.onRuntimeInitialized = main;
+// build_wasm.sh makes the module a factory; it starts streaming and compiling
+// jnb.wasm right away, which index.html already preloads
+createJnb().then((instance) => {
+  Module = instance;
+  main();
+});
 
 function urlparams_to_obj(entries) {
   const res = {};
@@ -1,9 +1,37 @@
 add_rules("mode.debug", "mode.release")
 
+-- the largest board a level can have, 14x10 if not set; bigger boards make
+-- every state bigger, smaller levels are padded with walls
+option("board_width")
+    set_showmenu(true)
+    set_description("Width of the board, at most 26")
+option_end()
+
+option("board_height")
+    set_showmenu(true)
+    set_description("Height of the board, at most 26")
+option_end()
+
 target("jellynobrain")
     set_languages("c17")
     set_kind("binary")
-    add_files("src/game.c", "src/main.c", "src/util.c")
+    add_files(
+        "src/b64.c", "src/bigmem.c", "src/cache.c", "src/census.c",
+        "src/game.c", "src/generator.c", "src/host.c", "src/main.c",
+        "src/pack.c", "src/server.c", "src/solver.c", "src/solver_ext.c",
+        "src/util.c", "src/verifier.c")
+    -- the level generator, the verifier, the server, the game host and the
+    -- census run on several threads
+    add_defines("JNB_THREADING")
+    if has_config("board_width") then
+        add_defines("BOARD_WIDTH=" .. get_config("board_width"))
+    end
+    if has_config("board_height") then
+        add_defines("BOARD_HEIGHT=" .. get_config("board_height"))
+    end
+    if not is_plat("windows") then
+        add_syslinks("pthread", "m")
+    end
     if is_mode("debug") then
         add_defines("DEBUG")
         add_cflags("-fsanitize=address,undefined", { tools = "clang"})
@@ -12,6 +40,27 @@ target("jellynobrain")
         add_ldflags("-fsanitize=address,undefined,leak", { tools = "gxx"})
     end
 
+-- checks the move engines against a reference implementation of the rules on
+-- random levels and states, and IDA* against BFS, like `xmake run engine_diff
+-- --seed 2 --iterations 100000`, with level files to play those instead, such
+-- as levels/regressions.txt; fails on any mismatch
+target("engine_diff")
+    set_default(false)
+    set_languages("c17")
+    set_kind("binary")
+    add_files(
+        "src/bigmem.c", "src/engine_diff.c", "src/game.c", "src/generator.c",
+        "src/pack.c", "src/solver.c", "src/solver_ext.c", "src/util.c")
+    if has_config("board_width") then
+        add_defines("BOARD_WIDTH=" .. get_config("board_width"))
+    end
+    if has_config("board_height") then
+        add_defines("BOARD_HEIGHT=" .. get_config("board_height"))
+    end
+    if not is_plat("windows") then
+        add_syslinks("m")
+    end
+
 --
 -- If you want to known more usage about xmake, please see https://xmake.io
 --